@@ -0,0 +1,223 @@
+#include "ClientConfig.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+namespace
+{
+    bool ParseUnsigned(const char* value, unsigned long long maxValue, unsigned long long& result)
+    {
+        char* end = nullptr;
+        errno = 0;
+        result = strtoull(value, &end, 10);
+
+        return errno == 0 && end != value && *end == '\0' && result <= maxValue;
+    }
+
+    // A byte count with an optional K, M or G suffix (powers of 1024)
+    bool ParseSize(const char* value, unsigned long long maxValue, unsigned long long& result)
+    {
+        char* end = nullptr;
+        errno = 0;
+        result = strtoull(value, &end, 10);
+
+        if (errno != 0 || end == value)
+        {
+            return false;
+        }
+
+        const char* suffixes = "KMG";
+        const char* suffix = *end != '\0' ? strchr(suffixes, *end) : nullptr;
+
+        if (suffix)
+        {
+            result <<= 10 * (suffix - suffixes + 1);
+            ++end;
+        }
+
+        return *end == '\0' && result <= maxValue;
+    }
+
+    void PrintUsage(const char* program)
+    {
+        printf("Usage: %s [options]\n"
+            "  --address=ADDR   server address (default 127.0.0.1)\n"
+            "  --port=PORT      server port (default 8865)\n"
+            "  --packages=N     packages of every test file (default 20)\n"
+            "  --congestion=aimd|none\n"
+            "                   send the test files with a paced congestion window (default) or all at once\n"
+            "  --load           generate load instead of sending the three test files, options below\n"
+            "  --files=N        files in flight over all threads (default 64)\n"
+            "  --total-files=N  stop starting files after N (default 0, only --duration)\n"
+            "  --duration=S     stop starting files after S seconds (default 10, 0 is no limit)\n"
+            "  --file-size=SIZE mean file size in bytes, K/M/G suffixes allowed (default 1M)\n"
+            "  --size-distribution=fixed|uniform|exponential\n"
+            "                   file sizes around --file-size (default fixed)\n"
+            "  --threads=N      sender threads (default 1)\n"
+            "  --ports=N        source ports per thread (default 1)\n"
+            "  --rate=PPS       packets per second over all threads (default 0, unlimited)\n"
+            "  --window=N       unacknowledged packages per file (default 32)\n"
+            "  --timeout=MS     resend a package unacknowledged for MS (default 200)\n"
+            "  --sack=on|off    ask for selective ACKs, also for the test files (default off)\n"
+            "  --log-level=debug|info|warning|error\n"
+            "                   lowest level logged, debug adds a line per package (default info)\n",
+            program);
+    }
+}
+
+bool ParseArguments(int argc, char** argv, ClientConfig& config)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* argument = argv[i];
+        const char* value = strchr(argument, '=');
+        const std::string name = value ? std::string(argument, value - argument) : std::string(argument);
+        value = value ? value + 1 : "";
+
+        unsigned long long number = 0;
+        bool isValid = true;
+
+        if (name == "--help")
+        {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (name == "--address")
+        {
+            config.address = value;
+        }
+        else if (name == "--port")
+        {
+            isValid = ParseUnsigned(value, 65535, number) && number > 0;
+            config.port = (unsigned short)number;
+        }
+        else if (name == "--log-level")
+        {
+            if (strcmp(value, "debug") == 0)
+            {
+                config.logLevel = LogLevel::Debug;
+            }
+            else if (strcmp(value, "info") == 0)
+            {
+                config.logLevel = LogLevel::Info;
+            }
+            else if (strcmp(value, "warning") == 0)
+            {
+                config.logLevel = LogLevel::Warning;
+            }
+            else if (strcmp(value, "error") == 0)
+            {
+                config.logLevel = LogLevel::Error;
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        else if (name == "--packages")
+        {
+            isValid = ParseUnsigned(value, 1 << 24, number) && number > 0;
+            config.packages = (unsigned)number;
+        }
+        else if (name == "--congestion")
+        {
+            isValid = strcmp(value, "aimd") == 0 || strcmp(value, "none") == 0;
+            config.congestion = strcmp(value, "none") == 0 ? CongestionMode::None : CongestionMode::Aimd;
+        }
+        else if (name == "--load")
+        {
+            isValid = *value == '\0';
+            config.isLoad = true;
+        }
+        else if (name == "--files")
+        {
+            isValid = ParseUnsigned(value, 1 << 20, number) && number > 0;
+            config.concurrentFiles = (unsigned)number;
+        }
+        else if (name == "--total-files")
+        {
+            isValid = ParseUnsigned(value, 1ull << 40, number);
+            config.totalFiles = number;
+        }
+        else if (name == "--duration")
+        {
+            isValid = ParseUnsigned(value, 365 * 24 * 3600, number);
+            config.duration = (unsigned)number;
+        }
+        else if (name == "--file-size")
+        {
+            isValid = ParseSize(value, 1ull << 40, number) && number > 0;
+            config.fileSize = number;
+        }
+        else if (name == "--size-distribution")
+        {
+            if (strcmp(value, "fixed") == 0)
+            {
+                config.sizeDistribution = SizeDistribution::Fixed;
+            }
+            else if (strcmp(value, "uniform") == 0)
+            {
+                config.sizeDistribution = SizeDistribution::Uniform;
+            }
+            else if (strcmp(value, "exponential") == 0)
+            {
+                config.sizeDistribution = SizeDistribution::Exponential;
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        else if (name == "--threads")
+        {
+            isValid = ParseUnsigned(value, 256, number) && number > 0;
+            config.threads = (unsigned)number;
+        }
+        else if (name == "--ports")
+        {
+            isValid = ParseUnsigned(value, 1024, number) && number > 0;
+            config.ports = (unsigned)number;
+        }
+        else if (name == "--rate")
+        {
+            isValid = ParseUnsigned(value, 1ull << 32, number);
+            config.rate = number;
+        }
+        else if (name == "--window")
+        {
+            isValid = ParseUnsigned(value, 1 << 20, number) && number > 0;
+            config.window = (unsigned)number;
+        }
+        else if (name == "--timeout")
+        {
+            isValid = ParseUnsigned(value, 3600 * 1000, number) && number > 0;
+            config.timeout = (unsigned)number;
+        }
+        else if (name == "--sack")
+        {
+            isValid = strcmp(value, "on") == 0 || strcmp(value, "off") == 0;
+            config.isSack = strcmp(value, "on") == 0;
+        }
+        else
+        {
+            isValid = false;
+        }
+
+        if (!isValid)
+        {
+            printf("Invalid argument: %s\n", argument);
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (config.isLoad && config.duration == 0 && config.totalFiles == 0)
+    {
+        printf("--duration=0 needs --total-files\n");
+        PrintUsage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
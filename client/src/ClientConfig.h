@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "Logger.h"
+
+enum class CongestionMode
+{
+    Aimd,   // congestion window with slow start, loss detection from the ACKs and pacing over the RTT
+    None    // every package at once, everything unacknowledged again after 3 s
+};
+
+enum class SizeDistribution
+{
+    Fixed,      // every file has fileSize bytes
+    Uniform,    // uniform in [1, 2 * fileSize]
+    Exponential // exponential with mean fileSize, capped at 16 * fileSize
+};
+
+struct ClientConfig
+{
+    std::string address = "127.0.0.1";
+    unsigned short port = 8865;
+
+    // Without it the client sends its three small test files once and exits
+    bool isLoad = false;
+
+    // Test files: packages per file and how they are sent
+    unsigned packages = 20;
+    CongestionMode congestion = CongestionMode::Aimd;
+
+    // Load generator: files in flight over all threads, started until `duration` seconds passed
+    // or `totalFiles` files were started (0 is no limit)
+    unsigned concurrentFiles = 64;
+    uint64_t totalFiles = 0;
+    unsigned duration = 10;
+    uint64_t fileSize = 1 << 20;
+    SizeDistribution sizeDistribution = SizeDistribution::Fixed;
+
+    // Sender threads, each with its own source ports; files are spread over both round-robin
+    unsigned threads = 1;
+    unsigned ports = 1;
+
+    // Packets per second over all threads, 0 sends as fast as the windows allow
+    uint64_t rate = 0;
+    // Unacknowledged packages per file and the time after which one is sent again
+    unsigned window = 32;
+    unsigned timeout = 200;
+    // Ask the server for selective ACKs, which cover many packages each, instead of one ACK per package;
+    // both modes, off by default since servers without them ignore the flagged packages
+    bool isSack = false;
+
+    // Lowest level logged at run time, Debug adds a line per package
+    LogLevel logLevel = LogLevel::Info;
+};
+
+// Parses "--name=value" arguments, prints usage and returns false on unknown or malformed ones
+bool ParseArguments(int argc, char** argv, ClientConfig& config);
@@ -0,0 +1,112 @@
+#include "CongestionControl.h"
+#include <algorithm>
+
+namespace
+{
+    constexpr double INITIAL_WINDOW = 10;
+    constexpr double MIN_WINDOW = 2;
+    constexpr double MAX_WINDOW = 1 << 16;
+
+    constexpr std::chrono::milliseconds INITIAL_RTO(1000);
+    constexpr std::chrono::milliseconds MIN_RTO(200);
+    constexpr std::chrono::seconds MAX_RTO(60);
+    constexpr unsigned MAX_BACKOFF = 64;
+
+    // Pacing runs ahead of the window, faster while it still doubles every round trip
+    constexpr double SLOW_START_PACING_GAIN = 2.0;
+    constexpr double PACING_GAIN = 1.25;
+    // Packages an idle sender may send back to back, it doesn't save up a whole window
+    constexpr double MAX_BURST = 4;
+}
+
+CongestionControl::CongestionControl()
+    : m_window(INITIAL_WINDOW)
+    , m_threshold(MAX_WINDOW)
+    , m_srtt(0)
+    , m_rttVariation(0)
+    , m_rto(INITIAL_RTO)
+    , m_hasRtt(false)
+    , m_backoff(1)
+{
+}
+
+bool CongestionControl::CanSend(unsigned inFlight, Clock::time_point now) const
+{
+    return inFlight < (unsigned)m_window && now >= m_nextSend;
+}
+
+void CongestionControl::OnSend(Clock::time_point now)
+{
+    // Without an RTT sample there is nothing to pace over, the initial window goes out at once
+    if (!m_hasRtt)
+    {
+        return;
+    }
+
+    const double gain = m_window < m_threshold ? SLOW_START_PACING_GAIN : PACING_GAIN;
+    const auto interval = std::chrono::duration_cast<Clock::duration>(m_srtt / (gain * m_window));
+    const auto earliest = now - std::chrono::duration_cast<Clock::duration>(interval * MAX_BURST);
+
+    m_nextSend = std::max(m_nextSend, earliest) + interval;
+}
+
+CongestionControl::Clock::time_point CongestionControl::GetNextSendTime() const
+{
+    return m_nextSend;
+}
+
+void CongestionControl::OnAck(Clock::duration rtt)
+{
+    if (rtt > Clock::duration::zero())
+    {
+        if (!m_hasRtt)
+        {
+            m_srtt = rtt;
+            m_rttVariation = rtt / 2;
+            m_hasRtt = true;
+        }
+        else
+        {
+            const Clock::duration deviation = m_srtt > rtt ? m_srtt - rtt : rtt - m_srtt;
+            m_rttVariation = (m_rttVariation * 3 + deviation) / 4;
+            m_srtt = (m_srtt * 7 + rtt) / 8;
+        }
+
+        m_rto = std::clamp<Clock::duration>(m_srtt + m_rttVariation * 4, MIN_RTO, MAX_RTO);
+        m_backoff = 1;
+    }
+
+    m_window = std::min(MAX_WINDOW, m_window < m_threshold ? m_window + 1 : m_window + 1 / m_window);
+}
+
+void CongestionControl::OnLoss(Clock::time_point sendTime, Clock::time_point now, bool isTimeout)
+{
+    if (sendTime < m_recoveryStart)
+    {
+        return;
+    }
+
+    if (isTimeout)
+    {
+        m_backoff = std::min(m_backoff * 2, MAX_BACKOFF);
+    }
+
+    m_threshold = std::max(MIN_WINDOW, m_window / 2);
+    m_window = isTimeout ? MIN_WINDOW : m_threshold;
+    m_recoveryStart = now;
+}
+
+double CongestionControl::GetWindow() const
+{
+    return m_window;
+}
+
+CongestionControl::Clock::duration CongestionControl::GetRtt() const
+{
+    return m_srtt;
+}
+
+CongestionControl::Clock::duration CongestionControl::GetRto() const
+{
+    return std::min<Clock::duration>(m_rto * m_backoff, MAX_RTO);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+
+// AIMD congestion window towards one destination: slow start up to the threshold, then one package
+// more per window of ACKs; a loss halves the window, a retransmission timeout restarts slow start.
+// The window shrinks once per loss episode, packages sent before the last reduction don't count.
+// The RTT is estimated as in RFC 6298, and sends are paced over the smoothed RTT so a window
+// goes out spread over a round trip instead of as one burst.
+class CongestionControl
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    CongestionControl();
+
+    // Whether the window and the pacing let another package go out at `now`
+    bool CanSend(unsigned inFlight, Clock::time_point now) const;
+    void OnSend(Clock::time_point now);
+    // When the pacing lets the next package go
+    Clock::time_point GetNextSendTime() const;
+
+    // Retransmitted packages give no RTT sample (Karn), they pass a zero rtt
+    void OnAck(Clock::duration rtt);
+    void OnLoss(Clock::time_point sendTime, Clock::time_point now, bool isTimeout);
+
+    double GetWindow() const;
+    Clock::duration GetRtt() const;
+    Clock::duration GetRto() const;
+
+private:
+    double m_window;                    // packages
+    double m_threshold;                 // slow start threshold
+    Clock::duration m_srtt;
+    Clock::duration m_rttVariation;
+    Clock::duration m_rto;
+    bool m_hasRtt;
+    unsigned m_backoff;                 // RTO multiplier after timeouts, reset by the next RTT sample
+    Clock::time_point m_recoveryStart;  // of the last window reduction
+    Clock::time_point m_nextSend;
+};
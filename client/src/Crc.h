@@ -3,15 +3,25 @@
 #include <stddef.h>
 #include <stdint.h>
 
-uint32_t crc32c(uint32_t crc, const unsigned char* buf, size_t len)
-{
-    int k;
+// CRC-32C (Castagnoli). Returns bit-identical results to the bitwise reference from Task.txt.
+// The implementation is picked once at startup: SSE4.2 crc32 instructions with 3-way interleaving,
+// PCLMULQDQ folding for large buffers, or a portable slicing-by-8 table fallback.
+uint32_t crc32c(uint32_t crc, const unsigned char* buf, size_t len);
 
-    crc = ~crc;
-    while (len--) {
-        crc ^= *buf++;
-        for (k = 0; k < 8; k++)
-            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
-    }
-    return ~crc;
-}
+// CRC of the concatenation A|B from crcA = crc32c(crc, A) and crcB = crc32c(0, B), in O(log lenB)
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, size_t lenB);
+
+// Checksums a large buffer in chunks on up to `threads` threads and merges them with crc32c_combine
+uint32_t crc32c_parallel(uint32_t crc, const unsigned char* buf, size_t len, unsigned threads);
+
+// Name of the implementation selected by crc32c
+const char* crc32c_implementation();
+
+// Individual implementations, exposed for benchmarks and verification.
+// The hardware ones may only be called when the matching *_supported() returns true.
+uint32_t crc32c_reference(uint32_t crc, const unsigned char* buf, size_t len);
+uint32_t crc32c_sw(uint32_t crc, const unsigned char* buf, size_t len);
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char* buf, size_t len);
+uint32_t crc32c_pclmul(uint32_t crc, const unsigned char* buf, size_t len);
+bool crc32c_sse42_supported();
+bool crc32c_pclmul_supported();
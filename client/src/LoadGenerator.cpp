@@ -0,0 +1,565 @@
+#include "LoadGenerator.h"
+#include "Crc.h"
+#include "Logger.h"
+#include <poll.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    constexpr unsigned char PUT = 1;
+    constexpr unsigned char ACK = 0;
+    // Selective ACKs: requested with the flag on the PUT type, the cumulative point comes as seq_number,
+    // then the first package of the bitmap window and the window
+    constexpr unsigned char SACK = 2;
+    constexpr unsigned char SACK_FLAG = 0x80;
+    constexpr unsigned SACK_WORDS = 5;
+    constexpr size_t ID_SIZE = 8;
+    constexpr size_t HEADER_SIZE =
+        sizeof(unsigned) +      // seq_number
+        sizeof(unsigned) +      // seq_total
+        sizeof(unsigned char) + // type
+        ID_SIZE * sizeof(char); // id
+    constexpr size_t MAX_PACKAGE_SIZE = 1472;
+    constexpr size_t MAX_DATA_SIZE = MAX_PACKAGE_SIZE - HEADER_SIZE;
+    constexpr size_t SACK_SIZE = HEADER_SIZE + sizeof(unsigned) + SACK_WORDS * sizeof(uint64_t);
+    constexpr size_t ACK_BUFFER_SIZE = 64;
+    constexpr int ACK_RECEIVE_BUFFER = 4 << 20;
+
+    // Random contents every file takes a window of, wrapping around per package
+    constexpr size_t DATA_SIZE = 16 << 20;
+    // Packages a thread sends before it looks at its ACKs again
+    constexpr unsigned SEND_BURST = 256;
+    constexpr std::chrono::seconds REPORT_INTERVAL(1);
+
+    const char DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    double Percentile(std::vector<double>& values, double percentile)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+
+        const size_t index = std::min(values.size() - 1, (size_t)(percentile / 100.0 * values.size()));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    struct Totals
+    {
+        uint64_t packagesSent = 0;
+        uint64_t packagesResent = 0;
+        uint64_t acksReceived = 0;
+        uint64_t filesCompleted = 0;
+        uint64_t filesCorrupted = 0;
+        uint64_t filesFailed = 0;
+        uint64_t bytesCompleted = 0;
+        size_t filesInFlight = 0;
+    };
+}
+
+LoadGenerator::Socket::Socket()
+    : socket(NetworkProtocol::IPv4, true)
+    , sendBuffers(UdpSocket::MAX_BATCH_SIZE * MAX_PACKAGE_SIZE)
+    , receiveBuffers(UdpSocket::MAX_BATCH_SIZE * ACK_BUFFER_SIZE)
+{
+    for (unsigned i = 0; i < UdpSocket::MAX_BATCH_SIZE; ++i)
+    {
+        sends[i].buff = sendBuffers.data() + i * MAX_PACKAGE_SIZE;
+        sends[i].bufSize = MAX_PACKAGE_SIZE;
+        receives[i].buff = receiveBuffers.data() + i * ACK_BUFFER_SIZE;
+        receives[i].bufSize = ACK_BUFFER_SIZE;
+    }
+
+    // ACKs arrive in bursts while the thread is sending; the default buffer holds only a few hundred
+    int receiveBufferSize = ACK_RECEIVE_BUFFER;
+    setsockopt(socket.GetSocketId(), SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+}
+
+LoadGenerator::LoadGenerator(const ClientConfig& config)
+    : m_config(config)
+    , m_data(DATA_SIZE + MAX_DATA_SIZE)
+    , m_filesStarted(0)
+{
+    std::random_device device;
+    std::mt19937_64 random(device());
+
+    for (size_t i = 0; i < m_data.size(); i += sizeof(uint64_t))
+    {
+        const uint64_t value = random();
+        memcpy(m_data.data() + i, &value, std::min(sizeof(value), m_data.size() - i));
+    }
+
+    m_runTag = DIGITS[10 + random() % 26];
+
+    for (unsigned i = 0; i < m_config.threads; ++i)
+    {
+        auto worker = std::make_unique<Worker>();
+        worker->index = i;
+        // The remainder goes to the first workers
+        worker->concurrentFiles = m_config.concurrentFiles / m_config.threads + (i < m_config.concurrentFiles % m_config.threads ? 1 : 0);
+        worker->rate = (double)m_config.rate / m_config.threads;
+        worker->random.seed(random());
+
+        for (unsigned j = 0; j < m_config.ports; ++j)
+        {
+            worker->sockets.push_back(std::make_unique<Socket>());
+        }
+
+        m_workers.push_back(std::move(worker));
+    }
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    for (auto& worker : m_workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+bool LoadGenerator::Run()
+{
+    const auto addresses = GetAddressInfo(m_config.address, m_config.port, NetworkProtocol::IPv4);
+
+    if (addresses.empty())
+    {
+        LOG_ERROR("Can't resolve: {}:{}", m_config.address, m_config.port);
+        return false;
+    }
+
+    m_server = addresses.front().GetEndpoint();
+
+    LOG_INFO("Load: {} files in flight, {} threads x {} ports, {} bytes per file, {} packets/s (0 is unlimited)",
+        m_config.concurrentFiles, m_config.threads, m_config.ports, m_config.fileSize, m_config.rate);
+
+    const auto start = Clock::now();
+    m_deadline = m_config.duration > 0 ? start + std::chrono::seconds(m_config.duration) : Clock::time_point::max();
+
+    for (auto& worker : m_workers)
+    {
+        Worker& current = *worker;
+        current.thread = std::thread([this, &current] { ThreadProc(current); });
+    }
+
+    auto collect = [this]
+    {
+        Totals totals;
+
+        for (const auto& worker : m_workers)
+        {
+            const Counters& counters = worker->counters;
+            totals.packagesSent += counters.packagesSent.load(std::memory_order_relaxed);
+            totals.packagesResent += counters.packagesResent.load(std::memory_order_relaxed);
+            totals.acksReceived += counters.acksReceived.load(std::memory_order_relaxed);
+            totals.filesCompleted += counters.filesCompleted.load(std::memory_order_relaxed);
+            totals.filesCorrupted += counters.filesCorrupted.load(std::memory_order_relaxed);
+            totals.filesFailed += counters.filesFailed.load(std::memory_order_relaxed);
+            totals.bytesCompleted += counters.bytesCompleted.load(std::memory_order_relaxed);
+            totals.filesInFlight += counters.filesInFlight.load(std::memory_order_relaxed);
+        }
+
+        return totals;
+    };
+
+    Totals previous;
+    auto reportTime = start;
+
+    while (std::any_of(m_workers.begin(), m_workers.end(), [](const std::unique_ptr<Worker>& worker) { return !worker->isDone; }))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        const auto now = Clock::now();
+
+        if (now - reportTime < REPORT_INTERVAL)
+        {
+            continue;
+        }
+
+        const Totals totals = collect();
+        const double seconds = std::chrono::duration<double>(now - reportTime).count();
+
+        LOG_INFO("Load: {:.0f} files/s, {:.1f} MB/s goodput, {:.0f} packets/s sent ({:.0f} resent), {:.0f} acks/s, {} files in flight",
+            (totals.filesCompleted - previous.filesCompleted) / seconds, (totals.bytesCompleted - previous.bytesCompleted) / seconds / 1e6,
+            (totals.packagesSent - previous.packagesSent) / seconds, (totals.packagesResent - previous.packagesResent) / seconds,
+            (totals.acksReceived - previous.acksReceived) / seconds, totals.filesInFlight);
+
+        previous = totals;
+        reportTime = now;
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const Totals totals = collect();
+    std::vector<double> latencies;
+
+    for (auto& worker : m_workers)
+    {
+        worker->thread.join();
+        latencies.insert(latencies.end(), worker->latencies.begin(), worker->latencies.end());
+    }
+
+    LOG_INFO("Files: {} completed, {} with a wrong checksum, {} failed in {:.1f} s",
+        totals.filesCompleted, totals.filesCorrupted, totals.filesFailed, seconds);
+    LOG_INFO("Goodput: {:.1f} MB/s, {:.0f} packets/s sent, {:.0f} acks/s, {:.2f}% resent",
+        totals.bytesCompleted / seconds / 1e6, totals.packagesSent / seconds, totals.acksReceived / seconds,
+        totals.packagesSent > 0 ? 100.0 * totals.packagesResent / totals.packagesSent : 0.0);
+    LOG_INFO("Time to checksum: p50 {:.2f} ms, p99 {:.2f} ms, p999 {:.2f} ms, max {:.2f} ms",
+        Percentile(latencies, 50) / 1000, Percentile(latencies, 99) / 1000, Percentile(latencies, 99.9) / 1000,
+        latencies.empty() ? 0.0 : *std::max_element(latencies.begin(), latencies.end()) / 1000);
+
+    return totals.filesCorrupted == 0;
+}
+
+void LoadGenerator::ThreadProc(Worker& worker)
+{
+    const auto timeout = std::chrono::milliseconds(m_config.timeout);
+    // A file without any new ACK for this long is given up
+    const auto stallTimeout = std::max<Clock::duration>(std::chrono::seconds(5), timeout * 20);
+    // Token bucket of the send rate, holding at most a batch or a millisecond of packets
+    const double burst = std::max<double>(UdpSocket::MAX_BATCH_SIZE, worker.rate / 1000);
+    double tokens = burst;
+    auto tokenTime = Clock::now();
+    size_t rotation = 0;
+
+    std::vector<pollfd> events;
+
+    for (const auto& socket : worker.sockets)
+    {
+        events.push_back(pollfd{ socket->socket.GetSocketId(), POLLIN, 0 });
+    }
+
+    while (true)
+    {
+        auto now = Clock::now();
+
+        while (worker.files.size() < worker.concurrentFiles && StartFile(worker, now))
+        {
+        }
+
+        if (worker.files.empty())
+        {
+            break;
+        }
+
+        if (worker.rate > 0)
+        {
+            tokens = std::min(burst, tokens + std::chrono::duration<double>(now - tokenTime).count() * worker.rate);
+            tokenTime = now;
+        }
+
+        unsigned budget = worker.rate > 0 ? std::min<unsigned>(SEND_BURST, (unsigned)tokens) : SEND_BURST;
+        const unsigned initialBudget = budget;
+        bool isWaiting = false;  // some file could send but the budget ran out
+
+        // Every round starts at another file, so a small budget is shared fairly
+        rotation = worker.order.empty() ? 0 : (rotation + 1) % worker.order.size();
+
+        for (size_t i = 0; i < worker.order.size(); ++i)
+        {
+            const uint64_t fileId = worker.order[(rotation + i) % worker.order.size()];
+            File& file = worker.files.at(fileId);
+
+            while (!file.unacked.empty() && file.isAcked[file.unacked.front().first])
+            {
+                file.unacked.pop_front();
+            }
+
+            while (!file.unacked.empty() && now - file.unacked.front().second >= timeout && budget > 0)
+            {
+                const unsigned seqNumber = file.unacked.front().first;
+                file.unacked.pop_front();
+
+                if (!file.isAcked[seqNumber])
+                {
+                    Send(worker, fileId, file, seqNumber);
+                    file.unacked.emplace_back(seqNumber, now);
+                    worker.counters.packagesResent.fetch_add(1, std::memory_order_relaxed);
+                    --budget;
+                }
+            }
+
+            while (file.nextSeq < file.seqTotal && file.nextSeq - file.acked < m_config.window && budget > 0)
+            {
+                Send(worker, fileId, file, file.nextSeq);
+                file.unacked.emplace_back(file.nextSeq, now);
+                ++file.nextSeq;
+                --budget;
+            }
+
+            isWaiting = isWaiting || budget == 0;
+        }
+
+        for (auto& socket : worker.sockets)
+        {
+            Flush(worker, *socket);
+        }
+
+        tokens -= initialBudget - budget;
+
+        size_t acks = 0;
+        now = Clock::now();
+
+        for (auto& socket : worker.sockets)
+        {
+            acks += Receive(worker, *socket, now);
+        }
+
+        // Files whose final ACK got lost can't complete any more: the server already dropped them
+        for (size_t i = 0; i < worker.order.size();)
+        {
+            const uint64_t fileId = worker.order[i];
+            const File& file = worker.files.at(fileId);
+
+            if (file.acked == file.seqTotal || now - file.lastProgress > stallTimeout)
+            {
+                worker.counters.filesFailed.fetch_add(1, std::memory_order_relaxed);
+                Finish(worker, fileId);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+
+        if (acks == 0 && budget == initialBudget)
+        {
+            // Nothing moved: sleep until an ACK arrives, the next token or the next retransmission check,
+            // at most 1 ms so that slow rates neither overflow tv_nsec nor delay the retransmissions
+            const long waitMicroseconds = isWaiting && worker.rate > 0 ? std::clamp((long)(1e6 / worker.rate), 1l, 1000l) : 1000;
+            const timespec wait = { 0, waitMicroseconds * 1000 };
+            ppoll(events.data(), events.size(), &wait, nullptr);
+        }
+    }
+
+    worker.isDone = true;
+}
+
+bool LoadGenerator::StartFile(Worker& worker, Clock::time_point now)
+{
+    if (now >= m_deadline)
+    {
+        return false;
+    }
+
+    if (m_config.totalFiles > 0 && m_filesStarted.fetch_add(1, std::memory_order_relaxed) >= m_config.totalFiles)
+    {
+        return false;
+    }
+
+    // Run tag, two digits of the worker and five of its counter, all printable
+    char id[ID_SIZE];
+    id[0] = m_runTag;
+    id[1] = DIGITS[worker.index / 36 % 36];
+    id[2] = DIGITS[worker.index % 36];
+
+    for (size_t i = ID_SIZE - 1, counter = worker.fileCounter++; i >= 3; --i, counter /= 36)
+    {
+        id[i] = DIGITS[counter % 36];
+    }
+
+    uint64_t fileId;
+    memcpy(&fileId, id, sizeof(fileId));
+
+    File& file = worker.files[fileId];
+    file.size = GetFileSize(worker.random);
+    file.seqTotal = (unsigned)((file.size + MAX_DATA_SIZE - 1) / MAX_DATA_SIZE);
+    file.dataOffset = worker.random() % DATA_SIZE;
+    file.socket = worker.fileCounter % worker.sockets.size();
+    file.startTime = now;
+    file.lastProgress = now;
+    file.isAcked.assign(file.seqTotal, false);
+
+    for (unsigned seqNumber = 0; seqNumber < file.seqTotal; ++seqNumber)
+    {
+        const size_t offset = (file.dataOffset + (uint64_t)seqNumber * MAX_DATA_SIZE) % DATA_SIZE;
+        const size_t size = std::min<uint64_t>(MAX_DATA_SIZE, file.size - (uint64_t)seqNumber * MAX_DATA_SIZE);
+        file.checksum = crc32c(file.checksum, (const unsigned char*)m_data.data() + offset, size);
+    }
+
+    worker.order.push_back(fileId);
+    worker.counters.filesInFlight.store(worker.files.size(), std::memory_order_relaxed);
+
+    return true;
+}
+
+void LoadGenerator::Send(Worker& worker, uint64_t fileId, File& file, unsigned seqNumber)
+{
+    Socket& socket = *worker.sockets[file.socket];
+    Datagram& datagram = socket.sends[socket.pending++];
+
+    const size_t offset = (file.dataOffset + (uint64_t)seqNumber * MAX_DATA_SIZE) % DATA_SIZE;
+    const size_t size = std::min<uint64_t>(MAX_DATA_SIZE, file.size - (uint64_t)seqNumber * MAX_DATA_SIZE);
+
+    char* ptr = datagram.buff;
+    memcpy(ptr, &seqNumber, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+    memcpy(ptr, &file.seqTotal, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+    *ptr++ = (char)(m_config.isSack ? PUT | SACK_FLAG : PUT);
+    memcpy(ptr, &fileId, ID_SIZE);
+    ptr += ID_SIZE;
+    memcpy(ptr, m_data.data() + offset, size);
+
+    datagram.dataSize = (unsigned)(HEADER_SIZE + size);
+    datagram.endpoint = m_server;
+
+    if (socket.pending == UdpSocket::MAX_BATCH_SIZE)
+    {
+        Flush(worker, socket);
+    }
+}
+
+void LoadGenerator::Flush(Worker& worker, Socket& socket)
+{
+    if (socket.pending == 0)
+    {
+        return;
+    }
+
+    // Datagrams the socket refuses (a full send buffer) are lost and will be resent
+    const int sent = socket.socket.WriteMany(socket.sends, socket.pending);
+    worker.counters.packagesSent.fetch_add(sent > 0 ? sent : 0, std::memory_order_relaxed);
+    socket.pending = 0;
+}
+
+size_t LoadGenerator::Receive(Worker& worker, Socket& socket, Clock::time_point now)
+{
+    size_t acks = 0;
+
+    while (true)
+    {
+        const int messagesRead = socket.socket.ReadMany(socket.receives, UdpSocket::MAX_BATCH_SIZE);
+
+        if (messagesRead <= 0)
+        {
+            break;
+        }
+
+        for (int i = 0; i < messagesRead; ++i)
+        {
+            ProcessAck(worker, socket.receives[i].buff, socket.receives[i].dataSize, now);
+        }
+
+        acks += messagesRead;
+
+        if ((unsigned)messagesRead < UdpSocket::MAX_BATCH_SIZE)
+        {
+            break;
+        }
+    }
+
+    worker.counters.acksReceived.fetch_add(acks, std::memory_order_relaxed);
+    return acks;
+}
+
+void LoadGenerator::ProcessAck(Worker& worker, const char* data, unsigned size, Clock::time_point now)
+{
+    const unsigned char type = size >= HEADER_SIZE ? (unsigned char)data[2 * sizeof(unsigned)] : 0xff;
+
+    if (type != ACK && !(type == SACK && size == SACK_SIZE))
+    {
+        return;
+    }
+
+    unsigned seqNumber;
+    memcpy(&seqNumber, data, sizeof(unsigned));
+
+    uint64_t fileId;
+    memcpy(&fileId, data + HEADER_SIZE - ID_SIZE, ID_SIZE);
+
+    const auto it = worker.files.find(fileId);
+
+    if (it == worker.files.end() || seqNumber >= it->second.seqTotal)
+    {
+        return;
+    }
+
+    File& file = it->second;
+
+    if (type == SACK)
+    {
+        for (; file.cumulative < seqNumber; ++file.cumulative)
+        {
+            Acknowledge(file, file.cumulative, now);
+        }
+
+        unsigned base;
+        memcpy(&base, data + HEADER_SIZE, sizeof(unsigned));
+
+        for (unsigned i = 0; i < SACK_WORDS; ++i)
+        {
+            uint64_t word;
+            memcpy(&word, data + HEADER_SIZE + sizeof(unsigned) + i * sizeof(uint64_t), sizeof(uint64_t));
+
+            for (; word != 0; word &= word - 1)
+            {
+                const uint64_t packageSeq = base + i * 64 + (unsigned)__builtin_ctzll(word);
+
+                if (packageSeq < file.seqTotal)
+                {
+                    Acknowledge(file, (unsigned)packageSeq, now);
+                }
+            }
+        }
+
+        return;
+    }
+
+    Acknowledge(file, seqNumber, now);
+
+    if (size == HEADER_SIZE + sizeof(uint32_t))
+    {
+        uint32_t checksum;
+        memcpy(&checksum, data + HEADER_SIZE, sizeof(checksum));
+
+        if (checksum != file.checksum)
+        {
+            LOG_ERROR("CRC from Server: {}, original: {}, id: {}", checksum, file.checksum,
+                std::string_view(data + HEADER_SIZE - ID_SIZE, ID_SIZE));
+            worker.counters.filesCorrupted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        worker.latencies.push_back(std::chrono::duration<double, std::micro>(now - file.startTime).count());
+        worker.counters.filesCompleted.fetch_add(1, std::memory_order_relaxed);
+        worker.counters.bytesCompleted.fetch_add(file.size, std::memory_order_relaxed);
+        Finish(worker, fileId);
+    }
+}
+
+void LoadGenerator::Acknowledge(File& file, unsigned seqNumber, Clock::time_point now)
+{
+    if (!file.isAcked[seqNumber])
+    {
+        file.isAcked[seqNumber] = true;
+        ++file.acked;
+        file.lastProgress = now;
+    }
+}
+
+void LoadGenerator::Finish(Worker& worker, uint64_t fileId)
+{
+    worker.files.erase(fileId);
+    worker.order.erase(std::find(worker.order.begin(), worker.order.end(), fileId));
+    worker.counters.filesInFlight.store(worker.files.size(), std::memory_order_relaxed);
+}
+
+uint64_t LoadGenerator::GetFileSize(std::mt19937_64& random) const
+{
+    const uint64_t mean = m_config.fileSize;
+
+    switch (m_config.sizeDistribution)
+    {
+    case SizeDistribution::Uniform:
+        return 1 + random() % (2 * mean);
+    case SizeDistribution::Exponential:
+        return std::max<uint64_t>(1, std::min<uint64_t>(16 * mean, (uint64_t)std::exponential_distribution<double>(1.0 / mean)(random)));
+    case SizeDistribution::Fixed:
+    default:
+        return mean;
+    }
+}
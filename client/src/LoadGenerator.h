@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "ClientConfig.h"
+#include "UdpSocket.h"
+
+// Keeps a configurable number of files in flight against the server from several threads and
+// source ports, optionally at a fixed packet rate. Every file is sent with a window of
+// unacknowledged packages and per-package retransmission; its time to checksum runs from the
+// first package to the final ACK, whose checksum is verified. Progress is reported once a second,
+// goodput, packet rates and time-to-checksum percentiles at the end.
+class LoadGenerator
+{
+public:
+    explicit LoadGenerator(const ClientConfig& config);
+    ~LoadGenerator();
+
+    // Returns false when the server can't be resolved or a file came back with a wrong checksum
+    bool Run();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct File
+    {
+        uint64_t size = 0;
+        unsigned seqTotal = 0;
+        unsigned nextSeq = 0;               // packages [0, nextSeq) were sent at least once
+        unsigned acked = 0;
+        unsigned cumulative = 0;            // packages [0, cumulative) were acknowledged, from SACKs
+        size_t dataOffset = 0;              // of package 0 in the shared data
+        uint32_t checksum = 0;              // expected crc32c of the whole file
+        size_t socket = 0;
+        Clock::time_point startTime;
+        Clock::time_point lastProgress;     // of the last new ACK
+        std::vector<bool> isAcked;
+        // Sent packages in the order they are due for retransmission; acknowledged ones are skipped lazily
+        std::deque<std::pair<unsigned, Clock::time_point>> unacked;
+    };
+
+    struct Socket
+    {
+        Socket();
+
+        UdpSocket socket;
+        std::vector<char> sendBuffers;      // one datagram slot per pending send
+        std::vector<char> receiveBuffers;
+        Datagram sends[UdpSocket::MAX_BATCH_SIZE];
+        Datagram receives[UdpSocket::MAX_BATCH_SIZE];
+        unsigned pending = 0;
+    };
+
+    // Written only by the worker's thread, read by the reporter
+    struct Counters
+    {
+        std::atomic<uint64_t> packagesSent{ 0 };
+        std::atomic<uint64_t> packagesResent{ 0 };
+        std::atomic<uint64_t> acksReceived{ 0 };
+        std::atomic<uint64_t> filesCompleted{ 0 };
+        std::atomic<uint64_t> filesCorrupted{ 0 };  // final ACK with a wrong checksum
+        std::atomic<uint64_t> filesFailed{ 0 };     // every package acknowledged but no final ACK, or stalled
+        std::atomic<uint64_t> bytesCompleted{ 0 };
+        std::atomic<size_t> filesInFlight{ 0 };
+    };
+
+    struct Worker
+    {
+        unsigned index = 0;
+        unsigned concurrentFiles = 0;
+        double rate = 0;                    // packets per second, 0 is unlimited
+        uint64_t fileCounter = 0;
+        std::mt19937_64 random;
+        std::vector<std::unique_ptr<Socket>> sockets;
+        std::unordered_map<uint64_t, File> files;
+        std::vector<uint64_t> order;        // ids of files, rotated so every file gets its turn to send
+        std::vector<double> latencies;      // time to checksum in microseconds
+        Counters counters;
+        std::atomic_bool isDone{ false };
+        std::thread thread;
+    };
+
+    void ThreadProc(Worker& worker);
+    bool StartFile(Worker& worker, Clock::time_point now);
+    // Queues a package on the file's socket, flushing the socket's batch when it is full
+    void Send(Worker& worker, uint64_t fileId, File& file, unsigned seqNumber);
+    void Flush(Worker& worker, Socket& socket);
+    // Returns the number of ACKs read
+    size_t Receive(Worker& worker, Socket& socket, Clock::time_point now);
+    // Takes ACKs and SACKs; a SACK acknowledges everything below its cumulative point and in its window
+    void ProcessAck(Worker& worker, const char* data, unsigned size, Clock::time_point now);
+    void Acknowledge(File& file, unsigned seqNumber, Clock::time_point now);
+    void Finish(Worker& worker, uint64_t fileId);
+
+    uint64_t GetFileSize(std::mt19937_64& random) const;
+
+private:
+    ClientConfig m_config;
+    Endpoint m_server;
+    std::vector<char> m_data;               // random file contents shared by all files
+    char m_runTag;                          // first id character, so reruns don't collide with leftovers
+    std::atomic<uint64_t> m_filesStarted;
+    Clock::time_point m_deadline;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+};
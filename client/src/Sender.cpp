@@ -1,17 +1,39 @@
 #include "Sender.h"
 #include "TestDataGenerator.h"
 #include "UdpSocket.h"
+#include "Logger.h"
+#include <poll.h>
 #include <algorithm>
 #include <cstring>
-#include <iostream>
+#include <deque>
 #include <random>
 
 const size_t NUMBER_OF_FILES = 3;
 const size_t BUF_SIZE = 1472;
 std::atomic_int Sender::idCounter(0);
 
-Sender::Sender()
-    : m_port(0)
+namespace
+{
+    constexpr char ACK = 0;
+    constexpr char SACK = 2;
+    constexpr size_t ID_SIZE = 8;
+    constexpr size_t HEADER_SIZE =
+        sizeof(unsigned) +      // seq_number
+        sizeof(unsigned) +      // seq_total
+        sizeof(unsigned char) + // type
+        ID_SIZE * sizeof(char); // id
+    constexpr size_t SACK_WORDS = 5;
+    constexpr size_t SACK_SIZE = HEADER_SIZE + sizeof(unsigned) + SACK_WORDS * sizeof(uint64_t);
+
+    // A package counts as lost once this many packages sent after it were acknowledged, and a quarter
+    // of the RTT has passed beyond its expected ACK, which may come late in a datagram of its own
+    constexpr uint64_t REORDER_THRESHOLD = 3;
+    constexpr std::chrono::milliseconds MAX_WAIT(100);
+    constexpr std::chrono::seconds REPORT_INTERVAL(1);
+}
+
+Sender::Sender(const ClientConfig& config)
+    : m_config(config)
 {
 }
 
@@ -23,44 +45,83 @@ Sender::~Sender()
     }
 }
 
-void Sender::Start(const std::string& address, unsigned short port)
+void Sender::Start()
 {
-    m_address = address;
-    m_port = port;
     m_thread = std::thread([this] { ThreadProc(); });
 }
 
 void Sender::ThreadProc()
 {
-    std::map<std::string, TestDataGenerator> files;
-    std::vector<TestDataGenerator::Package> packages;
-
     for (size_t i = 0; i < NUMBER_OF_FILES; ++i)
     {
         const std::string id(("file" + std::to_string(idCounter++)).c_str(), 8);
-        auto currentPackages = files[id].Generate(id, 20);
-        packages.insert(packages.end(), currentPackages.begin(), currentPackages.end());
+        auto currentPackages = m_files[id].generator.Generate(id, m_config.packages, m_config.isSack);
+        m_packages.insert(m_packages.end(), currentPackages.begin(), currentPackages.end());
     }
 
     unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::shuffle(packages.begin(), packages.end(), std::default_random_engine(seed));
+    std::shuffle(m_packages.begin(), m_packages.end(), std::default_random_engine(seed));
+
+    for (size_t i = 0; i < m_packages.size(); ++i)
+    {
+        auto& positions = m_files[m_packages[i].id].positions;
+        positions.resize(std::max<size_t>(positions.size(), m_packages[i].index + 1));
+        positions[m_packages[i].index] = i;
+    }
 
     UdpSocket socket(NetworkProtocol::IPv4, true);
+    const auto addresses = GetAddressInfo(m_config.address, m_config.port, NetworkProtocol::IPv4);
+
+    if (addresses.empty())
+    {
+        LOG_ERROR("Can't resolve: {}:{}", m_config.address, m_config.port);
+        return;
+    }
+
+    const SockAddr& serverAddress = addresses.front();
+    const auto start = Clock::now();
+
+    if (m_config.congestion == CongestionMode::None)
+    {
+        SendAll(socket, serverAddress);
+    }
+    else
+    {
+        SendWindowed(socket, serverAddress);
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const uint64_t lost = m_config.congestion == CongestionMode::None ? m_statistics.resent : m_statistics.lost;
+
+    LOG_INFO("Sent {} packages ({} resent, {:.2f}% lost), {} bytes in {:.3f} s, {:.3f} MB/s goodput",
+        m_statistics.sent, m_statistics.resent, m_statistics.sent > 0 ? 100.0 * lost / m_statistics.sent : 0.0,
+        m_statistics.bytesAcked, seconds, m_statistics.bytesAcked / seconds / 1e6);
+}
 
-    while (std::any_of(packages.begin(), packages.end(), [](const TestDataGenerator::Package& package) { return !package.received; }))
+void Sender::SendAll(UdpSocket& socket, const SockAddr& serverAddress)
+{
+    std::vector<size_t> acked;
+    auto reportTime = Clock::now();
+
+    while (m_statistics.acked < m_packages.size())
     {
-        for (auto& package : packages)
+        for (auto& package : m_packages)
         {
             // There's an issue here:
-            // If the server sends a packet with a checksum, but we do not receive it, 
+            // If the server sends a packet with a checksum, but we do not receive it,
             // then we will resend only the last packet, but the server has already deleted the rest of the packets from itself,
             // so we need to implement resending all packets again or use some other logic...
-            if (!package.received && 
+            if (!package.received &&
                 std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now()- package.sendTime).count() > 3 &&
                 socket.CanWrite(0))
             {
-                socket.Write((char*)package.data.data(), package.data.size(), m_address, m_port);
+                const bool isResent = package.sendTime != Clock::time_point();
+
+                socket.Write((char*)package.data.data(), package.data.size(), serverAddress);
                 package.sendTime = std::chrono::steady_clock::now();
+
+                ++m_statistics.sent;
+                m_statistics.resent += isResent ? 1 : 0;
             }
         }
 
@@ -71,27 +132,203 @@ void Sender::ThreadProc()
 
             if (bytesRead > 0)
             {
-                buffer.resize(bytesRead);
-                ProcessResponse(buffer, files, packages);
+                ProcessResponse(buffer.data(), bytesRead, acked);
             }
         }
+
+        const auto now = Clock::now();
+
+        if (now - reportTime >= REPORT_INTERVAL)
+        {
+            Report(std::chrono::duration<double>(now - reportTime).count(), nullptr);
+            reportTime = now;
+        }
     }
 }
 
-void Sender::ProcessResponse(const std::vector<char>& buffer, std::map<std::string, TestDataGenerator>& files
-    , std::vector<TestDataGenerator::Package>& packages)
+void Sender::SendWindowed(UdpSocket& socket, const SockAddr& serverAddress)
 {
-    static constexpr char ACK = 0;
-    static constexpr size_t ID_SIZE = 8;
-    static constexpr size_t HEADER_SIZE =
-        sizeof(unsigned) +      // seq_number
-        sizeof(unsigned) +      // seq_total
-        sizeof(unsigned char) + // type
-        ID_SIZE * sizeof(char); // id
+    CongestionControl congestion;
+    std::vector<Transmission> transmissions(m_packages.size());
+    std::deque<std::pair<size_t, uint64_t>> inFlight;  // positions and serials in send order, stale ones skipped lazily
+    std::deque<size_t> lost;                            // positions to send again
+    std::vector<size_t> acked;
+    size_t next = 0;                                    // the next position never sent
+    uint64_t serial = 0;
+    uint64_t highestAcked = 0;                          // serial of the latest transmission acknowledged
+    unsigned inFlightCount = 0;
+
+    std::vector<char> buffers(UdpSocket::MAX_BATCH_SIZE * BUF_SIZE);
+    Datagram receives[UdpSocket::MAX_BATCH_SIZE];
+
+    for (unsigned i = 0; i < UdpSocket::MAX_BATCH_SIZE; ++i)
+    {
+        receives[i].buff = buffers.data() + i * BUF_SIZE;
+        receives[i].bufSize = BUF_SIZE;
+    }
+
+    auto reportTime = Clock::now();
 
-    if (buffer.size() >= HEADER_SIZE)
+    while (m_statistics.acked < m_packages.size())
     {
-        const char* ptr = buffer.data();
+        auto now = Clock::now();
+
+        // Oldest first, so the first package neither reordered nor timed out ends the search
+        while (!inFlight.empty())
+        {
+            const auto [position, sentSerial] = inFlight.front();
+            Transmission& transmission = transmissions[position];
+
+            if (!transmission.isInFlight || transmission.serial != sentSerial)
+            {
+                inFlight.pop_front();
+                continue;
+            }
+
+            const auto sendTime = m_packages[position].sendTime;
+            const bool isTimeout = now - sendTime >= congestion.GetRto();
+            const bool isReordered = highestAcked >= sentSerial + REORDER_THRESHOLD
+                && now - sendTime >= congestion.GetRtt() + congestion.GetRtt() / 4;
+
+            if (!isReordered && !isTimeout)
+            {
+                break;
+            }
+
+            inFlight.pop_front();
+            transmission.isInFlight = false;
+            --inFlightCount;
+            lost.push_back(position);
+            ++m_statistics.lost;
+            congestion.OnLoss(sendTime, now, isTimeout);
+        }
+
+        // Lost packages go first, a final ACK may have covered packages not sent yet
+        bool isBlocked = false;
+
+        while (congestion.CanSend(inFlightCount, now))
+        {
+            size_t position = m_packages.size();
+
+            for (; !lost.empty() && position == m_packages.size(); lost.pop_front())
+            {
+                position = m_packages[lost.front()].received ? position : lost.front();
+            }
+
+            for (; next < m_packages.size() && position == m_packages.size(); ++next)
+            {
+                position = m_packages[next].received ? position : next;
+            }
+
+            if (position == m_packages.size())
+            {
+                break;
+            }
+
+            auto& package = m_packages[position];
+
+            if (socket.Write((char*)package.data.data(), package.data.size(), serverAddress) < 0)
+            {
+                // A full send buffer; the package is tried again once the socket is writable
+                lost.push_front(position);
+                isBlocked = true;
+                break;
+            }
+
+            Transmission& transmission = transmissions[position];
+            transmission.serial = ++serial;
+            transmission.isInFlight = true;
+            package.sendTime = now;
+
+            inFlight.emplace_back(position, serial);
+            ++inFlightCount;
+            congestion.OnSend(now);
+
+            ++m_statistics.sent;
+            m_statistics.resent += transmission.count++ > 0 ? 1 : 0;
+        }
+
+        acked.clear();
+
+        while (true)
+        {
+            const int messagesRead = socket.ReadMany(receives, UdpSocket::MAX_BATCH_SIZE);
+
+            if (messagesRead <= 0)
+            {
+                break;
+            }
+
+            for (int i = 0; i < messagesRead; ++i)
+            {
+                ProcessResponse(receives[i].buff, receives[i].dataSize, acked);
+            }
+
+            if ((unsigned)messagesRead < UdpSocket::MAX_BATCH_SIZE)
+            {
+                break;
+            }
+        }
+
+        now = Clock::now();
+
+        for (size_t position : acked)
+        {
+            Transmission& transmission = transmissions[position];
+
+            if (transmission.isInFlight)
+            {
+                transmission.isInFlight = false;
+                --inFlightCount;
+            }
+
+            highestAcked = std::max(highestAcked, transmission.serial);
+            congestion.OnAck(transmission.count == 1 ? now - m_packages[position].sendTime : Clock::duration::zero());
+        }
+
+        if (now - reportTime >= REPORT_INTERVAL)
+        {
+            Report(std::chrono::duration<double>(now - reportTime).count(), &congestion);
+            reportTime = now;
+        }
+
+        if (!acked.empty())
+        {
+            continue;
+        }
+
+        // Sleep until an ACK arrives, the pacing lets the next package go or the oldest package times out
+        auto wake = now + MAX_WAIT;
+
+        if (!isBlocked && (!lost.empty() || next < m_packages.size()) && inFlightCount < (unsigned)congestion.GetWindow())
+        {
+            wake = std::min(wake, congestion.GetNextSendTime());
+        }
+
+        if (!inFlight.empty())
+        {
+            wake = std::min(wake, m_packages[inFlight.front().first].sendTime + congestion.GetRto());
+        }
+
+        if (wake > now)
+        {
+            const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(wake - now);
+            const timespec timeout = { (time_t)(wait.count() / 1000000000), (long)(wait.count() % 1000000000) };
+            pollfd event = { socket.GetSocketId(), (short)(POLLIN | (isBlocked ? POLLOUT : 0)), 0 };
+            ppoll(&event, 1, &timeout, nullptr);
+        }
+    }
+
+    LOG_INFO("Final cwnd {:.1f}, srtt {:.3f} ms, rto {:.0f} ms", congestion.GetWindow(),
+        std::chrono::duration<double, std::milli>(congestion.GetRtt()).count(),
+        std::chrono::duration<double, std::milli>(congestion.GetRto()).count());
+}
+
+void Sender::ProcessResponse(const char* data, size_t size, std::vector<size_t>& acked)
+{
+    if (size >= HEADER_SIZE)
+    {
+        const char* ptr = data;
 
         unsigned seq_number;
         memcpy(&seq_number, ptr, sizeof(unsigned));
@@ -105,31 +342,109 @@ void Sender::ProcessResponse(const std::vector<char>& buffer, std::map<std::stri
         memcpy(&type, ptr, sizeof(unsigned char));
         ptr += sizeof(unsigned char);
 
-        if (type == ACK)
+        char id[ID_SIZE];
+        memcpy(id, ptr, ID_SIZE);
+        ptr += ID_SIZE;
+
+        std::string fileId(id, ID_SIZE);
+
+        const auto it = m_files.find(fileId);
+
+        if (it == m_files.end())
         {
-            char id[ID_SIZE];
-            memcpy(id, ptr, ID_SIZE);
-            ptr += ID_SIZE;
+            return;
+        }
 
-            std::string fileId(id, ID_SIZE);
+        File& file = it->second;
 
-            std::cout << "ACK: id: " << fileId << ", seq_number: " << seq_number << std::endl;
+        if (type == ACK)
+        {
+            LOG_DEBUG("ACK: id: {}, seq_number: {}", fileId, seq_number);
 
             unsigned checksum = 0;
+            // The final ACK stands for the whole file, whose other packages may only have been covered by SACKs
+            const bool isLast = size == HEADER_SIZE + sizeof(unsigned);
 
-            if (buffer.size() == HEADER_SIZE + sizeof(unsigned))
+            if (isLast)
             {
                 memcpy(&checksum, ptr, sizeof(unsigned));
-                std::cout << "CRC from Server: " << checksum << ", original: " << files[fileId].GetChecksum() << ", id: " << fileId << std::endl;
+                LOG_INFO("CRC from Server: {}, original: {}, id: {}", checksum, file.generator.GetChecksum(), fileId);
+
+                for (size_t position : file.positions)
+                {
+                    Acknowledge(position, acked);
+                }
+            }
+            else if (seq_number < file.positions.size())
+            {
+                Acknowledge(file.positions[seq_number], acked);
             }
+        }
+        else if (type == SACK && size == SACK_SIZE)
+        {
+            // seq_number is the cumulative point, the bitmap window starts at base
+            unsigned base;
+            memcpy(&base, ptr, sizeof(unsigned));
+            ptr += sizeof(unsigned);
 
-            for (auto& package : packages)
+            uint64_t window[SACK_WORDS];
+            memcpy(window, ptr, sizeof(window));
+
+            LOG_DEBUG("SACK: id: {}, cumulative: {}, base: {}", fileId, seq_number, base);
+
+            for (; file.cumulative < std::min<size_t>(seq_number, file.positions.size()); ++file.cumulative)
             {
-                if (package.id == fileId && package.index == seq_number)
+                Acknowledge(file.positions[file.cumulative], acked);
+            }
+
+            for (unsigned i = 0; i < SACK_WORDS; ++i)
+            {
+                for (uint64_t word = window[i]; word != 0; word &= word - 1)
                 {
-                    package.received = true;
+                    const uint64_t index = base + i * 64 + (unsigned)__builtin_ctzll(word);
+
+                    if (index < file.positions.size())
+                    {
+                        Acknowledge(file.positions[index], acked);
+                    }
                 }
             }
         }
     }
 }
+
+void Sender::Acknowledge(size_t position, std::vector<size_t>& acked)
+{
+    auto& package = m_packages[position];
+
+    if (!package.received)
+    {
+        package.received = true;
+        acked.push_back(position);
+
+        ++m_statistics.acked;
+        m_statistics.bytesAcked += package.data.size() - HEADER_SIZE;
+    }
+}
+
+void Sender::Report(double seconds, const CongestionControl* congestion)
+{
+    const uint64_t sent = m_statistics.sent - m_reported.sent;
+    // Without a congestion control every package sent again counts as lost
+    const uint64_t lost = congestion ? m_statistics.lost - m_reported.lost : m_statistics.resent - m_reported.resent;
+    const double lossRate = sent > 0 ? 100.0 * lost / sent : 0.0;
+    const double goodput = (m_statistics.bytesAcked - m_reported.bytesAcked) / seconds / 1e6;
+
+    if (congestion)
+    {
+        LOG_INFO("Sender: cwnd {:.1f}, srtt {:.3f} ms, {:.0f} packets/s, {:.2f}% lost, {:.3f} MB/s goodput",
+            congestion->GetWindow(), std::chrono::duration<double, std::milli>(congestion->GetRtt()).count(), sent / seconds,
+            lossRate, goodput);
+    }
+    else
+    {
+        LOG_INFO("Sender: {:.0f} packets/s, {:.2f}% lost, {:.3f} MB/s goodput", sent / seconds, lossRate, goodput);
+    }
+
+    m_reported = m_statistics;
+}
@@ -2,25 +2,64 @@
 
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <vector>
 #include <map>
+#include "ClientConfig.h"
+#include "CongestionControl.h"
 #include "TestDataGenerator.h"
+#include "UdpSocket.h"
 
 class Sender
 {
 public:
-    Sender();
+    explicit Sender(const ClientConfig& config);
     ~Sender();
-    void Start(const std::string& address, unsigned short port);
+    void Start();
 
 private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct File
+    {
+        TestDataGenerator generator;
+        std::vector<size_t> positions;  // of every package in m_packages, by its index
+        unsigned cumulative = 0;        // packages [0, cumulative) were acknowledged by SACKs
+    };
+
+    // Of the last transmission of a package
+    struct Transmission
+    {
+        uint64_t serial = 0;            // in send order, so later packages acknowledged reveal losses
+        unsigned count = 0;
+        bool isInFlight = false;
+    };
+
+    struct Statistics
+    {
+        uint64_t sent = 0;
+        uint64_t resent = 0;
+        uint64_t lost = 0;              // declared lost by the congestion control
+        uint64_t acked = 0;
+        uint64_t bytesAcked = 0;        // payload of the acknowledged packages
+    };
+
     void ThreadProc();
-    static void ProcessResponse(const std::vector<char>& buffer, std::map<std::string, TestDataGenerator>& files, 
-        std::vector<TestDataGenerator::Package>& packages);
+    // The original behaviour: everything at once, what is unacknowledged again after 3 s
+    void SendAll(UdpSocket& socket, const SockAddr& serverAddress);
+    // A paced congestion window; losses are detected from later packages acknowledged, or the RTO
+    void SendWindowed(UdpSocket& socket, const SockAddr& serverAddress);
+    // Marks the packages a response acknowledges and appends their positions in m_packages
+    void ProcessResponse(const char* data, size_t size, std::vector<size_t>& acked);
+    void Acknowledge(size_t position, std::vector<size_t>& acked);
+    void Report(double seconds, const CongestionControl* congestion);
 
 private:
-    std::string m_address;
-    unsigned short m_port;
+    ClientConfig m_config;
+    std::map<std::string, File> m_files;
+    std::vector<TestDataGenerator::Package> m_packages;
+    Statistics m_statistics;
+    Statistics m_reported;
 
     std::thread m_thread;
     static std::atomic_int idCounter;
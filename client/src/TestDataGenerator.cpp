@@ -11,7 +11,7 @@ TestDataGenerator::TestDataGenerator()
 {
 }
 
-std::vector<TestDataGenerator::Package> TestDataGenerator::Generate(const std::string& id, size_t numOfParts)
+std::vector<TestDataGenerator::Package> TestDataGenerator::Generate(const std::string& id, size_t numOfParts, bool isSack)
 {
     std::vector<Package> result;
 
@@ -33,6 +33,7 @@ std::vector<TestDataGenerator::Package> TestDataGenerator::Generate(const std::s
     }
 
     static constexpr unsigned char PUT = 1;
+    static constexpr unsigned char SACK_FLAG = 0x80;
     static constexpr size_t ID_SIZE = 8;
     static constexpr size_t HEADER_SIZE =
         sizeof(unsigned) +      // seq_number
@@ -41,6 +42,7 @@ std::vector<TestDataGenerator::Package> TestDataGenerator::Generate(const std::s
         ID_SIZE * sizeof(char); // id
 
     const unsigned size = m_data.size();
+    const unsigned char type = isSack ? PUT | SACK_FLAG : PUT;
 
     for (unsigned i = 0; i < size; ++i)
     {
@@ -53,7 +55,7 @@ std::vector<TestDataGenerator::Package> TestDataGenerator::Generate(const std::s
         memcpy(pos, &size, sizeof(unsigned));
         pos += sizeof(unsigned);
 
-        memcpy(pos, &PUT, sizeof(unsigned char));
+        memcpy(pos, &type, sizeof(unsigned char));
         pos += sizeof(unsigned char);
 
         memset(pos, 0, ID_SIZE);
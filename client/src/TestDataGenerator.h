@@ -21,7 +21,8 @@ public:
 
 public:
     TestDataGenerator();
-    std::vector<Package> Generate(const std::string& id, size_t numOfParts);
+    // With isSack the packages ask the server for selective ACKs
+    std::vector<Package> Generate(const std::string& id, size_t numOfParts, bool isSack);
     unsigned GetChecksum() const;
 
 private:
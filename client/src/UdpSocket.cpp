@@ -28,6 +28,11 @@ bool UdpSocket::IsSet() const
     return m_socketId != INVALID_SOCKET;
 }
 
+int UdpSocket::GetSocketId() const
+{
+    return m_socketId;
+}
+
 bool UdpSocket::Create(NetworkProtocol netProtocol, bool nonBlocking)
 {
     Close();
@@ -114,6 +119,22 @@ bool UdpSocket::Bind(unsigned short port, const std::string& address, bool reuse
     return isSuccess;
 }
 
+bool UdpSocket::SetReusePort(bool reusePort)
+{
+    int reuse = reusePort ? 1 : 0;
+    return IsSet() && setsockopt(m_socketId, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse)) == 0;
+}
+
+bool UdpSocket::AttachReusePortFilter(const std::vector<sock_filter>& program)
+{
+    sock_fprog filter;
+    filter.len = (unsigned short)program.size();
+    filter.filter = const_cast<sock_filter*>(program.data());
+
+    return IsSet() && !program.empty() &&
+        setsockopt(m_socketId, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &filter, sizeof(filter)) == 0;
+}
+
 bool UdpSocket::SetNonBlockingMode(bool nonBlocking)
 {
     unsigned long mode = nonBlocking ? 1 : 0;
@@ -150,6 +171,25 @@ int UdpSocket::Read(char* buff, unsigned bufSize, std::string* outAddress, unsig
     return bytesRead;
 }
 
+int UdpSocket::Read(char* buff, unsigned bufSize, Endpoint* outEndpoint)
+{
+    int bytesRead = SOCKET_ERROR;
+
+    if (IsSet() && buff && bufSize > 0)
+    {
+        sockaddr_storage address;
+        socklen_t addressSize = sizeof(address);
+        bytesRead = recvfrom(m_socketId, buff, bufSize, 0, (sockaddr*)&address, &addressSize);
+
+        if (bytesRead > 0 && outEndpoint)
+        {
+            *outEndpoint = Endpoint::FromSockAddr((const sockaddr*)&address, addressSize);
+        }
+    }
+
+    return bytesRead;
+}
+
 int UdpSocket::Write(const char* buff, unsigned bufSize, const std::string& address, unsigned short port)
 {
     int bytesSent = SOCKET_ERROR;
@@ -167,6 +207,105 @@ int UdpSocket::Write(const char* buff, unsigned bufSize, const std::string& addr
     return bytesSent;
 }
 
+int UdpSocket::Write(const char* buff, unsigned bufSize, const SockAddr& address)
+{
+    int bytesSent = SOCKET_ERROR;
+
+    if (IsSet() && buff && bufSize > 0 && address.IsSet())
+    {
+        bytesSent = sendto(m_socketId, buff, bufSize, 0, address.GetSockAddr(), address.GetSockAddrSize());
+    }
+
+    return bytesSent;
+}
+
+int UdpSocket::Write(const char* buff, unsigned bufSize, const Endpoint& endpoint)
+{
+    return Write(buff, bufSize, SockAddr(endpoint));
+}
+
+int UdpSocket::ReadMany(Datagram* datagrams, unsigned count)
+{
+    int messagesRead = SOCKET_ERROR;
+
+    if (IsSet() && datagrams && count > 0)
+    {
+        count = std::min(count, MAX_BATCH_SIZE);
+
+        mmsghdr messages[MAX_BATCH_SIZE];
+        iovec vectors[MAX_BATCH_SIZE];
+        sockaddr_storage addresses[MAX_BATCH_SIZE];
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            vectors[i].iov_base = datagrams[i].buff;
+            vectors[i].iov_len = datagrams[i].bufSize;
+
+            memset(&messages[i], 0, sizeof(mmsghdr));
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        messagesRead = recvmmsg(m_socketId, messages, count, 0, nullptr);
+
+        // A datagram larger than its buffer arrives cut off, it is reported empty instead
+        for (int i = 0; i < messagesRead; ++i)
+        {
+            datagrams[i].dataSize = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : messages[i].msg_len;
+            datagrams[i].endpoint = Endpoint::FromSockAddr((const sockaddr*)&addresses[i], messages[i].msg_hdr.msg_namelen);
+        }
+    }
+
+    return messagesRead;
+}
+
+int UdpSocket::WriteMany(const Datagram* datagrams, unsigned count)
+{
+    int messagesSent = SOCKET_ERROR;
+
+    if (IsSet() && datagrams && count > 0)
+    {
+        count = std::min(count, MAX_BATCH_SIZE);
+
+        mmsghdr messages[MAX_BATCH_SIZE];
+        iovec vectors[MAX_BATCH_SIZE];
+        SockAddr addresses[MAX_BATCH_SIZE];
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            addresses[i] = SockAddr(datagrams[i].endpoint);
+
+            vectors[i].iov_base = datagrams[i].buff;
+            vectors[i].iov_len = datagrams[i].dataSize;
+
+            memset(&messages[i], 0, sizeof(mmsghdr));
+            messages[i].msg_hdr.msg_name = addresses[i].GetSockAddrPtr();
+            messages[i].msg_hdr.msg_namelen = addresses[i].GetSockAddrSize();
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // sendmmsg may stop early, e.g. when the send buffer is full
+        for (unsigned sent = 0; sent < count;)
+        {
+            const int result = sendmmsg(m_socketId, messages + sent, count - sent, 0);
+
+            if (result <= 0)
+            {
+                messagesSent = sent > 0 ? (int)sent : result;
+                break;
+            }
+
+            sent += result;
+            messagesSent = sent;
+        }
+    }
+
+    return messagesSent;
+}
+
 bool UdpSocket::CanRead(unsigned waitTimeoutMillis) const
 {
     return Poll(true, waitTimeoutMillis);
@@ -245,25 +384,48 @@ SockAddr::SockAddr(const sockaddr* addr, socklen_t addrSize)
     Init(addr, addrSize);
 }
 
+SockAddr::SockAddr(const Endpoint& endpoint)
+    : m_sockaddrSize(0)
+{
+    Init();
+
+    if (endpoint.family == AF_INET)
+    {
+        auto* addr = reinterpret_cast<sockaddr_in*>(&m_sockaddr);
+        addr->sin_family = AF_INET;
+        addr->sin_port = endpoint.port;
+        memcpy(&addr->sin_addr, endpoint.address, sizeof(addr->sin_addr));
+        m_sockaddrSize = sizeof(sockaddr_in);
+    }
+    else if (endpoint.family == AF_INET6)
+    {
+        auto* addr = reinterpret_cast<sockaddr_in6*>(&m_sockaddr);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = endpoint.port;
+        memcpy(&addr->sin6_addr, endpoint.address, sizeof(addr->sin6_addr));
+        m_sockaddrSize = sizeof(sockaddr_in6);
+    }
+}
+
 void SockAddr::Init(const sockaddr* addr, socklen_t addrSize)
 {
-    if (Init() && addrSize <= (socklen_t)m_sockaddrBuffer.size())
+    if (Init() && addrSize <= (socklen_t)sizeof(m_sockaddr))
     {
-        memcpy(m_sockaddrBuffer.data(), addr, addrSize);
+        memcpy(&m_sockaddr, addr, addrSize);
         m_sockaddrSize = addrSize;
     }
 }
 
 bool SockAddr::IsSet() const
 {
-    return m_sockaddrSize > 0 && !m_sockaddrBuffer.empty();
+    return m_sockaddrSize > 0;
 }
 
 NetworkProtocol SockAddr::GetNetworkProtocol() const
 {
     if (IsSet())
     {
-        switch (reinterpret_cast<const sockaddr_storage*>(m_sockaddrBuffer.data())->ss_family)
+        switch (m_sockaddr.ss_family)
         {
             case AF_INET:
             {
@@ -280,10 +442,15 @@ NetworkProtocol SockAddr::GetNetworkProtocol() const
     return NetworkProtocol::Unknown;
 }
 
+Endpoint SockAddr::GetEndpoint() const
+{
+    return Endpoint::FromSockAddr(GetSockAddr(), m_sockaddrSize);
+}
+
 const sockaddr* SockAddr::GetSockAddr() const
 {
     return IsSet()
-        ? reinterpret_cast<const sockaddr*>(m_sockaddrBuffer.data())
+        ? reinterpret_cast<const sockaddr*>(&m_sockaddr)
         : nullptr;
 }
 
@@ -295,7 +462,7 @@ socklen_t SockAddr::GetSockAddrSize() const
 sockaddr* SockAddr::GetSockAddrPtr()
 {
     return IsSet()
-        ? reinterpret_cast<sockaddr*>(m_sockaddrBuffer.data())
+        ? reinterpret_cast<sockaddr*>(&m_sockaddr)
         : nullptr;
 }
 
@@ -307,12 +474,81 @@ socklen_t* SockAddr::GetSockAddrSizePtr()
 bool SockAddr::Init()
 {
     m_sockaddrSize = sizeof(sockaddr_storage);
-    m_sockaddrBuffer.resize(m_sockaddrSize);
-    memset(m_sockaddrBuffer.data(), 0, m_sockaddrSize);
+    memset(&m_sockaddr, 0, m_sockaddrSize);
 
     return m_sockaddrSize > 0;
 }
 
+Endpoint Endpoint::FromSockAddr(const sockaddr* addr, socklen_t addrSize)
+{
+    Endpoint endpoint;
+
+    if (addr && addr->sa_family == AF_INET && addrSize >= (socklen_t)sizeof(sockaddr_in))
+    {
+        const auto* addrIn = reinterpret_cast<const sockaddr_in*>(addr);
+        endpoint.family = AF_INET;
+        endpoint.port = addrIn->sin_port;
+        memcpy(endpoint.address, &addrIn->sin_addr, sizeof(addrIn->sin_addr));
+    }
+    else if (addr && addr->sa_family == AF_INET6 && addrSize >= (socklen_t)sizeof(sockaddr_in6))
+    {
+        const auto* addrIn6 = reinterpret_cast<const sockaddr_in6*>(addr);
+        endpoint.family = AF_INET6;
+        endpoint.port = addrIn6->sin6_port;
+        memcpy(endpoint.address, &addrIn6->sin6_addr, sizeof(addrIn6->sin6_addr));
+    }
+
+    return endpoint;
+}
+
+unsigned short Endpoint::GetPort() const
+{
+    return ntohs(port);
+}
+
+std::string Endpoint::ToString() const
+{
+    char addressBuffer[INET6_ADDRSTRLEN] = "?";
+
+    if (family == AF_INET || family == AF_INET6)
+    {
+        inet_ntop(family, address, addressBuffer, sizeof(addressBuffer));
+    }
+
+    return family == AF_INET6
+        ? "[" + std::string(addressBuffer) + "]:" + std::to_string(GetPort())
+        : std::string(addressBuffer) + ":" + std::to_string(GetPort());
+}
+
+bool Endpoint::operator==(const Endpoint& other) const
+{
+    return family == other.family && port == other.port && memcmp(address, other.address, sizeof(address)) == 0;
+}
+
+bool Endpoint::operator!=(const Endpoint& other) const
+{
+    return !(*this == other);
+}
+
+bool Endpoint::operator<(const Endpoint& other) const
+{
+    return memcmp(this, &other, sizeof(Endpoint)) < 0;
+}
+
+size_t EndpointHash::operator()(const Endpoint& endpoint) const
+{
+    uint64_t low, high;
+    memcpy(&low, endpoint.address, sizeof(low));
+    memcpy(&high, endpoint.address + sizeof(low), sizeof(high));
+
+    // splitmix64 finalizer over the folded fields
+    uint64_t hash = low ^ (high * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)endpoint.family << 16 | endpoint.port);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+
+    return (size_t)(hash ^ (hash >> 31));
+}
+
 std::vector<SockAddr> GetAddressInfo(const std::string& address, unsigned short port, NetworkProtocol netProtocol)
 {
     addrinfo hints;
@@ -1,12 +1,29 @@
 #include <ctime>
+#include "ClientConfig.h"
+#include "LoadGenerator.h"
 #include "Sender.h"
 
-int main()
+int main(int argc, char** argv)
 {
     srand(time(NULL));
 
-    Sender sender;
-    sender.Start("127.0.0.1", 8865);
+    ClientConfig config;
+
+    if (!ParseArguments(argc, argv, config))
+    {
+        return 1;
+    }
+
+    Logger::SetLevel(config.logLevel);
+
+    if (config.isLoad)
+    {
+        LoadGenerator generator(config);
+        return generator.Run() ? 0 : 1;
+    }
+
+    Sender sender(config);
+    sender.Start();
 
     return 0;
 }
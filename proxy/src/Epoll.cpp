@@ -0,0 +1,52 @@
+#include "Epoll.h"
+#include "Logger.h"
+#include <cerrno>
+#include <unistd.h>
+
+Epoll::Epoll()
+    : m_fd(::epoll_create1(EPOLL_CLOEXEC))
+{
+    if (m_fd == -1)
+    {
+        LOG_ERROR("Can't create epoll instance");
+    }
+}
+
+Epoll::~Epoll()
+{
+    if (IsSet())
+    {
+        ::close(m_fd);
+    }
+}
+
+bool Epoll::IsSet() const
+{
+    return m_fd != -1;
+}
+
+bool Epoll::Add(int fd, uint32_t events, uint64_t tag)
+{
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = tag;
+
+    return ::epoll_ctl(m_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+bool Epoll::Remove(int fd)
+{
+    return ::epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, nullptr) == 0;
+}
+
+int Epoll::Wait(epoll_event* events, int timeoutMillis)
+{
+    const int result = ::epoll_wait(m_fd, events, MAX_EVENTS, timeoutMillis);
+
+    if (result == -1 && errno == EINTR)
+    {
+        return 0;
+    }
+
+    return result;
+}
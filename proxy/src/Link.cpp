@@ -0,0 +1,189 @@
+#include "Link.h"
+#include <algorithm>
+
+namespace
+{
+    // A held packet goes out after this long even when no later packets pass it
+    constexpr uint64_t HOLD_LIMIT = 10 * 1000 * 1000;
+    // The bandwidth queue is measured in packets of this size
+    constexpr uint64_t FULL_PACKET_BITS = 1500 * 8;
+}
+
+uint32_t PacketStore::Allocate()
+{
+    if (m_free.empty())
+    {
+        const uint32_t first = (uint32_t)(m_slabs.size() * SLAB_SLOTS);
+        m_slabs.push_back(std::make_unique<char[]>(SLAB_SLOTS * SLOT_SIZE));
+        m_references.resize(m_references.size() + SLAB_SLOTS, 0);
+
+        for (uint32_t slot = first + SLAB_SLOTS; slot > first; --slot)
+        {
+            m_free.push_back(slot - 1);
+        }
+    }
+
+    const uint32_t slot = m_free.back();
+    m_free.pop_back();
+    m_references[slot] = 1;
+
+    return slot;
+}
+
+char* PacketStore::GetData(uint32_t slot)
+{
+    return m_slabs[slot / SLAB_SLOTS].get() + slot % SLAB_SLOTS * SLOT_SIZE;
+}
+
+void PacketStore::AddRef(uint32_t slot)
+{
+    ++m_references[slot];
+}
+
+void PacketStore::Release(uint32_t slot)
+{
+    if (--m_references[slot] == 0)
+    {
+        m_free.push_back(slot);
+    }
+}
+
+Link::Link(const LinkConfig& config, uint64_t seed, PacketStore& store)
+    : m_config(config)
+    , m_store(store)
+    , m_random(seed)
+    , m_queueTime(config.bandwidth > 0 ? (uint64_t)((double)config.queue * FULL_PACKET_BITS * 1e9 / config.bandwidth) : 0)
+    , m_linkFree(0)
+    , m_order(0)
+{
+}
+
+void Link::Push(const Packet& packet, uint64_t now)
+{
+    ++m_statistics.received;
+
+    if (Draw(m_config.loss))
+    {
+        ++m_statistics.lost;
+        m_store.Release(packet.slot);
+        return;
+    }
+
+    const unsigned copies = Draw(m_config.duplicate) ? 2 : 1;
+
+    if (copies == 2)
+    {
+        ++m_statistics.duplicated;
+        m_store.AddRef(packet.slot);
+    }
+
+    for (unsigned i = 0; i < copies; ++i)
+    {
+        if (Draw(m_config.reorder))
+        {
+            ++m_statistics.reordered;
+            m_held.push_back(Held{ packet, 1 + (unsigned)(m_random() % m_config.reorderWindow), now + HOLD_LIMIT });
+            continue;
+        }
+
+        Schedule(packet, now);
+
+        // Held packets that were passed by enough others follow this one
+        for (size_t j = 0; j < m_held.size();)
+        {
+            if (--m_held[j].remaining == 0)
+            {
+                Schedule(m_held[j].packet, now);
+                m_held[j] = m_held.back();
+                m_held.pop_back();
+            }
+            else
+            {
+                ++j;
+            }
+        }
+    }
+}
+
+bool Link::Pop(uint64_t now, Packet& packet)
+{
+    for (size_t i = 0; i < m_held.size();)
+    {
+        if (m_held[i].deadline <= now)
+        {
+            Schedule(m_held[i].packet, now);
+            m_held[i] = m_held.back();
+            m_held.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    if (m_queue.empty() || m_queue.top().time > now)
+    {
+        return false;
+    }
+
+    packet = m_queue.top().packet;
+    m_queue.pop();
+
+    ++m_statistics.forwarded;
+    m_statistics.bytesForwarded += packet.size;
+
+    return true;
+}
+
+uint64_t Link::GetNextTime() const
+{
+    uint64_t next = m_queue.empty() ? UINT64_MAX : m_queue.top().time;
+
+    for (const Held& held : m_held)
+    {
+        next = std::min(next, held.deadline);
+    }
+
+    return next;
+}
+
+const Link::Statistics& Link::GetStatistics() const
+{
+    return m_statistics;
+}
+
+bool Link::Draw(double probability)
+{
+    // Disabled impairments draw nothing, so a clean link costs no random numbers
+    return probability > 0 && std::uniform_real_distribution<double>(0, 1)(m_random) < probability;
+}
+
+void Link::Schedule(const Packet& packet, uint64_t now)
+{
+    uint64_t time = now;
+
+    if (m_config.bandwidth > 0)
+    {
+        // The cap serializes packets like a bottleneck link with a drop-tail queue in front of it
+        const uint64_t start = std::max(now, m_linkFree);
+
+        if (start - now > m_queueTime)
+        {
+            ++m_statistics.queueDrops;
+            m_store.Release(packet.slot);
+            return;
+        }
+
+        m_linkFree = start + (uint64_t)packet.size * 8 * 1000000000 / m_config.bandwidth;
+        time = m_linkFree;
+    }
+
+    time += m_config.delay;
+
+    if (m_config.jitter > 0)
+    {
+        time += m_random() % (m_config.jitter + 1);
+    }
+
+    m_queue.push(Scheduled{ time, m_order++, packet });
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <vector>
+#include "ProxyConfig.h"
+
+// Datagram slots with reference counts, so a duplicated packet is stored once. Grows in slabs
+// and never shrinks; datagrams are received straight into the slots.
+class PacketStore
+{
+public:
+    static constexpr size_t SLOT_SIZE = 2048;
+
+    uint32_t Allocate();
+    char* GetData(uint32_t slot);
+    void AddRef(uint32_t slot);
+    void Release(uint32_t slot);
+
+private:
+    static constexpr size_t SLAB_SLOTS = 4096;
+
+    std::vector<std::unique_ptr<char[]>> m_slabs;
+    std::vector<uint32_t> m_references;
+    std::vector<uint32_t> m_free;
+};
+
+struct Packet
+{
+    uint32_t slot;
+    uint32_t size;
+    uint32_t session;
+};
+
+// One direction of the relay. Packets go in as they are received and come out when they are due,
+// after loss, duplication, reordering, the bandwidth cap and delay were applied with a seeded
+// generator. Dropped packets are released to the store right away.
+class Link
+{
+public:
+    struct Statistics
+    {
+        uint64_t received = 0;
+        uint64_t forwarded = 0;
+        uint64_t bytesForwarded = 0;
+        uint64_t lost = 0;
+        uint64_t duplicated = 0;
+        uint64_t reordered = 0;
+        uint64_t queueDrops = 0;    // over the bandwidth queue
+    };
+
+    Link(const LinkConfig& config, uint64_t seed, PacketStore& store);
+
+    // Times are monotonic nanoseconds
+    void Push(const Packet& packet, uint64_t now);
+    // Takes the next packet due at now
+    bool Pop(uint64_t now, Packet& packet);
+    // When the next packet is due, UINT64_MAX without packets
+    uint64_t GetNextTime() const;
+
+    const Statistics& GetStatistics() const;
+
+private:
+    struct Scheduled
+    {
+        uint64_t time;
+        uint64_t order;             // keeps packets due at the same time in arrival order
+        Packet packet;
+
+        bool operator>(const Scheduled& other) const
+        {
+            return time != other.time ? time > other.time : order > other.order;
+        }
+    };
+
+    struct Held
+    {
+        Packet packet;
+        unsigned remaining;         // later packets to let pass
+        uint64_t deadline;          // released anyway, when the traffic stops
+    };
+
+    bool Draw(double probability);
+    // Queues the packet for the bandwidth and the delay
+    void Schedule(const Packet& packet, uint64_t now);
+
+private:
+    LinkConfig m_config;
+    PacketStore& m_store;
+    std::mt19937_64 m_random;
+    uint64_t m_queueTime;           // nanoseconds the bandwidth queue holds
+    uint64_t m_linkFree;            // when the bandwidth cap has sent everything queued so far
+    uint64_t m_order;
+    std::priority_queue<Scheduled, std::vector<Scheduled>, std::greater<Scheduled>> m_queue;
+    std::vector<Held> m_held;
+    Statistics m_statistics;
+};
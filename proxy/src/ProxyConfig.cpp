@@ -0,0 +1,197 @@
+#include "ProxyConfig.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+namespace
+{
+    bool ParseUnsigned(const char* value, unsigned long long maxValue, unsigned long long& result)
+    {
+        char* end = nullptr;
+        errno = 0;
+        result = strtoull(value, &end, 10);
+
+        return errno == 0 && end != value && *end == '\0' && result <= maxValue;
+    }
+
+    bool ParseDouble(const char* value, double maxValue, double& result)
+    {
+        char* end = nullptr;
+        errno = 0;
+        result = strtod(value, &end);
+
+        return errno == 0 && end != value && *end == '\0' && result >= 0 && result <= maxValue;
+    }
+
+    void PrintUsage(const char* program)
+    {
+        printf("Usage: %s [options]\n"
+            "  --address=ADDR   address to listen on (default 127.0.0.1)\n"
+            "  --port=PORT      port to listen on (default 8866)\n"
+            "  --server-address=ADDR, --server-port=PORT\n"
+            "                   where packets are relayed to (default 127.0.0.1:8865)\n"
+            "  --loss=PCT       drop packets\n"
+            "  --duplicate=PCT  send packets twice\n"
+            "  --reorder=PCT    hold packets back behind up to --reorder-window later ones (default 8)\n"
+            "  --delay=MS       add latency, fractions allowed\n"
+            "  --jitter=MS      add up to MS more latency, uniformly\n"
+            "  --bandwidth=MBIT cap the rate in Mbit/s (default 0, unlimited)\n"
+            "  --queue=N        packets queued for the bandwidth before they are dropped (default 1000)\n"
+            "  --direction=both|to-server|to-client\n"
+            "                   which direction the options above apply to, may be repeated (default both)\n"
+            "  --seed=N         seed of the random decisions (default 1)\n"
+            "  --session-timeout=S close a client's relay socket after S idle seconds (default 60)\n"
+            "  --log-level=debug|info|warning|error\n"
+            "                   lowest level logged, debug adds a line per package (default info)\n",
+            program);
+    }
+}
+
+bool ParseArguments(int argc, char** argv, ProxyConfig& config)
+{
+    // Impairment options apply to the directions selected by the last --direction
+    bool isToServer = true;
+    bool isToClient = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* argument = argv[i];
+        const char* value = strchr(argument, '=');
+        const std::string name = value ? std::string(argument, value - argument) : std::string(argument);
+        value = value ? value + 1 : "";
+
+        unsigned long long number = 0;
+        double real = 0;
+        bool isValid = true;
+
+        auto apply = [&](auto setter)
+        {
+            if (isToServer)
+            {
+                setter(config.toServer);
+            }
+
+            if (isToClient)
+            {
+                setter(config.toClient);
+            }
+        };
+
+        if (name == "--help")
+        {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (name == "--address")
+        {
+            config.address = value;
+        }
+        else if (name == "--port")
+        {
+            isValid = ParseUnsigned(value, 65535, number) && number > 0;
+            config.port = (unsigned short)number;
+        }
+        else if (name == "--log-level")
+        {
+            if (strcmp(value, "debug") == 0)
+            {
+                config.logLevel = LogLevel::Debug;
+            }
+            else if (strcmp(value, "info") == 0)
+            {
+                config.logLevel = LogLevel::Info;
+            }
+            else if (strcmp(value, "warning") == 0)
+            {
+                config.logLevel = LogLevel::Warning;
+            }
+            else if (strcmp(value, "error") == 0)
+            {
+                config.logLevel = LogLevel::Error;
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        else if (name == "--server-address")
+        {
+            config.serverAddress = value;
+        }
+        else if (name == "--server-port")
+        {
+            isValid = ParseUnsigned(value, 65535, number) && number > 0;
+            config.serverPort = (unsigned short)number;
+        }
+        else if (name == "--direction")
+        {
+            isValid = strcmp(value, "both") == 0 || strcmp(value, "to-server") == 0 || strcmp(value, "to-client") == 0;
+            isToServer = strcmp(value, "to-client") != 0;
+            isToClient = strcmp(value, "to-server") != 0;
+        }
+        else if (name == "--loss")
+        {
+            isValid = ParseDouble(value, 100, real);
+            apply([&](LinkConfig& link) { link.loss = real / 100; });
+        }
+        else if (name == "--duplicate")
+        {
+            isValid = ParseDouble(value, 100, real);
+            apply([&](LinkConfig& link) { link.duplicate = real / 100; });
+        }
+        else if (name == "--reorder")
+        {
+            isValid = ParseDouble(value, 100, real);
+            apply([&](LinkConfig& link) { link.reorder = real / 100; });
+        }
+        else if (name == "--reorder-window")
+        {
+            isValid = ParseUnsigned(value, 1 << 16, number) && number > 0;
+            apply([&](LinkConfig& link) { link.reorderWindow = (unsigned)number; });
+        }
+        else if (name == "--delay")
+        {
+            isValid = ParseDouble(value, 3600 * 1000, real);
+            apply([&](LinkConfig& link) { link.delay = (uint64_t)(real * 1e6); });
+        }
+        else if (name == "--jitter")
+        {
+            isValid = ParseDouble(value, 3600 * 1000, real);
+            apply([&](LinkConfig& link) { link.jitter = (uint64_t)(real * 1e6); });
+        }
+        else if (name == "--bandwidth")
+        {
+            isValid = ParseDouble(value, 1e6, real);
+            apply([&](LinkConfig& link) { link.bandwidth = (uint64_t)(real * 1e6); });
+        }
+        else if (name == "--queue")
+        {
+            isValid = ParseUnsigned(value, 1 << 24, number) && number > 0;
+            apply([&](LinkConfig& link) { link.queue = (unsigned)number; });
+        }
+        else if (name == "--seed")
+        {
+            isValid = ParseUnsigned(value, UINT64_MAX, number);
+            config.seed = number;
+        }
+        else if (name == "--session-timeout")
+        {
+            isValid = ParseUnsigned(value, 24 * 3600, number) && number > 0;
+            config.sessionTimeout = (unsigned)number;
+        }
+        else
+        {
+            isValid = false;
+        }
+
+        if (!isValid)
+        {
+            printf("Invalid argument: %s\n", argument);
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "Logger.h"
+
+// Impairments of one direction, applied in this order: loss, duplication, reordering,
+// the bandwidth cap with its queue, then delay and jitter
+struct LinkConfig
+{
+    double loss = 0;                // probability of dropping a packet
+    double duplicate = 0;           // probability of sending a packet twice
+    double reorder = 0;             // probability of holding a packet back behind later ones
+    unsigned reorderWindow = 8;     // a held packet is released after up to this many later packets
+    uint64_t delay = 0;             // nanoseconds added to every packet
+    uint64_t jitter = 0;            // up to this many nanoseconds more, uniformly; reorders packets too
+    uint64_t bandwidth = 0;         // bits per second, 0 is unlimited
+    unsigned queue = 1000;          // packets of full size waiting for the bandwidth before drop-tail
+};
+
+struct ProxyConfig
+{
+    // Clients send to address:port, the proxy relays to serverAddress:serverPort
+    std::string address = "127.0.0.1";
+    unsigned short port = 8866;
+    std::string serverAddress = "127.0.0.1";
+    unsigned short serverPort = 8865;
+
+    LinkConfig toServer;
+    LinkConfig toClient;
+
+    // Every random decision derives from the seed, so the same traffic is impaired the same way
+    uint64_t seed = 1;
+    // A client's relay socket is closed after this many seconds without packets
+    unsigned sessionTimeout = 60;
+
+    // Lowest level logged at run time, Debug adds a line per package
+    LogLevel logLevel = LogLevel::Info;
+};
+
+// Parses "--name=value" arguments, prints usage and returns false on unknown or malformed ones
+bool ParseArguments(int argc, char** argv, ProxyConfig& config);
@@ -0,0 +1,367 @@
+#include "UdpProxy.h"
+#include "Logger.h"
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <ctime>
+
+namespace
+{
+    constexpr uint64_t LISTEN_TAG = 0;
+    constexpr uint64_t TIMER_TAG = 1;
+    constexpr uint64_t SESSION_TAG = 2;     // plus the session id
+
+    constexpr int SOCKET_BUFFER_SIZE = 4 << 20;
+    constexpr uint64_t REPORT_INTERVAL = 1000000000;
+
+    uint64_t GetNow()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_nsec;
+    }
+
+    // Bursts at line rate must not overflow the kernel buffers of the proxy itself
+    void SetBufferSizes(const UdpSocket& socket)
+    {
+        int size = SOCKET_BUFFER_SIZE;
+        setsockopt(socket.GetSocketId(), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(socket.GetSocketId(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+}
+
+UdpProxy::UdpProxy(const ProxyConfig& config)
+    : m_config(config)
+    , m_toServer(config.toServer, config.seed * 2, m_store)
+    , m_toClient(config.toClient, config.seed * 2 + 1, m_store)
+    , m_socket(NetworkProtocol::IPv4, true)
+    , m_timerFd(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+    , m_timerTime(0)
+    , m_nextSession(1)
+    , m_sendErrors(0)
+{
+    for (unsigned i = 0; i < UdpSocket::MAX_BATCH_SIZE; ++i)
+    {
+        m_readSlots[i] = m_store.Allocate();
+        m_reads[i].buff = m_store.GetData(m_readSlots[i]);
+        m_reads[i].bufSize = PacketStore::SLOT_SIZE;
+    }
+}
+
+UdpProxy::~UdpProxy()
+{
+    if (m_timerFd != -1)
+    {
+        ::close(m_timerFd);
+    }
+}
+
+bool UdpProxy::Run()
+{
+    const auto addresses = GetAddressInfo(m_config.serverAddress, m_config.serverPort, NetworkProtocol::IPv4);
+
+    if (addresses.empty())
+    {
+        LOG_ERROR("Can't resolve: {}:{}", m_config.serverAddress, m_config.serverPort);
+        return false;
+    }
+
+    m_server = addresses.front().GetEndpoint();
+
+    if (!m_socket.Bind(m_config.port, m_config.address, true, 0))
+    {
+        LOG_ERROR("Can't bind: {}:{}", m_config.address, m_config.port);
+        return false;
+    }
+
+    SetBufferSizes(m_socket);
+
+    if (!m_epoll.IsSet() || m_timerFd == -1
+        || !m_epoll.Add(m_socket.GetSocketId(), EPOLLIN, LISTEN_TAG)
+        || !m_epoll.Add(m_timerFd, EPOLLIN, TIMER_TAG))
+    {
+        LOG_ERROR("Can't set up the event loop");
+        return false;
+    }
+
+    LOG_INFO("Proxy started: {}:{} -> {}:{}, seed {}", m_config.address, m_config.port, m_config.serverAddress,
+        m_config.serverPort, m_config.seed);
+
+    epoll_event events[Epoll::MAX_EVENTS];
+    uint64_t reportTime = GetNow();
+
+    while (true)
+    {
+        const uint64_t next = std::min(m_toServer.GetNextTime(), m_toClient.GetNextTime());
+        uint64_t now = GetNow();
+
+        if (next > now && next != UINT64_MAX)
+        {
+            ArmTimer(next);
+        }
+
+        // Without due packets the loop only wakes up for new ones, the timer or the report
+        const int count = m_epoll.Wait(events, next <= now ? 0 : (int)(REPORT_INTERVAL / 1000000));
+        now = GetNow();
+
+        for (int i = 0; i < count; ++i)
+        {
+            const uint64_t tag = events[i].data.u64;
+
+            if (tag == LISTEN_TAG)
+            {
+                Receive(m_socket, 0, m_toServer, now);
+            }
+            else if (tag == TIMER_TAG)
+            {
+                uint64_t expirations;
+                (void)!::read(m_timerFd, &expirations, sizeof(expirations));
+                m_timerTime = 0;
+            }
+            else
+            {
+                const auto it = m_sessions.find((uint32_t)(tag - SESSION_TAG));
+
+                if (it != m_sessions.end())
+                {
+                    it->second.lastActivity = now;
+                    Receive(*it->second.upstream, it->first, m_toClient, now);
+                }
+            }
+        }
+
+        Forward(now);
+
+        if (now - reportTime >= REPORT_INTERVAL)
+        {
+            Report((now - reportTime) / 1e9);
+            ExpireSessions(now);
+            reportTime = now;
+        }
+    }
+
+    return true;
+}
+
+void UdpProxy::Receive(UdpSocket& socket, uint32_t session, Link& link, uint64_t now)
+{
+    while (true)
+    {
+        const int messagesRead = socket.ReadMany(m_reads, UdpSocket::MAX_BATCH_SIZE);
+
+        if (messagesRead <= 0)
+        {
+            break;
+        }
+
+        for (int i = 0; i < messagesRead; ++i)
+        {
+            // Truncated datagrams are not forwarded cut off
+            if (m_reads[i].dataSize == 0)
+            {
+                continue;
+            }
+
+            const uint32_t id = session != 0 ? session : GetSession(m_reads[i].endpoint, now);
+
+            // Without a session the slot is simply read into again
+            if (id == 0)
+            {
+                continue;
+            }
+
+            link.Push(Packet{ m_readSlots[i], m_reads[i].dataSize, id }, now);
+
+            m_readSlots[i] = m_store.Allocate();
+            m_reads[i].buff = m_store.GetData(m_readSlots[i]);
+        }
+
+        if ((unsigned)messagesRead < UdpSocket::MAX_BATCH_SIZE)
+        {
+            break;
+        }
+    }
+}
+
+uint32_t UdpProxy::GetSession(const Endpoint& client, uint64_t now)
+{
+    const auto it = m_sessionIds.find(client);
+
+    if (it != m_sessionIds.end())
+    {
+        m_sessions[it->second].lastActivity = now;
+        return it->second;
+    }
+
+    Session session;
+    session.client = client;
+    session.upstream = std::make_unique<UdpSocket>(NetworkProtocol::IPv4, true);
+    session.lastActivity = now;
+
+    const uint32_t id = m_nextSession;
+
+    if (!session.upstream->IsSet() || !m_epoll.Add(session.upstream->GetSocketId(), EPOLLIN, SESSION_TAG + id))
+    {
+        LOG_ERROR("Can't create a relay socket for {}", client.ToString());
+        return 0;
+    }
+
+    SetBufferSizes(*session.upstream);
+
+    ++m_nextSession;
+    m_sessionIds[client] = id;
+    m_sessions[id] = std::move(session);
+
+    LOG_INFO("Session {}: {}", id, client.ToString());
+
+    return id;
+}
+
+void UdpProxy::Forward(uint64_t now)
+{
+    Packet packet;
+    UdpSocket* socket = nullptr;
+    unsigned count = 0;
+
+    // Towards the server every client has its own socket, consecutive packets of one client are batched
+    while (m_toServer.Pop(now, packet))
+    {
+        const auto it = m_sessions.find(packet.session);
+
+        if (it == m_sessions.end())
+        {
+            m_store.Release(packet.slot);
+            continue;
+        }
+
+        if (count > 0 && (it->second.upstream.get() != socket || count == UdpSocket::MAX_BATCH_SIZE))
+        {
+            Flush(*socket, count);
+            count = 0;
+        }
+
+        socket = it->second.upstream.get();
+        m_sends[count].buff = m_store.GetData(packet.slot);
+        m_sends[count].dataSize = packet.size;
+        m_sends[count].endpoint = m_server;
+        m_sendSlots[count++] = packet.slot;
+    }
+
+    if (count > 0)
+    {
+        Flush(*socket, count);
+        count = 0;
+    }
+
+    // Towards the clients everything leaves through the listening socket
+    while (m_toClient.Pop(now, packet))
+    {
+        const auto it = m_sessions.find(packet.session);
+
+        if (it == m_sessions.end())
+        {
+            m_store.Release(packet.slot);
+            continue;
+        }
+
+        if (count == UdpSocket::MAX_BATCH_SIZE)
+        {
+            Flush(m_socket, count);
+            count = 0;
+        }
+
+        m_sends[count].buff = m_store.GetData(packet.slot);
+        m_sends[count].dataSize = packet.size;
+        m_sends[count].endpoint = it->second.client;
+        m_sendSlots[count++] = packet.slot;
+    }
+
+    if (count > 0)
+    {
+        Flush(m_socket, count);
+    }
+}
+
+void UdpProxy::Flush(UdpSocket& socket, unsigned count)
+{
+    const int sent = socket.WriteMany(m_sends, count);
+    m_sendErrors += count - (unsigned)std::max(sent, 0);
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        m_store.Release(m_sendSlots[i]);
+    }
+}
+
+void UdpProxy::ArmTimer(uint64_t time)
+{
+    if (time == m_timerTime)
+    {
+        return;
+    }
+
+    itimerspec spec = {};
+    spec.it_value.tv_sec = (time_t)(time / 1000000000);
+    spec.it_value.tv_nsec = (long)(time % 1000000000);
+
+    if (::timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) == 0)
+    {
+        m_timerTime = time;
+    }
+}
+
+void UdpProxy::ExpireSessions(uint64_t now)
+{
+    const uint64_t timeout = (uint64_t)m_config.sessionTimeout * 1000000000;
+
+    for (auto it = m_sessions.begin(); it != m_sessions.end();)
+    {
+        if (now - it->second.lastActivity > timeout)
+        {
+            LOG_INFO("Session {} expired", it->first);
+            m_epoll.Remove(it->second.upstream->GetSocketId());
+            m_sessionIds.erase(it->second.client);
+            it = m_sessions.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void UdpProxy::Report(double seconds)
+{
+    auto report = [seconds](const char* direction, const Link::Statistics& current, Link::Statistics& reported)
+    {
+        if (current.received == reported.received)
+        {
+            return;
+        }
+
+        LOG_INFO("{}: {:.0f} packets/s, {:.1f} Mbit/s forwarded", direction, (current.forwarded - reported.forwarded) / seconds,
+            (current.bytesForwarded - reported.bytesForwarded) * 8 / seconds / 1e6);
+
+        const uint64_t lost = current.lost - reported.lost;
+        const uint64_t duplicated = current.duplicated - reported.duplicated;
+        const uint64_t reordered = current.reordered - reported.reordered;
+        const uint64_t queueDrops = current.queueDrops - reported.queueDrops;
+
+        if (lost + duplicated + reordered + queueDrops > 0)
+        {
+            LOG_INFO("{}: {} lost, {} duplicated, {} reordered, {} dropped by the bandwidth queue",
+                direction, lost, duplicated, reordered, queueDrops);
+        }
+
+        reported = current;
+    };
+
+    report("To server", m_toServer.GetStatistics(), m_reportedToServer);
+    report("To client", m_toClient.GetStatistics(), m_reportedToClient);
+
+    if (m_sendErrors > 0)
+    {
+        LOG_WARNING("{} datagrams refused by full socket buffers", m_sendErrors);
+        m_sendErrors = 0;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include "ProxyConfig.h"
+#include "Link.h"
+#include "UdpSocket.h"
+#include "Epoll.h"
+
+// Relays datagrams between clients and the server through two impaired Links. Every client gets
+// its own socket towards the server, so replies find their way back. One thread with batched
+// recvmmsg/sendmmsg, packets are received into and sent from the PacketStore without copies;
+// delayed packets wake the loop through a timerfd with nanosecond resolution.
+class UdpProxy
+{
+public:
+    explicit UdpProxy(const ProxyConfig& config);
+    ~UdpProxy();
+
+    // Relays until the process ends; returns false when the sockets can't be set up
+    bool Run();
+
+private:
+    struct Session
+    {
+        Endpoint client;
+        std::unique_ptr<UdpSocket> upstream;
+        uint64_t lastActivity = 0;
+    };
+
+    // Reads everything queued on a socket into the link, from a client when session is 0
+    void Receive(UdpSocket& socket, uint32_t session, Link& link, uint64_t now);
+    uint32_t GetSession(const Endpoint& client, uint64_t now);
+    // Sends the packets that are due, batched per socket
+    void Forward(uint64_t now);
+    void Flush(UdpSocket& socket, unsigned count);
+    void ArmTimer(uint64_t time);
+    void ExpireSessions(uint64_t now);
+    void Report(double seconds);
+
+private:
+    ProxyConfig m_config;
+    PacketStore m_store;
+    Link m_toServer;
+    Link m_toClient;
+
+    UdpSocket m_socket;
+    Endpoint m_server;
+    Epoll m_epoll;
+    int m_timerFd;
+    uint64_t m_timerTime;           // when the timer is armed for, 0 when disarmed
+
+    std::unordered_map<Endpoint, uint32_t, EndpointHash> m_sessionIds;
+    std::unordered_map<uint32_t, Session> m_sessions;
+    uint32_t m_nextSession;
+
+    // Receive slots taken from the store before every read, the used ones are replaced
+    uint32_t m_readSlots[UdpSocket::MAX_BATCH_SIZE];
+    Datagram m_reads[UdpSocket::MAX_BATCH_SIZE];
+    uint32_t m_sendSlots[UdpSocket::MAX_BATCH_SIZE];
+    Datagram m_sends[UdpSocket::MAX_BATCH_SIZE];
+
+    uint64_t m_sendErrors;          // datagrams the sockets refused
+    Link::Statistics m_reportedToServer;
+    Link::Statistics m_reportedToClient;
+};
@@ -0,0 +1,592 @@
+#include "UdpSocket.h"
+#include <cstring>
+#include <algorithm>
+#include <sys/ioctl.h>
+#include <netdb.h>
+#include <unistd.h>
+
+UdpSocket::UdpSocket()
+    : m_socketId(INVALID_SOCKET)
+    , m_netProtocol(NetworkProtocol::Unknown)
+    , m_nonBlocking(false)
+{
+}
+
+UdpSocket::UdpSocket(NetworkProtocol netProtocol, bool nonBlocking)
+    : UdpSocket()
+{
+    Create(netProtocol, nonBlocking);
+}
+
+UdpSocket::~UdpSocket()
+{
+    Close();
+}
+
+bool UdpSocket::IsSet() const
+{
+    return m_socketId != INVALID_SOCKET;
+}
+
+int UdpSocket::GetSocketId() const
+{
+    return m_socketId;
+}
+
+bool UdpSocket::Create(NetworkProtocol netProtocol, bool nonBlocking)
+{
+    Close();
+    auto socketId = ::socket(netProtocol == NetworkProtocol::IPv4 ? AF_INET : AF_INET6, SOCK_DGRAM, IPPROTO_UDP);
+
+    if (socketId != INVALID_SOCKET)
+    {
+        m_socketId = socketId;
+        m_netProtocol = netProtocol;
+
+        if (SetNonBlockingMode(nonBlocking))
+        {
+            linger lingerOptions { 1, 0 };
+            setsockopt(socketId, SOL_SOCKET, SO_LINGER, &lingerOptions, sizeof(lingerOptions));
+        }
+        else
+        {
+            Close();
+        }
+    }
+
+    return m_socketId != INVALID_SOCKET;
+}
+
+void UdpSocket::Close()
+{
+    if (IsSet() && ::close(m_socketId) != SOCKET_ERROR)
+    {
+        m_socketId = INVALID_SOCKET;
+        m_netProtocol = NetworkProtocol::Unknown;
+        m_nonBlocking = false;
+    }
+}
+
+bool UdpSocket::Bind(unsigned short port, const std::string& address, bool reuseAddress, unsigned timeout)
+{
+    bool isSuccess = false;
+
+    if (IsSet())
+    {
+        if (reuseAddress)
+        {
+            int reuse = 1;
+            setsockopt(m_socketId, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+        }
+
+        if (m_netProtocol == NetworkProtocol::IPv6)
+        {
+            int onlyIpv6 = 1;
+            setsockopt(m_socketId, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&onlyIpv6, sizeof(onlyIpv6));
+        }
+
+        auto addresses = GetAddressInfo(address, port, m_netProtocol);
+        const auto startTime = std::chrono::steady_clock::now();
+
+        for (bool tryAgain = true; tryAgain;)
+        {
+            for (size_t i = 0; i < addresses.size(); ++i)
+            {
+                const auto& sockAddr = addresses[i];
+                isSuccess = ::bind(m_socketId, sockAddr.GetSockAddr(), sockAddr.GetSockAddrSize()) == 0;
+
+                if (isSuccess || std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() > timeout)
+                {
+                    tryAgain = false;
+                    break;
+                }
+                else if (reuseAddress || errno != EADDRINUSE)
+                {
+                    addresses.erase(addresses.begin() + i);
+                    break;
+                }
+                else
+                {
+                    using namespace std::chrono_literals;
+                    std::this_thread::sleep_for(10ms);
+                }
+            }
+
+            tryAgain = tryAgain && !addresses.empty();
+        }
+    }
+
+    return isSuccess;
+}
+
+bool UdpSocket::SetReusePort(bool reusePort)
+{
+    int reuse = reusePort ? 1 : 0;
+    return IsSet() && setsockopt(m_socketId, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse)) == 0;
+}
+
+bool UdpSocket::AttachReusePortFilter(const std::vector<sock_filter>& program)
+{
+    sock_fprog filter;
+    filter.len = (unsigned short)program.size();
+    filter.filter = const_cast<sock_filter*>(program.data());
+
+    return IsSet() && !program.empty() &&
+        setsockopt(m_socketId, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &filter, sizeof(filter)) == 0;
+}
+
+bool UdpSocket::SetNonBlockingMode(bool nonBlocking)
+{
+    unsigned long mode = nonBlocking ? 1 : 0;
+    const bool isSuccess = ::ioctl(m_socketId, FIONBIO, &mode) != -1;
+
+    if (isSuccess)
+    {
+        m_nonBlocking = nonBlocking;
+    }
+
+    return isSuccess;
+}
+
+bool UdpSocket::IsNonBlocking() const
+{
+    return m_nonBlocking;
+}
+
+int UdpSocket::Read(char* buff, unsigned bufSize, std::string* outAddress, unsigned short* outPort)
+{
+    int bytesRead = SOCKET_ERROR;
+
+    if (IsSet() && buff && bufSize > 0)
+    {
+        SockAddr sockAddr;
+        bytesRead = recvfrom(m_socketId, buff, bufSize, 0, sockAddr.GetSockAddrPtr(), sockAddr.GetSockAddrSizePtr());
+
+        if (bytesRead > 0)
+        {
+            GetSocketInfo(sockAddr, outAddress, outPort, NULL);
+        }
+    }
+
+    return bytesRead;
+}
+
+int UdpSocket::Read(char* buff, unsigned bufSize, Endpoint* outEndpoint)
+{
+    int bytesRead = SOCKET_ERROR;
+
+    if (IsSet() && buff && bufSize > 0)
+    {
+        sockaddr_storage address;
+        socklen_t addressSize = sizeof(address);
+        bytesRead = recvfrom(m_socketId, buff, bufSize, 0, (sockaddr*)&address, &addressSize);
+
+        if (bytesRead > 0 && outEndpoint)
+        {
+            *outEndpoint = Endpoint::FromSockAddr((const sockaddr*)&address, addressSize);
+        }
+    }
+
+    return bytesRead;
+}
+
+int UdpSocket::Write(const char* buff, unsigned bufSize, const std::string& address, unsigned short port)
+{
+    int bytesSent = SOCKET_ERROR;
+
+    if (IsSet() && buff && bufSize > 0 && !address.empty() && port > 0)
+    {
+        const auto addresses = GetAddressInfo(address, port, m_netProtocol);
+
+        for (size_t i = 0; i < addresses.size() && bytesSent <= 0; ++i)
+        {
+            bytesSent = sendto(m_socketId, buff, bufSize, 0, addresses[i].GetSockAddr(), addresses[i].GetSockAddrSize());
+        }
+    }
+
+    return bytesSent;
+}
+
+int UdpSocket::Write(const char* buff, unsigned bufSize, const SockAddr& address)
+{
+    int bytesSent = SOCKET_ERROR;
+
+    if (IsSet() && buff && bufSize > 0 && address.IsSet())
+    {
+        bytesSent = sendto(m_socketId, buff, bufSize, 0, address.GetSockAddr(), address.GetSockAddrSize());
+    }
+
+    return bytesSent;
+}
+
+int UdpSocket::Write(const char* buff, unsigned bufSize, const Endpoint& endpoint)
+{
+    return Write(buff, bufSize, SockAddr(endpoint));
+}
+
+int UdpSocket::ReadMany(Datagram* datagrams, unsigned count)
+{
+    int messagesRead = SOCKET_ERROR;
+
+    if (IsSet() && datagrams && count > 0)
+    {
+        count = std::min(count, MAX_BATCH_SIZE);
+
+        mmsghdr messages[MAX_BATCH_SIZE];
+        iovec vectors[MAX_BATCH_SIZE];
+        sockaddr_storage addresses[MAX_BATCH_SIZE];
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            vectors[i].iov_base = datagrams[i].buff;
+            vectors[i].iov_len = datagrams[i].bufSize;
+
+            memset(&messages[i], 0, sizeof(mmsghdr));
+            messages[i].msg_hdr.msg_name = &addresses[i];
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        messagesRead = recvmmsg(m_socketId, messages, count, 0, nullptr);
+
+        // A datagram larger than its buffer arrives cut off, it is reported empty instead
+        for (int i = 0; i < messagesRead; ++i)
+        {
+            datagrams[i].dataSize = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : messages[i].msg_len;
+            datagrams[i].endpoint = Endpoint::FromSockAddr((const sockaddr*)&addresses[i], messages[i].msg_hdr.msg_namelen);
+        }
+    }
+
+    return messagesRead;
+}
+
+int UdpSocket::WriteMany(const Datagram* datagrams, unsigned count)
+{
+    int messagesSent = SOCKET_ERROR;
+
+    if (IsSet() && datagrams && count > 0)
+    {
+        count = std::min(count, MAX_BATCH_SIZE);
+
+        mmsghdr messages[MAX_BATCH_SIZE];
+        iovec vectors[MAX_BATCH_SIZE];
+        SockAddr addresses[MAX_BATCH_SIZE];
+
+        for (unsigned i = 0; i < count; ++i)
+        {
+            addresses[i] = SockAddr(datagrams[i].endpoint);
+
+            vectors[i].iov_base = datagrams[i].buff;
+            vectors[i].iov_len = datagrams[i].dataSize;
+
+            memset(&messages[i], 0, sizeof(mmsghdr));
+            messages[i].msg_hdr.msg_name = addresses[i].GetSockAddrPtr();
+            messages[i].msg_hdr.msg_namelen = addresses[i].GetSockAddrSize();
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // sendmmsg may stop early, e.g. when the send buffer is full
+        for (unsigned sent = 0; sent < count;)
+        {
+            const int result = sendmmsg(m_socketId, messages + sent, count - sent, 0);
+
+            if (result <= 0)
+            {
+                messagesSent = sent > 0 ? (int)sent : result;
+                break;
+            }
+
+            sent += result;
+            messagesSent = sent;
+        }
+    }
+
+    return messagesSent;
+}
+
+bool UdpSocket::CanRead(unsigned waitTimeoutMillis) const
+{
+    return Poll(true, waitTimeoutMillis);
+}
+
+bool UdpSocket::CanWrite(unsigned waitTimeoutMillis) const
+{
+    return Poll(false, waitTimeoutMillis);
+}
+
+bool UdpSocket::Poll(bool readEvent, int timeout) const
+{
+    bool canReadOrWrite = false;
+
+    if (IsSet())
+    {
+        short pollEvent = readEvent ? POLLIN : POLLOUT;
+
+        struct pollfd fdArray{ 0, 0, 0 };
+        fdArray.fd = m_socketId;
+        fdArray.events = pollEvent;
+
+        canReadOrWrite = poll(&fdArray, 1, timeout) > 0 && (fdArray.revents & pollEvent) != 0;
+
+        if (!canReadOrWrite && (fdArray.revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            // TODO
+        }
+    }
+
+    return canReadOrWrite;
+}
+
+bool UdpSocket::GetSocketInfo(const SockAddr& addrStorage,
+    std::string* outPeerAddress, unsigned short* outPeerPort, NetworkProtocol* outNetworkProtocol)
+{
+    bool isSuccess = false;
+
+    char peerAddressBuffer[NI_MAXHOST];
+    char peerPortBuffer[NI_MAXSERV];
+
+    if (getnameinfo(addrStorage.GetSockAddr(), addrStorage.GetSockAddrSize(),
+        peerAddressBuffer, sizeof(peerAddressBuffer), peerPortBuffer, sizeof(peerPortBuffer), NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+    {
+        isSuccess = true;
+
+        if (outPeerAddress)
+        {
+            *outPeerAddress = std::string(peerAddressBuffer);
+        }
+
+        if (outPeerPort)
+        {
+            *outPeerPort = (unsigned short)atoi(peerPortBuffer);
+        }
+
+        if (outNetworkProtocol)
+        {
+            *outNetworkProtocol = addrStorage.GetNetworkProtocol();
+        }
+    }
+
+    return isSuccess;
+}
+
+
+SockAddr::SockAddr()
+    : m_sockaddrSize(0)
+{
+    Init();
+}
+
+SockAddr::SockAddr(const sockaddr* addr, socklen_t addrSize)
+    : m_sockaddrSize(0)
+{
+    Init(addr, addrSize);
+}
+
+SockAddr::SockAddr(const Endpoint& endpoint)
+    : m_sockaddrSize(0)
+{
+    Init();
+
+    if (endpoint.family == AF_INET)
+    {
+        auto* addr = reinterpret_cast<sockaddr_in*>(&m_sockaddr);
+        addr->sin_family = AF_INET;
+        addr->sin_port = endpoint.port;
+        memcpy(&addr->sin_addr, endpoint.address, sizeof(addr->sin_addr));
+        m_sockaddrSize = sizeof(sockaddr_in);
+    }
+    else if (endpoint.family == AF_INET6)
+    {
+        auto* addr = reinterpret_cast<sockaddr_in6*>(&m_sockaddr);
+        addr->sin6_family = AF_INET6;
+        addr->sin6_port = endpoint.port;
+        memcpy(&addr->sin6_addr, endpoint.address, sizeof(addr->sin6_addr));
+        m_sockaddrSize = sizeof(sockaddr_in6);
+    }
+}
+
+void SockAddr::Init(const sockaddr* addr, socklen_t addrSize)
+{
+    if (Init() && addrSize <= (socklen_t)sizeof(m_sockaddr))
+    {
+        memcpy(&m_sockaddr, addr, addrSize);
+        m_sockaddrSize = addrSize;
+    }
+}
+
+bool SockAddr::IsSet() const
+{
+    return m_sockaddrSize > 0;
+}
+
+NetworkProtocol SockAddr::GetNetworkProtocol() const
+{
+    if (IsSet())
+    {
+        switch (m_sockaddr.ss_family)
+        {
+            case AF_INET:
+            {
+                return NetworkProtocol::IPv4;
+            }
+            case AF_INET6:
+            {
+                return NetworkProtocol::IPv6;
+            }
+            default: break;
+        }
+    }
+
+    return NetworkProtocol::Unknown;
+}
+
+Endpoint SockAddr::GetEndpoint() const
+{
+    return Endpoint::FromSockAddr(GetSockAddr(), m_sockaddrSize);
+}
+
+const sockaddr* SockAddr::GetSockAddr() const
+{
+    return IsSet()
+        ? reinterpret_cast<const sockaddr*>(&m_sockaddr)
+        : nullptr;
+}
+
+socklen_t SockAddr::GetSockAddrSize() const
+{
+    return m_sockaddrSize;
+}
+
+sockaddr* SockAddr::GetSockAddrPtr()
+{
+    return IsSet()
+        ? reinterpret_cast<sockaddr*>(&m_sockaddr)
+        : nullptr;
+}
+
+socklen_t* SockAddr::GetSockAddrSizePtr()
+{
+    return &m_sockaddrSize;
+}
+
+bool SockAddr::Init()
+{
+    m_sockaddrSize = sizeof(sockaddr_storage);
+    memset(&m_sockaddr, 0, m_sockaddrSize);
+
+    return m_sockaddrSize > 0;
+}
+
+Endpoint Endpoint::FromSockAddr(const sockaddr* addr, socklen_t addrSize)
+{
+    Endpoint endpoint;
+
+    if (addr && addr->sa_family == AF_INET && addrSize >= (socklen_t)sizeof(sockaddr_in))
+    {
+        const auto* addrIn = reinterpret_cast<const sockaddr_in*>(addr);
+        endpoint.family = AF_INET;
+        endpoint.port = addrIn->sin_port;
+        memcpy(endpoint.address, &addrIn->sin_addr, sizeof(addrIn->sin_addr));
+    }
+    else if (addr && addr->sa_family == AF_INET6 && addrSize >= (socklen_t)sizeof(sockaddr_in6))
+    {
+        const auto* addrIn6 = reinterpret_cast<const sockaddr_in6*>(addr);
+        endpoint.family = AF_INET6;
+        endpoint.port = addrIn6->sin6_port;
+        memcpy(endpoint.address, &addrIn6->sin6_addr, sizeof(addrIn6->sin6_addr));
+    }
+
+    return endpoint;
+}
+
+unsigned short Endpoint::GetPort() const
+{
+    return ntohs(port);
+}
+
+std::string Endpoint::ToString() const
+{
+    char addressBuffer[INET6_ADDRSTRLEN] = "?";
+
+    if (family == AF_INET || family == AF_INET6)
+    {
+        inet_ntop(family, address, addressBuffer, sizeof(addressBuffer));
+    }
+
+    return family == AF_INET6
+        ? "[" + std::string(addressBuffer) + "]:" + std::to_string(GetPort())
+        : std::string(addressBuffer) + ":" + std::to_string(GetPort());
+}
+
+bool Endpoint::operator==(const Endpoint& other) const
+{
+    return family == other.family && port == other.port && memcmp(address, other.address, sizeof(address)) == 0;
+}
+
+bool Endpoint::operator!=(const Endpoint& other) const
+{
+    return !(*this == other);
+}
+
+bool Endpoint::operator<(const Endpoint& other) const
+{
+    return memcmp(this, &other, sizeof(Endpoint)) < 0;
+}
+
+size_t EndpointHash::operator()(const Endpoint& endpoint) const
+{
+    uint64_t low, high;
+    memcpy(&low, endpoint.address, sizeof(low));
+    memcpy(&high, endpoint.address + sizeof(low), sizeof(high));
+
+    // splitmix64 finalizer over the folded fields
+    uint64_t hash = low ^ (high * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)endpoint.family << 16 | endpoint.port);
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+
+    return (size_t)(hash ^ (hash >> 31));
+}
+
+std::vector<SockAddr> GetAddressInfo(const std::string& address, unsigned short port, NetworkProtocol netProtocol)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+
+    if (netProtocol == NetworkProtocol::IPv6)
+    {
+        hints.ai_family = AF_INET6;
+    }
+    else if (netProtocol == NetworkProtocol::IPv4)
+    {
+        hints.ai_family = AF_INET;
+    }
+    else
+    {
+        hints.ai_family = AF_UNSPEC;
+    }
+
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_NUMERICSERV | AI_PASSIVE;
+
+    if (hints.ai_family != AF_UNSPEC)
+    {
+        hints.ai_flags = hints.ai_flags | AI_NUMERICHOST;
+    }
+
+    std::vector<SockAddr> addresses;
+    addrinfo* originalAddr = nullptr;
+
+    if (getaddrinfo(address.empty() ? nullptr : address.data(), std::to_string(port).data(), &hints, &originalAddr) == 0)
+    {
+        for (auto* addrInfo = originalAddr; addrInfo != nullptr; addrInfo = addrInfo->ai_next)
+        {
+            addresses.push_back(SockAddr(addrInfo->ai_addr, (socklen_t)addrInfo->ai_addrlen));
+        }
+
+        freeaddrinfo(originalAddr);
+    }
+
+    return addresses;
+}
@@ -0,0 +1,18 @@
+#include "ProxyConfig.h"
+#include "UdpProxy.h"
+
+int main(int argc, char** argv)
+{
+    ProxyConfig config;
+
+    if (!ParseArguments(argc, argv, config))
+    {
+        return 1;
+    }
+
+    Logger::SetLevel(config.logLevel);
+
+    UdpProxy proxy(config);
+
+    return proxy.Run() ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+// Throughput benchmark for every crc32c implementation. Each variant is first checked
+// against the bitwise reference on random data, lengths and alignments.
+
+#include "../src/Crc.h"
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+    typedef uint32_t (*Crc32cFunction)(uint32_t, const unsigned char*, size_t);
+
+    struct Variant
+    {
+        const char* name;
+        Crc32cFunction function;
+        bool supported;
+    };
+
+    bool Verify(const Variant& variant, const std::vector<unsigned char>& data, std::mt19937& random)
+    {
+        for (int i = 0; i < 2000; ++i)
+        {
+            const size_t offset = random() % 64;
+            const size_t len = i < 1000 ? random() % 300 : random() % (data.size() - offset);
+            const uint32_t crc = random();
+
+            if (variant.function(crc, data.data() + offset, len) != crc32c_reference(crc, data.data() + offset, len))
+            {
+                printf("%s: mismatch at offset %zu, length %zu\n", variant.name, offset, len);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Checksums the same buffer for about 200 ms and returns GB/s
+    double Measure(Crc32cFunction function, const std::vector<unsigned char>& data, size_t len)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed(0);
+        size_t totalBytes = 0;
+        uint32_t crc = 0;
+
+        while (elapsed.count() < 0.2)
+        {
+            for (size_t i = 0; i < (1 << 20) / len + 1; ++i)
+            {
+                crc = function(crc, data.data(), len);
+                totalBytes += len;
+            }
+
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+
+        volatile uint32_t sink = crc;
+        (void)sink;
+
+        return (double)totalBytes / elapsed.count() / 1e9;
+    }
+}
+
+namespace
+{
+    bool VerifyCombine(const std::vector<unsigned char>& data, std::mt19937& random)
+    {
+        for (int i = 0; i < 2000; ++i)
+        {
+            const size_t len = random() % data.size();
+            const size_t split = len > 0 ? random() % len : 0;
+            const uint32_t crc = random();
+
+            const uint32_t combined = crc32c_combine(crc32c(crc, data.data(), split), crc32c(0, data.data() + split, len - split), len - split);
+
+            if (combined != crc32c(crc, data.data(), len))
+            {
+                printf("crc32c_combine: mismatch at split %zu, length %zu\n", split, len);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Nanoseconds per crc32c_combine call for a packet-sized second part
+    double MeasureCombine(size_t lenB)
+    {
+        const size_t iterations = 1 << 20;
+        uint32_t crc = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < iterations; ++i)
+        {
+            crc = crc32c_combine(crc, (uint32_t)i, lenB + (i & 7));
+        }
+
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        volatile uint32_t sink = crc;
+        (void)sink;
+
+        return elapsed.count() / iterations;
+    }
+}
+
+int main()
+{
+    const std::vector<Variant> variants = {
+        { "reference", crc32c_reference, true },
+        { "slicing-by-8", crc32c_sw, true },
+        { "sse4.2", crc32c_sse42, crc32c_sse42_supported() },
+        { "pclmul", crc32c_pclmul, crc32c_pclmul_supported() },
+        { "crc32c", crc32c, true },
+    };
+
+    const size_t sizes[] = { 64, 256, 1455, 4096, 65536, 1 << 20 };
+
+    std::mt19937 random(12345);
+    std::vector<unsigned char> data(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1] + 64);
+
+    for (auto& byte : data)
+    {
+        byte = (unsigned char)random();
+    }
+
+    printf("selected: %s\n", crc32c_implementation());
+    printf("%-14s", "GB/s");
+
+    for (size_t size : sizes)
+    {
+        printf("%10zu", size);
+    }
+
+    printf("\n");
+
+    int result = 0;
+
+    for (const auto& variant : variants)
+    {
+        if (!variant.supported)
+        {
+            printf("%-14s not supported\n", variant.name);
+            continue;
+        }
+
+        if (!Verify(variant, data, random))
+        {
+            result = 1;
+            continue;
+        }
+
+        printf("%-14s", variant.name);
+
+        for (size_t size : sizes)
+        {
+            printf("%10.2f", Measure(variant.function, data, size));
+            fflush(stdout);
+        }
+
+        printf("\n");
+    }
+
+    if (!VerifyCombine(data, random))
+    {
+        result = 1;
+    }
+
+    printf("crc32c_combine(lenB=1455): %.1f ns\n", MeasureCombine(1455));
+
+    std::vector<unsigned char> large(256 << 20, 0x5a);
+    const unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+
+    for (unsigned count : { 1u, threads })
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const uint32_t crc = crc32c_parallel(0, large.data(), large.size(), count);
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (crc != crc32c(0, large.data(), large.size()))
+        {
+            printf("crc32c_parallel: mismatch with %u threads\n", count);
+            result = 1;
+        }
+
+        printf("crc32c_parallel(256 MiB, %u threads): %.2f GB/s\n", count, large.size() / elapsed.count() / 1e9);
+    }
+
+    return result;
+}
@@ -0,0 +1,189 @@
+// Lookup structures for per-file and per-peer state at 100k+ concurrent transfers: the former
+// std::map keyed by the id string, std::unordered_map and FlatHashMap keyed by the id as uint64_t,
+// and the Endpoint tables. Keys look like real ids: short ASCII names padded to 8 bytes.
+
+#include "../src/FlatHashMap.h"
+#include "../src/UdpSocket.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Value
+    {
+        uint64_t payload[4] = {};
+    };
+
+    struct Timings
+    {
+        double insert;
+        double hit;
+        double miss;
+        double erase;
+    };
+
+    uint64_t MakeId(size_t index)
+    {
+        char id[9];
+        snprintf(id, sizeof(id), "f%07zu", index % 10000000);
+
+        uint64_t result;
+        memcpy(&result, id, sizeof(result));
+        return result;
+    }
+
+    std::string ToString(uint64_t id)
+    {
+        return std::string(reinterpret_cast<const char*>(&id), sizeof(id));
+    }
+
+    Endpoint MakeEndpoint(size_t index)
+    {
+        Endpoint endpoint;
+        endpoint.family = AF_INET;
+        endpoint.port = htons((uint16_t)(1024 + index % 60000));
+        const uint32_t address = htonl(0x0a000000u + (uint32_t)(index / 60000));
+        memcpy(endpoint.address, &address, sizeof(address));
+        return endpoint;
+    }
+
+    template <typename Function>
+    double NanosecondsPerOperation(size_t operations, Function&& function)
+    {
+        const auto start = Clock::now();
+        function();
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / operations;
+    }
+
+    // Map adapters: Insert, Find (returns a value pointer or nullptr) and Erase by key
+
+    template <typename Key, typename Map>
+    struct StdAdapter
+    {
+        Map map;
+
+        void Insert(const Key& key) { map[key].payload[0] = 1; }
+        Value* Find(const Key& key) { auto it = map.find(key); return it != map.end() ? &it->second : nullptr; }
+        void Erase(const Key& key) { map.erase(key); }
+    };
+
+    template <typename Key, typename Hash>
+    struct FlatAdapter
+    {
+        FlatHashMap<Key, Value, Hash> map;
+
+        void Insert(const Key& key) { map[key].payload[0] = 1; }
+        Value* Find(const Key& key) { return map.Find(key); }
+        void Erase(const Key& key) { map.Erase(key); }
+    };
+
+    template <typename Adapter, typename Key>
+    Timings Run(const std::vector<Key>& keys, const std::vector<Key>& missing, const std::vector<size_t>& order)
+    {
+        Adapter adapter;
+        Timings timings;
+        uint64_t found = 0;
+
+        timings.insert = NanosecondsPerOperation(keys.size(), [&]
+        {
+            for (const auto& key : keys)
+            {
+                adapter.Insert(key);
+            }
+        });
+
+        // Random order defeats the locality the insertion order would give the tree
+        timings.hit = NanosecondsPerOperation(order.size(), [&]
+        {
+            for (size_t index : order)
+            {
+                found += adapter.Find(keys[index]) != nullptr;
+            }
+        });
+
+        timings.miss = NanosecondsPerOperation(missing.size(), [&]
+        {
+            for (const auto& key : missing)
+            {
+                found += adapter.Find(key) != nullptr;
+            }
+        });
+
+        timings.erase = NanosecondsPerOperation(order.size(), [&]
+        {
+            for (size_t index : order)
+            {
+                adapter.Erase(keys[index]);
+            }
+        });
+
+        if (found != keys.size())
+        {
+            printf("unexpected lookup result: %llu of %zu\n", (unsigned long long)found, keys.size());
+        }
+
+        return timings;
+    }
+
+    void Print(const char* name, const Timings& timings)
+    {
+        printf("  %-34s%10.1f%10.1f%10.1f%10.1f\n", name, timings.insert, timings.hit, timings.miss, timings.erase);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    std::mt19937_64 random(12345);
+
+    std::vector<size_t> order(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        order[i] = i;
+    }
+
+    std::shuffle(order.begin(), order.end(), random);
+
+    std::vector<uint64_t> ids(count);
+    std::vector<uint64_t> missingIds(count);
+    std::vector<std::string> names(count);
+    std::vector<std::string> missingNames(count);
+    std::vector<Endpoint> endpoints(count);
+    std::vector<Endpoint> missingEndpoints(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        ids[i] = MakeId(i);
+        missingIds[i] = MakeId(i + count);
+        names[i] = ToString(ids[i]);
+        missingNames[i] = ToString(missingIds[i]);
+        endpoints[i] = MakeEndpoint(i);
+        missingEndpoints[i] = MakeEndpoint(i + count);
+    }
+
+    printf("%zu keys, ns per operation\n", count);
+    printf("  %-34s%10s%10s%10s%10s\n", "", "insert", "hit", "miss", "erase");
+
+    printf("file id\n");
+    Print("std::map<std::string>", Run<StdAdapter<std::string, std::map<std::string, Value>>>(names, missingNames, order));
+    Print("std::unordered_map<uint64_t>", Run<StdAdapter<uint64_t, std::unordered_map<uint64_t, Value, UInt64Hash>>>(ids, missingIds, order));
+    Print("FlatHashMap<uint64_t>", Run<FlatAdapter<uint64_t, UInt64Hash>>(ids, missingIds, order));
+
+    printf("peer\n");
+    Print("std::map<Endpoint>", Run<StdAdapter<Endpoint, std::map<Endpoint, Value>>>(endpoints, missingEndpoints, order));
+    Print("std::unordered_map<Endpoint>", Run<StdAdapter<Endpoint, std::unordered_map<Endpoint, Value, EndpointHash>>>(endpoints, missingEndpoints, order));
+    Print("FlatHashMap<Endpoint>", Run<FlatAdapter<Endpoint, EndpointHash>>(endpoints, missingEndpoints, order));
+
+    return 0;
+}
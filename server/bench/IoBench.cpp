@@ -0,0 +1,182 @@
+// Closed-loop comparison of the UdpServer I/O backends on loopback: a client keeps a fixed window
+// of PUT packets in flight and measures the time to each ACK, the server reports how many
+// datagrams its I/O threads moved per syscall.
+
+#include "../src/UdpServer.h"
+#include "../src/UdpSocket.h"
+#include "../src/Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t ID_SIZE = 8;
+    constexpr size_t HEADER_SIZE = sizeof(unsigned) + sizeof(unsigned) + sizeof(unsigned char) + ID_SIZE;
+    constexpr size_t PAYLOAD_SIZE = 1000;
+    constexpr unsigned FILE_PACKETS = 1024;
+    constexpr unsigned char PUT = 1;
+    constexpr unsigned short BASE_PORT = 18865;
+    constexpr unsigned LOSS_TIMEOUT = 200;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Result
+    {
+        double seconds = 0;
+        size_t lost = 0;
+        std::vector<double> latencies; // microseconds
+    };
+
+    void MakePacket(size_t index, char* packet)
+    {
+        const unsigned seqNumber = index % FILE_PACKETS;
+        const unsigned seqTotal = FILE_PACKETS;
+        char id[ID_SIZE + 1];
+        snprintf(id, sizeof(id), "io%06zu", (index / FILE_PACKETS) % 1000000);
+
+        char* ptr = packet;
+        memcpy(ptr, &seqNumber, sizeof(unsigned));
+        ptr += sizeof(unsigned);
+        memcpy(ptr, &seqTotal, sizeof(unsigned));
+        ptr += sizeof(unsigned);
+        *ptr++ = (char)PUT;
+        memcpy(ptr, id, ID_SIZE);
+        ptr += ID_SIZE;
+        memset(ptr, (int)(index & 0xff), PAYLOAD_SIZE);
+    }
+
+    // Returns the packet index acknowledged by an ACK or SIZE_MAX
+    size_t ParseAck(const char* ack, unsigned size)
+    {
+        if (size < HEADER_SIZE)
+        {
+            return SIZE_MAX;
+        }
+
+        unsigned seqNumber;
+        memcpy(&seqNumber, ack, sizeof(unsigned));
+
+        char id[ID_SIZE + 1] = {};
+        memcpy(id, ack + HEADER_SIZE - ID_SIZE, ID_SIZE);
+
+        return strncmp(id, "io", 2) == 0 ? strtoul(id + 2, nullptr, 10) * FILE_PACKETS + seqNumber : SIZE_MAX;
+    }
+
+    Result RunClient(const SockAddr& server, size_t packets, unsigned window)
+    {
+        Result result;
+        UdpSocket socket(NetworkProtocol::IPv4, true);
+        std::vector<Clock::time_point> sendTimes(packets);
+        std::vector<bool> acked(packets, false);
+        std::vector<char> packet(HEADER_SIZE + PAYLOAD_SIZE);
+
+        char buffers[UdpSocket::MAX_BATCH_SIZE][64];
+        Datagram datagrams[UdpSocket::MAX_BATCH_SIZE];
+
+        for (unsigned i = 0; i < UdpSocket::MAX_BATCH_SIZE; ++i)
+        {
+            datagrams[i].buff = buffers[i];
+            datagrams[i].bufSize = sizeof(buffers[i]);
+        }
+
+        result.latencies.reserve(packets);
+        size_t next = 0;
+        size_t inFlight = 0;
+        const auto start = Clock::now();
+
+        while (next < packets || inFlight > 0)
+        {
+            for (; inFlight < window && next < packets; ++next, ++inFlight)
+            {
+                MakePacket(next, packet.data());
+                sendTimes[next] = Clock::now();
+                socket.Write(packet.data(), packet.size(), server);
+            }
+
+            if (!socket.CanRead(LOSS_TIMEOUT))
+            {
+                result.lost += inFlight;
+                inFlight = 0;
+                continue;
+            }
+
+            const int messagesRead = socket.ReadMany(datagrams, UdpSocket::MAX_BATCH_SIZE);
+            const auto now = Clock::now();
+
+            for (int i = 0; i < messagesRead; ++i)
+            {
+                const size_t index = ParseAck(datagrams[i].buff, datagrams[i].dataSize);
+
+                if (index < packets && !acked[index])
+                {
+                    acked[index] = true;
+                    result.latencies.push_back(std::chrono::duration<double, std::micro>(now - sendTimes[index]).count());
+                    inFlight -= inFlight > 0 ? 1 : 0;
+                }
+            }
+        }
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        return result;
+    }
+
+    double Percentile(std::vector<double>& values, double percentile)
+    {
+        if (values.empty())
+        {
+            return 0;
+        }
+
+        const size_t index = std::min(values.size() - 1, (size_t)(percentile / 100.0 * values.size()));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const size_t packets = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+    const unsigned window = argc > 2 ? (unsigned)strtoul(argv[2], nullptr, 10) : 64;
+
+    // Keeps the per-packet and startup messages of the server out of the table
+    Logger::SetLevel(LogLevel::Warning);
+
+    printf("%zu packets of %zu bytes, window %u\n", packets, HEADER_SIZE + PAYLOAD_SIZE, window);
+    printf("%-8s%12s%10s%12s%12s%12s%12s\n", "backend", "packets/s", "lost", "syscalls", "per packet", "p50 us", "p99 us");
+
+    const std::pair<const char*, IoBackend> backends[] = {
+        { "epoll", IoBackend::Epoll },
+        { "uring", IoBackend::Uring },
+    };
+
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i)
+    {
+        ServerConfig config;
+        config.port = (unsigned short)(BASE_PORT + i);
+        config.ioBackend = backends[i].second;
+
+        UdpServer server(config);
+        std::thread serverThread([&] { server.Start(config.address, config.port); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        const auto addresses = GetAddressInfo(config.address, config.port, NetworkProtocol::IPv4);
+        Result result = RunClient(addresses.front(), packets, window);
+
+        server.Stop();
+        serverThread.join();
+
+        const auto io = server.GetIoStatistics();
+
+        printf("%-8s%12.0f%10zu%12llu%12.3f%12.1f%12.1f\n", backends[i].first,
+            result.latencies.size() / result.seconds, result.lost, (unsigned long long)io.syscalls,
+            io.datagramsReceived > 0 ? (double)io.syscalls / io.datagramsReceived : 0.0,
+            Percentile(result.latencies, 50), Percentile(result.latencies, 99));
+    }
+
+    return 0;
+}
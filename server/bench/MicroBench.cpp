@@ -0,0 +1,534 @@
+// Microbenchmarks of the server hot paths, the baseline for every change to them:
+//   crc32c over packet and file sized buffers,
+//   DefaultProtocol::Process on in-order, shuffled and duplicate-heavy package streams,
+//   RequestHandler from AddRequest to the response, one request and batches,
+//   UdpSocket send/receive on loopback, one datagram and recvmmsg/sendmmsg batches.
+// Every benchmark is repeated REPETITIONS times; the results go to a JSON file (stdout by default),
+// progress to stderr.
+//
+//     MicroBench [output.json] [name filter]
+
+#include "../src/Crc.h"
+#include "../src/DefaultProtocol.h"
+#include "../src/RequestHandler.h"
+#include "../src/UdpSocket.h"
+#include "../src/Metrics.h"
+#include "../src/Logger.h"
+#include <poll.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t ID_SIZE = 8;
+    constexpr size_t HEADER_SIZE = sizeof(unsigned) + sizeof(unsigned) + sizeof(unsigned char) + ID_SIZE;
+    constexpr size_t DATA_SIZE = 1455;
+    constexpr size_t CHECKSUM_ACK_SIZE = HEADER_SIZE + sizeof(uint32_t);
+    constexpr unsigned char PUT = 1;
+    constexpr unsigned short UDP_PORT = 18965;
+
+    constexpr unsigned REPETITIONS = 5;
+    constexpr std::chrono::milliseconds MIN_REPETITION_TIME(100);
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Measurement
+    {
+        double nsPerOp;     // median over the repetitions
+        double minNsPerOp;
+        uint64_t operations;
+    };
+
+    // Calls run, which performs `operations` operations, until a repetition took MIN_REPETITION_TIME
+    Measurement Measure(uint64_t operations, const std::function<void()>& run)
+    {
+        run(); // warm-up: caches, page faults, lazily created threads and pools
+
+        std::vector<double> samples;
+        uint64_t total = 0;
+
+        for (unsigned i = 0; i < REPETITIONS; ++i)
+        {
+            const auto start = Clock::now();
+            uint64_t done = 0;
+
+            do
+            {
+                run();
+                done += operations;
+            } while (Clock::now() - start < MIN_REPETITION_TIME);
+
+            samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / done);
+            total += done;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        return Measurement{ samples[samples.size() / 2], samples.front(), total };
+    }
+
+    class Suite
+    {
+    public:
+        explicit Suite(const std::string& filter)
+            : m_filter(filter)
+        {
+        }
+
+        bool IsSelected(const std::string& name) const
+        {
+            return m_filter.empty() || name.find(m_filter) != std::string::npos;
+        }
+
+        // bytes per operation adds a throughput figure, 0 leaves it out
+        void Add(const std::string& name, const Measurement& measurement, uint64_t bytesPerOp = 0)
+        {
+            m_json.BeginObject(name.c_str());
+            m_json.Add("ns_per_op", measurement.nsPerOp);
+            m_json.Add("min_ns_per_op", measurement.minNsPerOp);
+            m_json.Add("ops_per_s", 1e9 / measurement.nsPerOp);
+            m_json.Add("operations", measurement.operations);
+
+            if (bytesPerOp > 0)
+            {
+                m_json.Add("gb_per_s", bytesPerOp / measurement.nsPerOp);
+            }
+
+            m_json.EndObject();
+
+            fprintf(stderr, "%-32s%12.1f ns/op%12.1f min\n", name.c_str(), measurement.nsPerOp, measurement.minNsPerOp);
+        }
+
+        void Add(const std::string& name, const Histogram& latency)
+        {
+            m_json.Add(name.c_str(), latency);
+
+            fprintf(stderr, "%-32s%12.1f us p50%10.1f us p99%10.1f us p999\n", name.c_str(),
+                latency.GetPercentile(0.5) / 1000.0, latency.GetPercentile(0.99) / 1000.0, latency.GetPercentile(0.999) / 1000.0);
+        }
+
+        JsonWriter& GetJson() { return m_json; }
+
+    private:
+        std::string m_filter;
+        JsonWriter m_json;
+    };
+
+    // A PUT datagram with random payload
+    std::vector<char> MakePackage(unsigned fileIndex, unsigned seqNumber, unsigned seqTotal, std::mt19937& random)
+    {
+        std::vector<char> package(HEADER_SIZE + DATA_SIZE);
+        char id[ID_SIZE + 1];
+        snprintf(id, sizeof(id), "mb%06u", fileIndex % 1000000);
+
+        char* ptr = package.data();
+        memcpy(ptr, &seqNumber, sizeof(unsigned));
+        ptr += sizeof(unsigned);
+        memcpy(ptr, &seqTotal, sizeof(unsigned));
+        ptr += sizeof(unsigned);
+        *ptr++ = (char)PUT;
+        memcpy(ptr, id, ID_SIZE);
+        ptr += ID_SIZE;
+
+        for (size_t i = 0; i < DATA_SIZE; ++i)
+        {
+            ptr[i] = (char)random();
+        }
+
+        return package;
+    }
+
+    void RunCrc(Suite& suite)
+    {
+        const size_t sizes[] = { 64, 256, DATA_SIZE, 4096, 65536, 1 << 20 };
+
+        std::mt19937 random(1);
+        std::vector<unsigned char> data(sizes[sizeof(sizes) / sizeof(sizes[0]) - 1]);
+
+        for (auto& byte : data)
+        {
+            byte = (unsigned char)random();
+        }
+
+        for (size_t size : sizes)
+        {
+            const std::string name = "crc32c/" + std::to_string(size);
+
+            if (!suite.IsSelected(name))
+            {
+                continue;
+            }
+
+            const size_t calls = std::max<size_t>(1, (1 << 20) / size);
+            uint32_t crc = 0;
+
+            suite.Add(name, Measure(calls, [&]
+            {
+                for (size_t i = 0; i < calls; ++i)
+                {
+                    crc = crc32c(crc, data.data(), size);
+                }
+            }), size);
+
+            volatile uint32_t sink = crc;
+            (void)sink;
+        }
+    }
+
+    // Files of FILE_PACKAGES packages, interleaved round-robin the way concurrent transfers arrive.
+    // Duplicates only repeat packages already sent, so every file completes exactly once per run.
+    struct PackageStream
+    {
+        static constexpr unsigned FILES = 64;
+        static constexpr unsigned FILE_PACKAGES = 256;
+
+        enum class Order
+        {
+            InOrder,
+            Shuffled,
+            Duplicates  // shuffled, every other package followed by a resend of an earlier one
+        };
+
+        PackageStream(Order order, std::mt19937& random)
+        {
+            std::vector<std::vector<unsigned>> files(FILES);
+
+            for (unsigned file = 0; file < FILES; ++file)
+            {
+                std::vector<unsigned> sequence(FILE_PACKAGES);
+
+                for (unsigned seq = 0; seq < FILE_PACKAGES; ++seq)
+                {
+                    packages.push_back(MakePackage(file, seq, FILE_PACKAGES, random));
+                    sequence[seq] = file * FILE_PACKAGES + seq;
+                }
+
+                if (order != Order::InOrder)
+                {
+                    std::shuffle(sequence.begin(), sequence.end(), random);
+                }
+
+                for (unsigned i = 0; i < FILE_PACKAGES; ++i)
+                {
+                    files[file].push_back(sequence[i]);
+
+                    if (order == Order::Duplicates && i + 1 < FILE_PACKAGES && random() % 2 == 0)
+                    {
+                        files[file].push_back(sequence[random() % (i + 1)]);
+                    }
+                }
+            }
+
+            const size_t total = CountAll(files);
+
+            for (size_t position = 0; indices.size() < total; ++position)
+            {
+                for (const auto& file : files)
+                {
+                    if (position < file.size())
+                    {
+                        indices.push_back(file[position]);
+                    }
+                }
+            }
+        }
+
+        static size_t CountAll(const std::vector<std::vector<unsigned>>& files)
+        {
+            size_t count = 0;
+
+            for (const auto& file : files)
+            {
+                count += file.size();
+            }
+
+            return count;
+        }
+
+        std::vector<std::vector<char>> packages;
+        std::vector<unsigned> indices;  // the order packages are processed in
+    };
+
+    bool RunProtocol(Suite& suite)
+    {
+        const std::pair<const char*, PackageStream::Order> orders[] = {
+            { "protocol/in_order", PackageStream::Order::InOrder },
+            { "protocol/shuffled", PackageStream::Order::Shuffled },
+            { "protocol/duplicates", PackageStream::Order::Duplicates },
+        };
+
+        std::mt19937 random(2);
+        bool isValid = true;
+
+        for (const auto& order : orders)
+        {
+            if (!suite.IsSelected(order.first))
+            {
+                continue;
+            }
+
+            const PackageStream stream(order.second, random);
+            unsigned completed = 0;
+
+            // A fresh protocol per run, the way a peer starts out; the files are reassembled in memory
+            const Measurement measurement = Measure(stream.indices.size(), [&]
+            {
+                DefaultProtocol protocol;
+                Response response;
+                Response held;
+                completed = 0;
+
+                for (unsigned index : stream.indices)
+                {
+                    const auto& package = stream.packages[index];
+                    protocol.Process(package.data(), package.size(), response);
+                    completed += response.size == CHECKSUM_ACK_SIZE ? 1 : 0;
+
+                    // Held ACKs are taken out the way RequestHandler does with the default policy
+                    if (protocol.IsAckDue())
+                    {
+                        while (protocol.FlushAck(held))
+                        {
+                        }
+                    }
+                }
+            });
+
+            if (completed != PackageStream::FILES)
+            {
+                fprintf(stderr, "%s: %u of %u files completed\n", order.first, completed, PackageStream::FILES);
+                isValid = false;
+            }
+
+            suite.Add(order.first, measurement, HEADER_SIZE + DATA_SIZE);
+        }
+
+        return isValid;
+    }
+
+    // Queues count packages of consecutive in-order files and waits for all their responses
+    void RoundTrip(RequestHandler& handler, const std::vector<std::vector<char>>& packages, size_t& next, size_t count,
+        RequestHandler::Responses& responses)
+    {
+        Endpoint client;
+        client.family = AF_INET;
+        client.port = htons(40000);
+
+        for (size_t i = 0; i < count; ++i, next = (next + 1) % packages.size())
+        {
+            PacketBuffer buffer = PacketBuffer::Allocate();
+            memcpy(buffer.GetData(), packages[next].data(), packages[next].size());
+            buffer.SetSize(packages[next].size());
+            handler.AddRequest(client, std::move(buffer));
+        }
+
+        handler.SubmitRequests();
+
+        for (size_t received = 0; received < count;)
+        {
+            handler.GetResponses(responses);
+            received += responses.size();
+
+            if (received < count && !handler.HasResponses())
+            {
+                pollfd event = { handler.GetResponsesEventFd(), POLLIN, 0 };
+                poll(&event, 1, 10);
+            }
+        }
+    }
+
+    void RunRequestHandler(Suite& suite)
+    {
+        const bool isLatencySelected = suite.IsSelected("request_handler/round_trip_latency");
+        const bool isBatchSelected = suite.IsSelected("request_handler/batch_64");
+
+        if (!isLatencySelected && !isBatchSelected)
+        {
+            return;
+        }
+
+        constexpr unsigned FILE_PACKAGES = 256;
+        std::mt19937 random(3);
+        std::vector<std::vector<char>> packages;
+
+        for (unsigned file = 0; file < 16; ++file)
+        {
+            for (unsigned seq = 0; seq < FILE_PACKAGES; ++seq)
+            {
+                packages.push_back(MakePackage(file, seq, FILE_PACKAGES, random));
+            }
+        }
+
+        ServerConfig config;
+        RequestHandler handler(config);
+        RequestHandler::Responses responses;
+        size_t next = 0;
+
+        if (isLatencySelected)
+        {
+            Histogram latency;
+
+            // One request at a time: the worker parks between requests, so this includes its wake-up
+            Measure(1, [&]
+            {
+                const uint64_t start = GetMonotonicNanoseconds();
+                RoundTrip(handler, packages, next, 1, responses);
+                latency.Record(GetMonotonicNanoseconds() - start);
+            });
+
+            suite.Add("request_handler/round_trip_latency", latency);
+        }
+
+        if (isBatchSelected)
+        {
+            constexpr size_t BATCH_SIZE = 64;
+
+            suite.Add("request_handler/batch_64", Measure(BATCH_SIZE, [&]
+            {
+                RoundTrip(handler, packages, next, BATCH_SIZE, responses);
+            }), HEADER_SIZE + DATA_SIZE);
+        }
+
+        handler.Stop();
+    }
+
+    bool RunUdpSocket(Suite& suite)
+    {
+        const bool isSingleSelected = suite.IsSelected("udp_socket/single");
+        const bool isBatchSelected = suite.IsSelected("udp_socket/batch");
+
+        if (!isSingleSelected && !isBatchSelected)
+        {
+            return true;
+        }
+
+        UdpSocket receiver(NetworkProtocol::IPv4, true);
+        UdpSocket sender(NetworkProtocol::IPv4, true);
+
+        if (!receiver.Bind(UDP_PORT, "127.0.0.1", true, 0))
+        {
+            fprintf(stderr, "udp_socket: can't bind 127.0.0.1:%u\n", UDP_PORT);
+            return false;
+        }
+
+        // A whole batch must fit into the receive buffer, the default one holds fewer full-size datagrams
+        int receiveBufferSize = 4 << 20;
+        setsockopt(receiver.GetSocketId(), SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+
+        const Endpoint destination = GetAddressInfo("127.0.0.1", UDP_PORT, NetworkProtocol::IPv4).front().GetEndpoint();
+        constexpr unsigned BATCH_SIZE = UdpSocket::MAX_BATCH_SIZE;
+        const unsigned datagramSize = (unsigned)(HEADER_SIZE + DATA_SIZE);
+
+        std::vector<char> buffers(BATCH_SIZE * PacketBuffer::GetCapacity(), 'x');
+        Datagram datagrams[BATCH_SIZE];
+        bool isValid = true;
+
+        for (unsigned i = 0; i < BATCH_SIZE; ++i)
+        {
+            datagrams[i].buff = buffers.data() + i * PacketBuffer::GetCapacity();
+            datagrams[i].bufSize = (unsigned)PacketBuffer::GetCapacity();
+            datagrams[i].dataSize = datagramSize;
+            datagrams[i].endpoint = destination;
+        }
+
+        // Loopback delivers during the send call, so a datagram is normally readable right away
+        auto receive = [&](unsigned count)
+        {
+            for (unsigned received = 0; received < count;)
+            {
+                const int result = count == 1 ? receiver.Read(datagrams[0].buff, datagrams[0].bufSize, nullptr)
+                    : receiver.ReadMany(datagrams, count - received);
+
+                if (result > 0)
+                {
+                    received += count == 1 ? 1 : (unsigned)result;
+                }
+                else if (!receiver.CanRead(100))
+                {
+                    isValid = false;
+                    return;
+                }
+            }
+        };
+
+        if (isSingleSelected)
+        {
+            suite.Add("udp_socket/single", Measure(1, [&]
+            {
+                sender.Write(datagrams[0].buff, datagramSize, destination);
+                receive(1);
+            }), datagramSize);
+        }
+
+        if (isBatchSelected)
+        {
+            suite.Add("udp_socket/batch_" + std::to_string(BATCH_SIZE), Measure(BATCH_SIZE, [&]
+            {
+                // ReadMany reports the received sizes and sources in the same datagrams
+                for (unsigned i = 0; i < BATCH_SIZE; ++i)
+                {
+                    datagrams[i].dataSize = datagramSize;
+                    datagrams[i].endpoint = destination;
+                }
+
+                sender.WriteMany(datagrams, BATCH_SIZE);
+                receive(BATCH_SIZE);
+            }), datagramSize);
+        }
+
+        if (!isValid)
+        {
+            fprintf(stderr, "udp_socket: datagrams were lost on loopback\n");
+        }
+
+        return isValid;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* outputPath = argc > 1 ? argv[1] : nullptr;
+    Suite suite(argc > 2 ? argv[2] : "");
+
+    // The per-package messages of the protocol would be measured too
+    Logger::SetLevel(LogLevel::Warning);
+
+    JsonWriter& json = suite.GetJson();
+    json.BeginObject();
+    json.Add("crc32c_implementation", std::string(crc32c_implementation()));
+    json.Add("hardware_threads", (uint64_t)std::thread::hardware_concurrency());
+    json.Add("repetitions", (uint64_t)REPETITIONS);
+    json.BeginObject("benchmarks");
+
+    RunCrc(suite);
+    bool isValid = RunProtocol(suite);
+    RunRequestHandler(suite);
+    isValid = RunUdpSocket(suite) && isValid;
+
+    json.EndObject();
+    json.EndObject();
+
+    FILE* output = outputPath ? fopen(outputPath, "w") : stdout;
+
+    if (!output)
+    {
+        fprintf(stderr, "Can't write %s\n", outputPath);
+        return 1;
+    }
+
+    fprintf(output, "%s\n", json.GetText().c_str());
+
+    if (output != stdout)
+    {
+        fclose(output);
+        fprintf(stderr, "Results written to %s\n", outputPath);
+    }
+
+    return isValid ? 0 : 1;
+}
@@ -0,0 +1,503 @@
+#include "Crc.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__)
+    #include <immintrin.h>
+    #define CRC32C_X86 1
+#endif
+
+namespace
+{
+    constexpr uint32_t POLY = 0x82f63b78; // reflected Castagnoli polynomial
+
+    // Buffers at least this large are checksummed with PCLMULQDQ folding when available
+    constexpr size_t PCLMUL_THRESHOLD = 256;
+
+    // Block sizes of the 3-way interleaved SSE4.2 loop
+    constexpr size_t LONG_BLOCK = 8192;
+    constexpr size_t SHORT_BLOCK = 256;
+
+    struct SliceTables
+    {
+        uint32_t table[8][256];
+    };
+
+    // table[k][n] is the CRC of byte n followed by k zero bytes
+    constexpr SliceTables MakeSliceTables()
+    {
+        SliceTables tables{};
+
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            uint32_t crc = n;
+
+            for (int k = 0; k < 8; ++k)
+            {
+                crc = crc & 1 ? (crc >> 1) ^ POLY : crc >> 1;
+            }
+
+            tables.table[0][n] = crc;
+        }
+
+        for (uint32_t n = 0; n < 256; ++n)
+        {
+            for (int k = 1; k < 8; ++k)
+            {
+                const uint32_t previous = tables.table[k - 1][n];
+                tables.table[k][n] = (previous >> 8) ^ tables.table[0][previous & 0xff];
+            }
+        }
+
+        return tables;
+    }
+
+    constexpr SliceTables SLICE = MakeSliceTables();
+
+    // Multiplies two polynomials modulo POLY, both in the reflected representation (bit 31 is x^0)
+    uint32_t MultModP(uint32_t a, uint32_t b)
+    {
+        uint32_t product = 0;
+
+        for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1)
+        {
+            if (a & mask)
+            {
+                product ^= b;
+
+                if ((a & (mask - 1)) == 0)
+                {
+                    break;
+                }
+            }
+
+            b = b & 1 ? (b >> 1) ^ POLY : b >> 1;
+        }
+
+        return product;
+    }
+
+    // x^(2^k) modulo POLY for every bit of a 64-bit exponent
+    struct PowerTable
+    {
+        PowerTable()
+        {
+            power[0] = 1u << 30; // x^1
+
+            for (int k = 1; k < 64; ++k)
+            {
+                power[k] = MultModP(power[k - 1], power[k - 1]);
+            }
+        }
+
+        uint32_t power[64];
+    };
+
+    const PowerTable& GetPowerTable()
+    {
+        static const PowerTable table;
+        return table;
+    }
+
+    // x^n modulo POLY, reflected
+    uint32_t XPowModP(uint64_t n)
+    {
+        const auto& power = GetPowerTable().power;
+        uint32_t result = 1u << 31; // x^0
+
+        for (int k = 0; n != 0; n >>= 1, ++k)
+        {
+            if (n & 1)
+            {
+                result = MultModP(power[k], result);
+            }
+        }
+
+        return result;
+    }
+
+    // Raw CRC register followed by `bits` zero bits
+    uint32_t ShiftSoftware(uint32_t crc, uint64_t bits)
+    {
+        return MultModP(XPowModP(bits), crc);
+    }
+
+    // Linear operator that appends `len` zero bytes to a raw CRC register, applied as 4 table lookups
+    struct ZerosOperator
+    {
+        explicit ZerosOperator(size_t len)
+        {
+            const uint32_t xpow = XPowModP(8 * (uint64_t)len);
+
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                for (int k = 0; k < 4; ++k)
+                {
+                    table[k][n] = MultModP(xpow, n << (8 * k));
+                }
+            }
+        }
+
+        uint32_t operator()(uint32_t crc) const
+        {
+            return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+        }
+
+        uint32_t table[4][256];
+    };
+
+    typedef uint32_t (*Crc32cFunction)(uint32_t, const unsigned char*, size_t);
+
+    uint32_t crc32c_dispatch(uint32_t crc, const unsigned char* buf, size_t len)
+    {
+        return len >= PCLMUL_THRESHOLD ? crc32c_pclmul(crc, buf, len) : crc32c_sse42(crc, buf, len);
+    }
+
+    typedef uint32_t (*ShiftFunction)(uint32_t, uint64_t);
+
+    uint32_t ShiftPclmul(uint32_t crc, uint64_t bits);
+
+    struct Implementation
+    {
+        Crc32cFunction function;
+        ShiftFunction shift;
+        const char* name;
+    };
+
+    Implementation SelectImplementation()
+    {
+        if (crc32c_pclmul_supported())
+        {
+            return { crc32c_dispatch, ShiftPclmul, "sse4.2+pclmul" };
+        }
+
+        if (crc32c_sse42_supported())
+        {
+            return { crc32c_sse42, ShiftSoftware, "sse4.2" };
+        }
+
+        return { crc32c_sw, ShiftSoftware, "slicing-by-8" };
+    }
+
+    const Implementation& GetImplementation()
+    {
+        static const Implementation implementation = SelectImplementation();
+        return implementation;
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    return GetImplementation().function(crc, buf, len);
+}
+
+const char* crc32c_implementation()
+{
+    return GetImplementation().name;
+}
+
+uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, size_t lenB)
+{
+    // The pre- and post-inversions of both values cancel out, so only crcA has to be moved over lenB bytes
+    return GetImplementation().shift(crcA, 8 * (uint64_t)lenB) ^ crcB;
+}
+
+uint32_t crc32c_parallel(uint32_t crc, const unsigned char* buf, size_t len, unsigned threads)
+{
+    static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    threads = (unsigned)std::min<size_t>(threads, len / MIN_CHUNK_SIZE);
+
+    if (threads <= 1)
+    {
+        return crc32c(crc, buf, len);
+    }
+
+    const size_t chunkSize = len / threads;
+    std::vector<uint32_t> checksums(threads);
+    std::vector<std::thread> workers;
+
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        const size_t offset = i * chunkSize;
+        const size_t size = i + 1 == threads ? len - offset : chunkSize;
+        workers.emplace_back([&checksums, i, buf, offset, size] { checksums[i] = crc32c(0, buf + offset, size); });
+    }
+
+    checksums[0] = crc32c(crc, buf, chunkSize);
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+
+    for (unsigned i = 1; i < threads; ++i)
+    {
+        const size_t size = i + 1 == threads ? len - i * chunkSize : chunkSize;
+        checksums[0] = crc32c_combine(checksums[0], checksums[i], size);
+    }
+
+    return checksums[0];
+}
+
+uint32_t crc32c_reference(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    int k;
+
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (k = 0; k < 8; k++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78 : crc >> 1;
+    }
+    return ~crc;
+}
+
+uint32_t crc32c_sw(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    const auto& table = SLICE.table;
+    crc = ~crc;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; len >= 8; buf += 8, len -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(word));
+        word ^= crc;
+
+        crc = table[7][word & 0xff] ^ table[6][(word >> 8) & 0xff] ^
+            table[5][(word >> 16) & 0xff] ^ table[4][(word >> 24) & 0xff] ^
+            table[3][(word >> 32) & 0xff] ^ table[2][(word >> 40) & 0xff] ^
+            table[1][(word >> 48) & 0xff] ^ table[0][word >> 56];
+    }
+#endif
+
+    for (; len > 0; ++buf, --len)
+    {
+        crc = table[0][(crc ^ *buf) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+
+bool crc32c_sse42_supported()
+{
+    return __builtin_cpu_supports("sse4.2");
+}
+
+bool crc32c_pclmul_supported()
+{
+    return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+}
+
+namespace
+{
+    // Three independent crc32 dependency chains over adjacent blocks, merged by shifting
+    // the first two registers over the bytes that follow them.
+    __attribute__((target("sse4.2")))
+    uint64_t Crc32cInterleaved(uint64_t crc0, const unsigned char*& buf, size_t& len, size_t block, const ZerosOperator& shift)
+    {
+        while (len >= 3 * block)
+        {
+            uint64_t crc1 = 0;
+            uint64_t crc2 = 0;
+
+            for (const unsigned char* end = buf + block; buf < end; buf += 8)
+            {
+                uint64_t word0, word1, word2;
+                memcpy(&word0, buf, 8);
+                memcpy(&word1, buf + block, 8);
+                memcpy(&word2, buf + 2 * block, 8);
+
+                crc0 = _mm_crc32_u64(crc0, word0);
+                crc1 = _mm_crc32_u64(crc1, word1);
+                crc2 = _mm_crc32_u64(crc2, word2);
+            }
+
+            crc0 = shift(shift((uint32_t)crc0) ^ (uint32_t)crc1) ^ (uint32_t)crc2;
+            buf += 2 * block;
+            len -= 3 * block;
+        }
+
+        return crc0;
+    }
+}
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    static const ZerosOperator shiftLong(LONG_BLOCK);
+    static const ZerosOperator shiftShort(SHORT_BLOCK);
+
+    uint64_t crc0 = ~crc;
+
+    for (; len > 0 && ((uintptr_t)buf & 7) != 0; ++buf, --len)
+    {
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *buf);
+    }
+
+    crc0 = Crc32cInterleaved(crc0, buf, len, LONG_BLOCK, shiftLong);
+    crc0 = Crc32cInterleaved(crc0, buf, len, SHORT_BLOCK, shiftShort);
+
+    for (; len >= 8; buf += 8, len -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, buf, 8);
+        crc0 = _mm_crc32_u64(crc0, word);
+    }
+
+    for (; len > 0; ++buf, --len)
+    {
+        crc0 = _mm_crc32_u8((uint32_t)crc0, *buf);
+    }
+
+    return ~(uint32_t)crc0;
+}
+
+namespace
+{
+    // Folding constant for a 64-bit half of a 128-bit lane: x^(n-1) mod P, bit-reversed into the
+    // upper half so that the carry-less product lines up with the reflected lane layout.
+    uint64_t FoldConstant(uint64_t n)
+    {
+        return (uint64_t)XPowModP(n - 1) << 32;
+    }
+
+    // Lane holds 128 message bits, the low quadword first. Moving it `distance` bits forward
+    // multiplies the first quadword by x^(distance + 64) and the second one by x^distance.
+    __attribute__((target("sse4.2,pclmul")))
+    inline __m128i Fold(__m128i lane, __m128i constants, __m128i data)
+    {
+        const __m128i first = _mm_clmulepi64_si128(lane, constants, 0x00);
+        const __m128i second = _mm_clmulepi64_si128(lane, constants, 0x11);
+        return _mm_xor_si128(_mm_xor_si128(first, second), data);
+    }
+}
+
+namespace
+{
+    // Multiplying with a carry-less product and reducing it with the crc32 instruction adds a factor
+    // of x^33, so the powers of x are stored premultiplied by x^-33.
+    struct ScaledPowerTable
+    {
+        ScaledPowerTable()
+        {
+            // x * x^-1 == 1: x^-1 is the register that the shift-by-one step of the byte-wise loop maps to x^0
+            const uint32_t xInverse = ((1u << 31) ^ POLY) << 1 | 1;
+            uint32_t xInverse33 = 1u << 31;
+
+            for (int i = 0; i < 33; ++i)
+            {
+                xInverse33 = MultModP(xInverse33, xInverse);
+            }
+
+            const auto& table = GetPowerTable();
+
+            for (int k = 0; k < 64; ++k)
+            {
+                power[k] = MultModP(table.power[k], xInverse33);
+            }
+        }
+
+        uint32_t power[64];
+    };
+
+    __attribute__((target("sse4.2,pclmul")))
+    uint32_t ShiftPclmul(uint32_t crc, uint64_t bits)
+    {
+        static const ScaledPowerTable table;
+
+        for (int k = 0; bits != 0; bits >>= 1, ++k)
+        {
+            if (bits & 1)
+            {
+                const __m128i product = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)crc), _mm_cvtsi32_si128((int)table.power[k]), 0x00);
+                crc = (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(product));
+            }
+        }
+
+        return crc;
+    }
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t crc32c_pclmul(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    static const __m128i fold512 = _mm_set_epi64x(FoldConstant(512), FoldConstant(512 + 64));
+    static const __m128i fold128 = _mm_set_epi64x(FoldConstant(128), FoldConstant(128 + 64));
+
+    if (len < 128)
+    {
+        return crc32c_sse42(crc, buf, len);
+    }
+
+    __m128i x0 = _mm_loadu_si128((const __m128i*)buf);
+    __m128i x1 = _mm_loadu_si128((const __m128i*)(buf + 16));
+    __m128i x2 = _mm_loadu_si128((const __m128i*)(buf + 32));
+    __m128i x3 = _mm_loadu_si128((const __m128i*)(buf + 48));
+
+    // The initial register is xored into the first 32 message bits, exactly like the byte-wise loop does
+    x0 = _mm_xor_si128(x0, _mm_cvtsi32_si128((int)~crc));
+    buf += 64;
+    len -= 64;
+
+    for (; len >= 64; buf += 64, len -= 64)
+    {
+        x0 = Fold(x0, fold512, _mm_loadu_si128((const __m128i*)buf));
+        x1 = Fold(x1, fold512, _mm_loadu_si128((const __m128i*)(buf + 16)));
+        x2 = Fold(x2, fold512, _mm_loadu_si128((const __m128i*)(buf + 32)));
+        x3 = Fold(x3, fold512, _mm_loadu_si128((const __m128i*)(buf + 48)));
+    }
+
+    x0 = Fold(x0, fold128, x1);
+    x0 = Fold(x0, fold128, x2);
+    x0 = Fold(x0, fold128, x3);
+
+    for (; len >= 16; buf += 16, len -= 16)
+    {
+        x0 = Fold(x0, fold128, _mm_loadu_si128((const __m128i*)buf));
+    }
+
+    // The remaining lane is congruent to everything folded so far, so a plain crc32 over its
+    // 16 bytes starting from a zero register yields the CRC register of the processed prefix
+    uint64_t crc0 = _mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(x0));
+    crc0 = _mm_crc32_u64(crc0, (uint64_t)_mm_extract_epi64(x0, 1));
+
+    return crc32c_sse42(~(uint32_t)crc0, buf, len);
+}
+
+#else
+
+bool crc32c_sse42_supported()
+{
+    return false;
+}
+
+bool crc32c_pclmul_supported()
+{
+    return false;
+}
+
+uint32_t crc32c_sse42(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    return crc32c_sw(crc, buf, len);
+}
+
+uint32_t crc32c_pclmul(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    return crc32c_sw(crc, buf, len);
+}
+
+namespace
+{
+    uint32_t ShiftPclmul(uint32_t crc, uint64_t bits)
+    {
+        return ShiftSoftware(crc, bits);
+    }
+}
+
+#endif
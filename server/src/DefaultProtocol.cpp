@@ -1,33 +1,93 @@
 #include "DefaultProtocol.h"
 #include "Crc.h"
+#include "FileSink.h"
+#include "MemoryStore.h"
+#include "Logger.h"
+#include <algorithm>
 #include <cstring>
-#include <iostream>
+#include <new>
 
-DefaultProtocol::DefaultProtocol()
-    : m_lastUpdateTime(std::chrono::steady_clock::now())
+namespace
 {
-}
-
-std::vector<char> DefaultProtocol::Process(const std::vector<char>& buffer)
-{
-    static constexpr unsigned char ACK = 0;
-    static constexpr unsigned char PUT = 1;
-    static constexpr size_t ID_SIZE = 8;
-    static constexpr size_t HEADER_SIZE =
+    constexpr unsigned char ACK = 0;
+    constexpr unsigned char PUT = 1;
+    constexpr size_t ID_SIZE = 8;
+    constexpr size_t HEADER_SIZE =
         sizeof(unsigned) +      // seq_number
         sizeof(unsigned) +      // seq_total
         sizeof(unsigned char) + // type
         ID_SIZE * sizeof(char); // id
+    constexpr size_t MAX_PACKAGE_SIZE = 1472;
+    constexpr size_t MAX_DATA_SIZE = MAX_PACKAGE_SIZE - HEADER_SIZE;
 
-    std::vector<char> response;
+    // Clients that understand selective ACKs set the flag on the type of their PUTs. A SACK carries
+    // the cumulative point as seq_number, then the first package of a bitmap window and the window.
+    constexpr unsigned char SACK = 2;
+    constexpr unsigned char SACK_FLAG = 0x80;
+    constexpr unsigned SACK_WORDS = 5;
+    constexpr size_t SACK_SIZE = HEADER_SIZE + sizeof(unsigned) + SACK_WORDS * sizeof(uint64_t);
+    // Packages of a file remembered between SACKs, the window may not cover them
+    constexpr size_t MAX_UNREPORTED = 64;
 
-    if (buffer.size() > HEADER_SIZE)
+    // The first package of the SACK window, which ends with the word of the highest package
+    // since packages in flight are right below it
+    unsigned GetSackBase(unsigned nextSeq, unsigned highestSeq)
     {
-        Package package;
+        const unsigned highestWord = highestSeq / 64;
+
+        return std::max(nextSeq / 64, highestWord + 1 > SACK_WORDS ? highestWord + 1 - SACK_WORDS : 0) * 64;
+    }
+
+    // The id as the sink and the log see it; 8 bytes fit into the small string buffer
+    std::string FileIdToString(uint64_t fileId)
+    {
+        return std::string(reinterpret_cast<const char*>(&fileId), ID_SIZE);
+    }
+
+    MemoryStore defaultStore;
+}
 
-        const char* ptr = buffer.data();
+DefaultProtocol::DefaultProtocol(IDataSink* sink, FileTimers* timers, const Endpoint& endpoint, IFileStore* store, FileBudget* budget,
+    ProtocolMetrics* metrics, const AckPolicy& ackPolicy)
+    : m_sink(sink)
+    , m_timers(timers)
+    , m_endpoint(endpoint)
+    , m_store(store ? store : &defaultStore)
+    , m_budget(budget)
+    , m_metrics(metrics)
+    , m_ackPolicy(ackPolicy)
+    , m_charged(0)
+    , m_pendingFlushed(0)
+    , m_heldFlushed(0)
+{
+}
 
-        memcpy(&package.seq_number, ptr, sizeof(unsigned));
+DefaultProtocol::~DefaultProtocol()
+{
+    m_files.ForEach([this](uint64_t, File& file)
+    {
+        Release(file);
+
+        if (m_sink)
+        {
+            m_sink->OnAbort(file.name);
+        }
+    });
+}
+
+void DefaultProtocol::Process(const char* buffer, size_t size, Response& response)
+{
+    static_assert(HEADER_SIZE + sizeof(unsigned) <= Response::MAX_SIZE, "ACK must fit into Response");
+    static_assert(SACK_SIZE <= Response::MAX_SIZE, "SACK must fit into Response");
+
+    response.size = 0;
+
+    if (size > HEADER_SIZE && size <= MAX_PACKAGE_SIZE)
+    {
+        const char* ptr = buffer;
+
+        unsigned seqNumber;
+        memcpy(&seqNumber, ptr, sizeof(unsigned));
         ptr += sizeof(unsigned);
 
         unsigned seq_total;
@@ -38,77 +98,591 @@ std::vector<char> DefaultProtocol::Process(const std::vector<char>& buffer)
         memcpy(&type, ptr, sizeof(unsigned char));
         ptr += sizeof(unsigned char);
 
-        if (type == PUT)
+        if ((type & ~SACK_FLAG) == PUT)
         {
-            char id[ID_SIZE];
-            memcpy(id, ptr, ID_SIZE);
+            uint64_t fileId;
+            memcpy(&fileId, ptr, ID_SIZE);
             ptr += ID_SIZE;
 
-            const size_t dataSize = buffer.size() - HEADER_SIZE;
+            File* filePtr = m_files.Find(fileId);
+
+            if (!filePtr)
+            {
+                if (seqNumber >= seq_total)
+                {
+                    return;
+                }
+
+                // Admission control: nothing is allocated for a file the budget can't take. In memory the
+                // whole file is checked against the quota, one refused midway would never complete, and it
+                // reserves all of its slots unless stop-acks charges them package by package
+                const uint64_t overhead = File::GetOverhead(seq_total);
+                const uint64_t maxSize = m_store->IsInMemory() ? (uint64_t)seq_total * MAX_DATA_SIZE : 0;
+                const bool isCharged = m_budget && m_budget->policy == BudgetPolicy::StopAcks;
+                const uint64_t reserved = isCharged ? overhead : overhead + maxSize;
+
+                if (m_budget && m_budget->fileQuota != 0 && overhead + maxSize > m_budget->fileQuota)
+                {
+                    m_budget->filesRefused.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                if (!Reserve(reserved, fileId))
+                {
+                    m_budget->filesRefused.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+
+                File newFile;
+
+                if (!newFile.Init(seq_total))
+                {
+                    LOG_ERROR("Can't allocate {} packages, id: {}", seq_total, FileIdToString(fileId));
+                    Unreserve(reserved);
+                    return;
+                }
+
+                newFile.name = GetOutputFileName(m_endpoint, FileIdToString(fileId));
+                newFile.data = m_store->Open(newFile.name, seq_total, MAX_DATA_SIZE);
+
+                if (!newFile.data)
+                {
+                    LOG_ERROR("Can't store {} packages, id: {}", seq_total, FileIdToString(fileId));
+                    Unreserve(reserved);
+                    return;
+                }
+
+                newFile.charged = reserved;
+                newFile.isSack = (type & SACK_FLAG) != 0;
+
+                if (m_metrics)
+                {
+                    newFile.startTime = GetMonotonicNanoseconds();
+                }
+
+                if (m_budget)
+                {
+                    newFile.admission = ++m_budget->nextAdmission;
+                    m_budget->files.emplace(newFile.admission, FileBudget::AdmittedFile{ m_endpoint, fileId });
+                }
+
+                if (m_timers)
+                {
+                    newFile.serial = ++m_timers->nextSerial;
+                    m_timers->wheel.Schedule(m_timers->wheel.GetNow() + m_timers->idleTimeout, FileTimer{ m_endpoint, fileId, newFile.serial });
+                }
+
+                filePtr = m_files.Insert(fileId).first;
+                *filePtr = std::move(newFile);
+            }
+
+            if (seqNumber >= filePtr->seqTotal)
+            {
+                return;
+            }
+
+            bool isNew = false;
+
+            if (!filePtr->IsReceived(seqNumber))
+            {
+                const size_t dataSize = size - HEADER_SIZE;
+                const bool isCharged = m_budget && m_budget->policy == BudgetPolicy::StopAcks;
+                const uint64_t charge = isCharged && m_store->IsInMemory() ? dataSize : 0;
+
+                // Refused packages are not acknowledged, so the client sends them again later
+                if (charge > 0)
+                {
+                    if (!Reserve(charge, fileId))
+                    {
+                        m_budget->packagesRefused.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                    }
+
+                    // Evictions may have moved the file within m_files
+                    filePtr = m_files.Find(fileId);
+                }
+
+                if (!filePtr->data->Write(seqNumber, ptr, dataSize))
+                {
+                    LOG_ERROR("Can't store seq_number: {}, id: {}", seqNumber, FileIdToString(fileId));
+                    Unreserve(charge);
+                    return;
+                }
+
+                auto& file = *filePtr;
 
-            package.data.resize(dataSize);
-            memcpy(package.data.data(), ptr, dataSize);
+                file.charged += charge;
+                file.sizes[seqNumber] = (uint16_t)dataSize;
+                if (m_metrics && --m_metrics->checksumCountdown == 0)
+                {
+                    const uint64_t start = GetMonotonicNanoseconds();
+                    file.checksums[seqNumber] = crc32c(0, (const unsigned char*)ptr, dataSize);
+
+                    m_metrics->checksumNanoseconds.Add(GetMonotonicNanoseconds() - start);
+                    m_metrics->checksumSamples.Add();
+                    m_metrics->checksumCountdown = ProtocolMetrics::CHECKSUM_SAMPLING;
+                }
+                else
+                {
+                    file.checksums[seqNumber] = crc32c(0, (const unsigned char*)ptr, dataSize);
+                }
+
+                file.SetReceived(seqNumber);
+                file.highestSeq = std::max(file.highestSeq, seqNumber);
+                isNew = true;
+
+                if (m_metrics)
+                {
+                    m_metrics->packagesStored.Add();
+                }
 
-            const std::string fileId(id, ID_SIZE);
+                if (seqNumber == file.nextSeq)
+                {
+                    Advance(file);
+                }
+            }
+            else if (m_metrics)
+            {
+                m_metrics->duplicates.Add();
+            }
 
-            auto& currentPackages = m_packages[fileId];
-            currentPackages.insert(package);
+            auto& file = *filePtr;
 
-            std::cout << "Received: id: " << fileId << ", seq_number: " << package.seq_number << std::endl;
+            // The clock only moves once per batch, touching a file is a plain store
+            if (m_timers)
+            {
+                file.lastActivity = m_timers->wheel.GetNow();
+            }
+
+            LOG_DEBUG("Received: id: {}, seq_number: {}", FileIdToString(fileId), seqNumber);
 
             /**** Creating response ****/
 
-            const unsigned packagesCount = currentPackages.size();
-            const bool isLastPackage = packagesCount == seq_total;
-            response.resize(isLastPackage ? HEADER_SIZE + sizeof(unsigned) : HEADER_SIZE);
+            const unsigned packagesCount = file.received;
+            const bool isLastPackage = packagesCount == file.seqTotal;
 
-            char* ptr = response.data();
+            // A SACK goes out at once after AckPolicy::every new packages, otherwise the file waits for the
+            // flush; duplicates are acknowledged then as well, the previous SACK may have been lost
+            if (file.isSack && !isLastPackage)
+            {
+                // New packages above the cumulative point may drop out of the window before the SACK goes out;
+                // a duplicate the SACK covers or that is already remembered needs nothing more
+                const bool isCovered = isNew ? seqNumber < file.nextSeq : file.IsInSack(seqNumber) ||
+                    std::find(file.unreported.begin(), file.unreported.end(), seqNumber) != file.unreported.end();
 
-            memcpy(ptr, &package.seq_number, sizeof(unsigned));
-            ptr += sizeof(unsigned);
+                if (!isCovered)
+                {
+                    file.unreported.push_back(seqNumber);
+                }
 
-            memcpy(ptr, &packagesCount, sizeof(unsigned));
-            ptr += sizeof(unsigned);
+                const bool isDue = isNew && ++file.unacked >= m_ackPolicy.every;
 
-            memcpy(ptr, &ACK, sizeof(unsigned char));
-            ptr += sizeof(unsigned char);
+                // A full list is flushed at once, so that no package goes unacknowledged
+                if (isDue || file.unreported.size() >= MAX_UNREPORTED)
+                {
+                    WriteSack(fileId, file, response);
+                }
+                else if (!file.isAckPending)
+                {
+                    file.isAckPending = true;
+                    m_pendingAcks.push_back(fileId);
+                }
 
-            memcpy(ptr, id, ID_SIZE);
-            ptr += ID_SIZE;
+                return;
+            }
+
+            WriteAck(fileId, seqNumber, packagesCount, response);
 
             if (isLastPackage)
             {
-                unsigned checksum = 0;
+                // All packages are received, so the contiguous prefix covers the whole file
+                const unsigned checksum = file.checksum;
 
-                for (const auto& package : currentPackages)
+                LOG_INFO("CRC: {}, id: {}", checksum, FileIdToString(fileId));
+
+                if (!file.data->Complete(file.sizes.get()))
+                {
+                    LOG_ERROR("Can't complete stored file, id: {}", FileIdToString(fileId));
+                }
+
+                if (m_sink)
                 {
-                    checksum = crc32c(checksum, (const unsigned char*)package.data.data(), package.data.size());
+                    m_sink->OnComplete(file.name, checksum);
                 }
 
-                std::cout << "CRC: " << checksum << ", id: " << fileId << std::endl;
+                if (m_metrics)
+                {
+                    m_metrics->filesCompleted.Add();
+                    m_metrics->fileCompletion.Record(GetMonotonicNanoseconds() - file.startTime);
+                }
 
-                m_packages.erase(fileId);
-                memcpy(ptr, &checksum, sizeof(unsigned));
+                Release(file);
+                m_files.Erase(fileId);
+                memcpy(response.data + HEADER_SIZE, &checksum, sizeof(unsigned));
+                response.size += sizeof(unsigned);
+            }
+            else if (m_ackPolicy.every > 1)
+            {
+                // Goes out together with the others of this peer
+                m_heldAcks.push_back(response);
+                response.size = 0;
             }
         }
     }
+}
 
-    m_lastUpdateTime = std::chrono::steady_clock::now();
+void DefaultProtocol::Advance(File& file)
+{
+    char scratch[MAX_DATA_SIZE];
 
-    return response;
+    for (; file.nextSeq < file.seqTotal && file.IsReceived(file.nextSeq); ++file.nextSeq)
+    {
+        const size_t size = file.sizes[file.nextSeq];
+        file.checksum = crc32c_combine(file.checksum, file.checksums[file.nextSeq], size);
+
+        if (m_sink)
+        {
+            const char* data = file.data->Read(file.nextSeq, size, scratch);
+
+            if (data)
+            {
+                m_sink->OnData(file.name, data, size);
+            }
+        }
+    }
 }
 
 bool DefaultProtocol::IsEmpty()
 {
-    return m_packages.empty();
+    // Held ACKs of completed files still have to go out, duplicates included
+    return m_files.IsEmpty() && !HasPendingAcks();
+}
+
+bool DefaultProtocol::HasPendingAcks()
+{
+    return !m_heldAcks.empty() || !m_pendingAcks.empty();
 }
 
-bool DefaultProtocol::IsExpired()
+bool DefaultProtocol::IsAckDue()
 {
-    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - m_lastUpdateTime).count() > 10;
+    // Files with SACKs count their packages themselves and send at once
+    return m_heldAcks.size() - m_heldFlushed >= m_ackPolicy.every;
+}
+
+bool DefaultProtocol::FlushAck(Response& response)
+{
+    // Out of window ACKs a SACK adds are sent after it, by the next calls
+    if (m_heldFlushed < m_heldAcks.size())
+    {
+        response = m_heldAcks[m_heldFlushed++];
+        return true;
+    }
+
+    m_heldAcks.clear();
+    m_heldFlushed = 0;
+
+    while (m_pendingFlushed < m_pendingAcks.size())
+    {
+        const uint64_t fileId = m_pendingAcks[m_pendingFlushed++];
+
+        // Completed and dropped files leave their entries behind
+        File* file = m_files.Find(fileId);
+
+        if (file && file->isAckPending)
+        {
+            WriteSack(fileId, *file, response);
+            return true;
+        }
+    }
+
+    m_pendingAcks.clear();
+    m_pendingFlushed = 0;
+
+    return false;
 }
 
-bool DefaultProtocol::Package::operator<(const DefaultProtocol::Package& other) const
+void DefaultProtocol::WriteAck(uint64_t fileId, unsigned seqNumber, unsigned packagesCount, Response& response)
 {
-    return seq_number < other.seq_number;
+    char* ptr = response.data;
+
+    memcpy(ptr, &seqNumber, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+
+    memcpy(ptr, &packagesCount, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+
+    memcpy(ptr, &ACK, sizeof(unsigned char));
+    ptr += sizeof(unsigned char);
+
+    memcpy(ptr, &fileId, ID_SIZE);
+
+    response.size = HEADER_SIZE;
+
+    if (m_metrics)
+    {
+        m_metrics->acks.Add();
+    }
+}
+
+void DefaultProtocol::WriteSack(uint64_t fileId, File& file, Response& response)
+{
+    const unsigned words = (file.seqTotal + 63) / 64;
+    const unsigned base = GetSackBase(file.nextSeq, file.highestSeq);
+    const unsigned firstWord = base / 64;
+
+    // Packages the window misses, the client sent them out of order, are acknowledged one by one
+    for (unsigned seqNumber : file.unreported)
+    {
+        if (!file.IsInSack(seqNumber))
+        {
+            Response ack;
+            WriteAck(fileId, seqNumber, file.received, ack);
+            m_heldAcks.push_back(ack);
+        }
+    }
+
+    file.unreported.clear();
+
+    char* ptr = response.data;
+
+    memcpy(ptr, &file.nextSeq, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+
+    memcpy(ptr, &file.received, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+
+    memcpy(ptr, &SACK, sizeof(unsigned char));
+    ptr += sizeof(unsigned char);
+
+    memcpy(ptr, &fileId, ID_SIZE);
+    ptr += ID_SIZE;
+
+    memcpy(ptr, &base, sizeof(unsigned));
+    ptr += sizeof(unsigned);
+
+    for (unsigned i = firstWord; i < firstWord + SACK_WORDS; ++i)
+    {
+        const uint64_t word = i < words ? file.receivedMask[i] : 0;
+        memcpy(ptr, &word, sizeof(uint64_t));
+        ptr += sizeof(uint64_t);
+    }
+
+    response.size = SACK_SIZE;
+    file.unacked = 0;
+    file.isAckPending = false;
+
+    if (m_metrics)
+    {
+        m_metrics->sacks.Add();
+    }
+
+    LOG_DEBUG("SACK: id: {}, cumulative: {}, base: {}", FileIdToString(fileId), file.nextSeq, base);
+}
+
+bool DefaultProtocol::OnTimer(const FileTimer& timer)
+{
+    File* file = m_files.Find(timer.fileId);
+
+    // The file completed, possibly followed by a new one with the same id and its own timer
+    if (!file || file->serial != timer.serial)
+    {
+        return false;
+    }
+
+    const uint64_t deadline = file->lastActivity + m_timers->idleTimeout;
+
+    if (deadline > m_timers->wheel.GetNow())
+    {
+        m_timers->wheel.Schedule(deadline, timer);
+        return false;
+    }
+
+    LOG_INFO("Expired: id: {}, received: {}/{}", FileIdToString(timer.fileId), file->received, file->seqTotal);
+
+    Drop(timer.fileId, *file);
+    return true;
+}
+
+void DefaultProtocol::Evict(uint64_t fileId)
+{
+    File* file = m_files.Find(fileId);
+
+    if (file)
+    {
+        LOG_WARNING("Evicted: id: {}, received: {}/{}", FileIdToString(fileId), file->received, file->seqTotal);
+
+        Drop(fileId, *file);
+    }
+}
+
+bool DefaultProtocol::Reserve(uint64_t bytes, uint64_t currentFileId)
+{
+    if (!m_budget)
+    {
+        return true;
+    }
+
+    const BudgetPolicy policy = m_budget->policy;
+
+    // Without the shared budget the quota only covers this worker
+    while (!m_budget->global && m_budget->peerQuota != 0 && m_charged + bytes > m_budget->peerQuota)
+    {
+        if (policy != BudgetPolicy::EvictOldest || !EvictOwnOldest(currentFileId))
+        {
+            return false;
+        }
+    }
+
+    while (m_budget->global)
+    {
+        const MemoryBudget::Result result = m_budget->global->TryCharge(m_endpoint, bytes, m_budget->peerQuota);
+
+        if (result == MemoryBudget::Result::Charged)
+        {
+            break;
+        }
+
+        if (policy != BudgetPolicy::EvictOldest)
+        {
+            return false;
+        }
+
+        // The peer's files on other workers stay, only the limit is worth asking them for
+        if (result == MemoryBudget::Result::OverQuota ? !EvictOwnOldest(currentFileId) : !EvictWorkerOldest(currentFileId))
+        {
+            if (result == MemoryBudget::Result::OverLimit)
+            {
+                m_budget->global->RequestEviction(bytes);
+            }
+
+            return false;
+        }
+    }
+
+    m_charged += bytes;
+    return true;
+}
+
+void DefaultProtocol::Unreserve(uint64_t bytes)
+{
+    if (m_budget)
+    {
+        m_charged -= bytes;
+
+        if (m_budget->global)
+        {
+            m_budget->global->Release(m_endpoint, bytes);
+        }
+    }
+}
+
+bool DefaultProtocol::EvictOwnOldest(uint64_t currentFileId)
+{
+    uint64_t oldestId = 0;
+    uint64_t oldestAdmission = UINT64_MAX;
+
+    m_files.ForEach([&](uint64_t fileId, File& file)
+    {
+        if (fileId != currentFileId && file.admission < oldestAdmission)
+        {
+            oldestId = fileId;
+            oldestAdmission = file.admission;
+        }
+    });
+
+    if (oldestAdmission == UINT64_MAX)
+    {
+        return false;
+    }
+
+    Evict(oldestId);
+    m_budget->filesEvicted.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool DefaultProtocol::EvictWorkerOldest(uint64_t currentFileId)
+{
+    for (const auto& entry : m_budget->files)
+    {
+        // Copied, the eviction erases the entry
+        const FileBudget::AdmittedFile file = entry.second;
+
+        if (file.endpoint == m_endpoint)
+        {
+            if (file.fileId == currentFileId)
+            {
+                continue;
+            }
+
+            Evict(file.fileId);
+        }
+        else if (m_budget->evict)
+        {
+            m_budget->evict(file);
+        }
+        else
+        {
+            continue;
+        }
+
+        m_budget->filesEvicted.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void DefaultProtocol::Release(File& file)
+{
+    if (m_budget)
+    {
+        Unreserve(file.charged);
+        m_budget->files.erase(file.admission);
+    }
+}
+
+void DefaultProtocol::Drop(uint64_t fileId, File& file)
+{
+    Release(file);
+
+    if (m_sink)
+    {
+        m_sink->OnAbort(file.name);
+    }
+
+    m_files.Erase(fileId);
+}
+
+bool DefaultProtocol::File::Init(unsigned seqTotal)
+{
+    this->seqTotal = seqTotal;
+
+    sizes.reset(new (std::nothrow) uint16_t[seqTotal]);
+    checksums.reset(new (std::nothrow) uint32_t[seqTotal]);
+    receivedMask.reset(new (std::nothrow) uint64_t[(seqTotal + 63) / 64]());
+
+    return sizes && checksums && receivedMask;
+}
+
+uint64_t DefaultProtocol::File::GetOverhead(unsigned seqTotal)
+{
+    return sizeof(File) + (uint64_t)seqTotal * (sizeof(uint16_t) + sizeof(uint32_t)) + (seqTotal + 63) / 64 * sizeof(uint64_t);
+}
+
+bool DefaultProtocol::File::IsReceived(unsigned seqNumber) const
+{
+    return (receivedMask[seqNumber / 64] >> (seqNumber % 64)) & 1;
+}
+
+void DefaultProtocol::File::SetReceived(unsigned seqNumber)
+{
+    receivedMask[seqNumber / 64] |= (uint64_t)1 << (seqNumber % 64);
+    ++received;
+}
+
+bool DefaultProtocol::File::IsInSack(unsigned seqNumber) const
+{
+    const unsigned base = GetSackBase(nextSeq, highestSeq);
+
+    return seqNumber < nextSeq || (seqNumber >= base && seqNumber - base < SACK_WORDS * 64);
 }
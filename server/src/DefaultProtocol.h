@@ -1,31 +1,104 @@
 #pragma once
 
 #include "IProtocol.h"
+#include "IDataSink.h"
+#include "IFileStore.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "FlatHashMap.h"
 
-#include <map>
-#include <set>
+#include <memory>
 #include <vector>
 #include <string>
-#include <chrono>
 
 class DefaultProtocol : public IProtocol
 {
 public:
-    DefaultProtocol();
+    // Without timers files never expire, without a store files are reassembled in memory,
+    // without a budget memory is unlimited
+    explicit DefaultProtocol(IDataSink* sink = nullptr, FileTimers* timers = nullptr, const Endpoint& endpoint = Endpoint(),
+        IFileStore* store = nullptr, FileBudget* budget = nullptr, ProtocolMetrics* metrics = nullptr,
+        const AckPolicy& ackPolicy = AckPolicy());
+    ~DefaultProtocol();
     
-    virtual std::vector<char> Process(const std::vector<char>& data) override;
+    void Process(const char* data, size_t size, Response& response) override;
     bool IsEmpty() override;
-    bool IsExpired() override;
+    bool HasPendingAcks() override;
+    bool IsAckDue() override;
+    bool FlushAck(Response& response) override;
+    bool OnTimer(const FileTimer& timer) override;
+    void Evict(uint64_t fileId) override;
 
 private:
-    struct Package
+    // Reassembly state of one file, allocated once from seq_total of its first package.
+    // Package i is stored in slot i of the stored file, so inserts are O(1) and idempotent;
+    // the per-package overhead is one bit, a 2 byte size and a 4 byte checksum.
+    struct File
     {
-        unsigned seq_number;
-        std::vector<char> data;
+        bool Init(unsigned seqTotal);
+        bool IsReceived(unsigned seqNumber) const;
+        void SetReceived(unsigned seqNumber);
+        // Whether the next SACK covers the package, by the cumulative point or by its window
+        bool IsInSack(unsigned seqNumber) const;
+        // Memory of the bookkeeping, charged when the file is admitted
+        static uint64_t GetOverhead(unsigned seqTotal);
 
-        bool operator<(const Package& other) const;
+        unsigned seqTotal = 0;
+        unsigned received = 0;
+        unsigned nextSeq = 0;                  // packages [0, nextSeq) are already merged into checksum
+        uint32_t checksum = 0;
+        uint64_t serial = 0;
+        uint64_t lastActivity = 0;             // FileTimers tick of the last package
+        uint64_t admission = 0;                // key in FileBudget::files
+        uint64_t charged = 0;                  // bytes charged to the budget
+        uint64_t startTime = 0;                // monotonic nanoseconds of the first package, with metrics only
+        bool isSack = false;                   // the client asked for selective ACKs
+        bool isAckPending = false;             // in m_pendingAcks, a SACK goes out after the batch
+        unsigned unacked = 0;                  // new packages since the last SACK
+        unsigned highestSeq = 0;               // highest package received
+        std::vector<unsigned> unreported;      // packages received since the last SACK, a SACK flushes it when full
+        std::string name;                      // for the store and the sink, unique per peer and id
+        std::unique_ptr<IStoredFile> data;     // seqTotal slots of the maximum data size
+        std::unique_ptr<uint16_t[]> sizes;
+        std::unique_ptr<uint32_t[]> checksums; // crc32c of every package alone, computed on arrival
+        std::unique_ptr<uint64_t[]> receivedMask;
     };
 
-    std::map<std::string/*fileId*/, std::set<Package>> m_packages;
-    std::chrono::time_point<std::chrono::steady_clock> m_lastUpdateTime;
+    // Merges the per-package checksums that continue the contiguous prefix into the file checksum
+    // with crc32c_combine and hands their data to the sink
+    void Advance(File& file);
+
+    // Charges bytes to the peer quota and the global budget, evicting files when the policy allows it.
+    // Never evicts currentFileId; other files may be erased, so pointers into m_files are stale afterwards.
+    bool Reserve(uint64_t bytes, uint64_t currentFileId);
+    void Unreserve(uint64_t bytes);
+    bool EvictOwnOldest(uint64_t currentFileId);
+    bool EvictWorkerOldest(uint64_t currentFileId);
+
+    void WriteAck(uint64_t fileId, unsigned seqNumber, unsigned packagesCount, Response& response);
+    // Writes the cumulative point and the bitmap window around the latest packages; the packages
+    // received since the last SACK that fall outside of it get ACKs of their own
+    void WriteSack(uint64_t fileId, File& file, Response& response);
+
+    // Returns everything the file holds to the budget
+    void Release(File& file);
+    // Aborts a partial file
+    void Drop(uint64_t fileId, File& file);
+
+private:
+    IDataSink* m_sink;
+    FileTimers* m_timers;
+    Endpoint m_endpoint;
+    IFileStore* m_store;
+    FileBudget* m_budget;
+    ProtocolMetrics* m_metrics;
+    AckPolicy m_ackPolicy;
+    uint64_t m_charged;                        // bytes of this peer's files on this worker
+    // Keyed by the 8 id bytes of the header loaded as one integer
+    FlatHashMap<uint64_t, File, UInt64Hash> m_files;
+    // Both are flushed in arrival order, a client must not mistake the flush for reordering
+    std::vector<uint64_t> m_pendingAcks;       // files with isAckPending, possibly completed or dropped since
+    std::vector<Response> m_heldAcks;          // classic ACKs held back by the policy
+    size_t m_pendingFlushed;                   // entries of m_pendingAcks handled by the current flush
+    size_t m_heldFlushed;                      // entries of m_heldAcks sent by the current flush
 };
@@ -0,0 +1,510 @@
+#include "DiskStore.h"
+#include "FlatHashMap.h"
+#include "Logger.h"
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+    // Slots moved per pread/pwrite pair while compacting
+    constexpr size_t COMPACT_SLOTS = 1024;
+    // Slots per O_DIRECT chunk; 4096 slots of any size are a multiple of the 4 KiB alignment
+    constexpr size_t CHUNK_SLOTS = 4096;
+    constexpr size_t DIRECT_ALIGNMENT = 4096;
+    // Chunks buffered per file and over all files; beyond them packages go straight to the file
+    constexpr size_t MAX_FILE_CHUNKS = 4;
+    constexpr size_t MAX_OPEN_CHUNKS = 32;
+
+    bool WriteAll(int fd, const char* data, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            const ssize_t written = ::pwrite(fd, data, size, offset);
+
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (written <= 0)
+            {
+                return false;
+            }
+
+            data += written;
+            size -= written;
+            offset += written;
+        }
+
+        return true;
+    }
+
+    bool ReadAll(int fd, char* data, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            const ssize_t read = ::pread(fd, data, size, offset);
+
+            if (read < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (read <= 0)
+            {
+                return false;
+            }
+
+            data += read;
+            size -= read;
+            offset += read;
+        }
+
+        return true;
+    }
+
+    // Common part: the .part file, its removal when incomplete and the final compaction through fd
+    class DiskFile : public IStoredFile
+    {
+    public:
+        DiskFile(const std::string& path, int fd, unsigned seqTotal, size_t slotSize)
+            : m_path(path)
+            , m_fd(fd)
+            , m_seqTotal(seqTotal)
+            , m_slotSize(slotSize)
+            , m_isCompleted(false)
+        {
+        }
+
+        ~DiskFile() override
+        {
+            ::close(m_fd);
+
+            if (!m_isCompleted)
+            {
+                ::unlink(GetPartPath().c_str());
+            }
+        }
+
+        bool Write(unsigned seqNumber, const char* data, size_t size) override
+        {
+            return WriteAll(m_fd, data, size, GetOffset(seqNumber));
+        }
+
+        const char* Read(unsigned seqNumber, size_t size, char* scratch) override
+        {
+            return ReadAll(m_fd, scratch, size, GetOffset(seqNumber)) ? scratch : nullptr;
+        }
+
+        bool Complete(const uint16_t* sizes) override
+        {
+            return Compact(sizes) && Publish();
+        }
+
+    protected:
+        std::string GetPartPath() const
+        {
+            return m_path + ".part";
+        }
+
+        uint64_t GetOffset(unsigned seqNumber) const
+        {
+            return (uint64_t)seqNumber * m_slotSize;
+        }
+
+        // Packages only move towards the start, so compacting block by block in ascending order
+        // never overwrites a slot that is still to be read
+        bool Compact(const uint16_t* sizes)
+        {
+            std::vector<char> buffer;
+            uint64_t offset = 0;
+
+            for (unsigned first = 0; first < m_seqTotal; first += COMPACT_SLOTS)
+            {
+                const unsigned last = (unsigned)std::min<uint64_t>(m_seqTotal, (uint64_t)first + COMPACT_SLOTS);
+                bool isInPlace = offset == GetOffset(first);
+
+                for (unsigned i = first; i < last && isInPlace; ++i)
+                {
+                    isInPlace = sizes[i] == m_slotSize || i + 1 == m_seqTotal;
+                }
+
+                if (isInPlace)
+                {
+                    offset = GetOffset(last - 1) + sizes[last - 1];
+                    continue;
+                }
+
+                buffer.resize((last - first) * m_slotSize);
+
+                if (!ReadAll(m_fd, buffer.data(), buffer.size(), GetOffset(first)))
+                {
+                    return false;
+                }
+
+                size_t compacted = 0;
+
+                for (unsigned i = first; i < last; ++i)
+                {
+                    memmove(buffer.data() + compacted, buffer.data() + (size_t)(i - first) * m_slotSize, sizes[i]);
+                    compacted += sizes[i];
+                }
+
+                if (!WriteAll(m_fd, buffer.data(), compacted, offset))
+                {
+                    return false;
+                }
+
+                offset += compacted;
+            }
+
+            return ::ftruncate(m_fd, offset) == 0;
+        }
+
+        bool Publish()
+        {
+            if (::rename(GetPartPath().c_str(), m_path.c_str()) != 0)
+            {
+                return false;
+            }
+
+            m_isCompleted = true;
+            return true;
+        }
+
+    protected:
+        std::string m_path;
+        int m_fd;
+        unsigned m_seqTotal;
+        size_t m_slotSize;
+        bool m_isCompleted;
+    };
+
+    class MappedFile : public DiskFile
+    {
+    public:
+        MappedFile(const std::string& path, int fd, unsigned seqTotal, size_t slotSize, char* mapping)
+            : DiskFile(path, fd, seqTotal, slotSize)
+            , m_mapping(mapping)
+        {
+        }
+
+        ~MappedFile() override
+        {
+            Unmap();
+        }
+
+        bool Write(unsigned seqNumber, const char* data, size_t size) override
+        {
+            memcpy(m_mapping + GetOffset(seqNumber), data, size);
+            return true;
+        }
+
+        const char* Read(unsigned seqNumber, size_t, char*) override
+        {
+            return m_mapping + GetOffset(seqNumber);
+        }
+
+        bool Complete(const uint16_t* sizes) override
+        {
+            uint64_t offset = 0;
+
+            for (unsigned i = 0; i < m_seqTotal; ++i)
+            {
+                if (offset != GetOffset(i))
+                {
+                    memmove(m_mapping + offset, m_mapping + GetOffset(i), sizes[i]);
+                }
+
+                offset += sizes[i];
+            }
+
+            Unmap();
+            return ::ftruncate(m_fd, offset) == 0 && Publish();
+        }
+
+    private:
+        void Unmap()
+        {
+            if (m_mapping)
+            {
+                ::munmap(m_mapping, GetOffset(m_seqTotal));
+                m_mapping = nullptr;
+            }
+        }
+
+    private:
+        char* m_mapping;
+    };
+
+    // Packages shuffled over a large file leave most chunks partly filled, so their number is capped per
+    // file and per store, and their memory is charged to the budget. A chunk that doesn't fit is spilled:
+    // written as it is and completed by pwrite per package, which overwrites the slots still missing.
+    class DirectFile : public DiskFile
+    {
+    public:
+        DirectFile(const std::string& path, int fd, int directFd, unsigned seqTotal, size_t slotSize,
+            std::atomic<size_t>& openChunks, MemoryBudget* budget)
+            : DiskFile(path, fd, seqTotal, slotSize)
+            , m_directFd(directFd)
+            , m_openChunks(openChunks)
+            , m_budget(budget)
+            , m_isSpilled((seqTotal + CHUNK_SLOTS - 1) / CHUNK_SLOTS, false)
+        {
+        }
+
+        ~DirectFile() override
+        {
+            m_chunks.ForEach([this](uint64_t, Chunk&) { ReleaseChunk(); });
+
+            if (m_directFd != m_fd)
+            {
+                ::close(m_directFd);
+            }
+        }
+
+        bool Write(unsigned seqNumber, const char* data, size_t size) override
+        {
+            const uint64_t chunkIndex = seqNumber / CHUNK_SLOTS;
+            Chunk* chunk = m_chunks.Find(chunkIndex);
+
+            if (!chunk && !m_isSpilled[chunkIndex])
+            {
+                chunk = OpenChunk(chunkIndex);
+            }
+
+            if (!chunk)
+            {
+                return DiskFile::Write(seqNumber, data, size);
+            }
+
+            memcpy(chunk->data.get() + (size_t)(seqNumber % CHUNK_SLOTS) * m_slotSize, data, size);
+
+            return ++chunk->received < GetChunkSlots(chunkIndex) || Flush(chunkIndex);
+        }
+
+        const char* Read(unsigned seqNumber, size_t size, char* scratch) override
+        {
+            const Chunk* chunk = m_chunks.Find(seqNumber / CHUNK_SLOTS);
+
+            if (chunk)
+            {
+                return chunk->data.get() + (size_t)(seqNumber % CHUNK_SLOTS) * m_slotSize;
+            }
+
+            return DiskFile::Read(seqNumber, size, scratch);
+        }
+
+        bool Complete(const uint16_t* sizes) override
+        {
+            // Every chunk is flushed by its last package, except for failed writes
+            return m_chunks.IsEmpty() && DiskFile::Complete(sizes);
+        }
+
+    private:
+        struct Chunk
+        {
+            struct Free
+            {
+                void operator()(char* data) const { free(data); }
+            };
+
+            std::unique_ptr<char, Free> data;
+            size_t received = 0;
+        };
+
+        size_t GetChunkCapacity() const
+        {
+            return CHUNK_SLOTS * m_slotSize;
+        }
+
+        size_t GetChunkSlots(uint64_t chunkIndex) const
+        {
+            return std::min<uint64_t>(CHUNK_SLOTS, m_seqTotal - chunkIndex * CHUNK_SLOTS);
+        }
+
+        // Returns nullptr when the chunk is spilled instead
+        Chunk* OpenChunk(uint64_t chunkIndex)
+        {
+            if (m_chunks.GetSize() >= MAX_FILE_CHUNKS && !SpillFullest())
+            {
+                return nullptr;
+            }
+
+            if (!AcquireChunk())
+            {
+                m_isSpilled[chunkIndex] = true;
+                return nullptr;
+            }
+
+            Chunk& chunk = *m_chunks.Insert(chunkIndex).first;
+            chunk.data.reset(static_cast<char*>(aligned_alloc(DIRECT_ALIGNMENT, GetChunkCapacity())));
+
+            if (!chunk.data)
+            {
+                m_chunks.Erase(chunkIndex);
+                ReleaseChunk();
+                m_isSpilled[chunkIndex] = true;
+                return nullptr;
+            }
+
+            return &chunk;
+        }
+
+        bool AcquireChunk()
+        {
+            size_t open = m_openChunks.load(std::memory_order_relaxed);
+
+            do
+            {
+                if (open >= MAX_OPEN_CHUNKS)
+                {
+                    return false;
+                }
+            }
+            while (!m_openChunks.compare_exchange_weak(open, open + 1, std::memory_order_relaxed));
+
+            if (m_budget && !m_budget->TryCharge(GetChunkCapacity()))
+            {
+                m_openChunks.fetch_sub(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            return true;
+        }
+
+        void ReleaseChunk()
+        {
+            m_openChunks.fetch_sub(1, std::memory_order_relaxed);
+
+            if (m_budget)
+            {
+                m_budget->Release(GetChunkCapacity());
+            }
+        }
+
+        // The fullest chunk leaves the fewest packages to pwrite
+        bool SpillFullest()
+        {
+            uint64_t fullestIndex = 0;
+            size_t fullest = 0;
+
+            m_chunks.ForEach([&](uint64_t chunkIndex, Chunk& chunk)
+            {
+                if (chunk.received > fullest)
+                {
+                    fullestIndex = chunkIndex;
+                    fullest = chunk.received;
+                }
+            });
+
+            if (fullest == 0 || !Flush(fullestIndex))
+            {
+                return false;
+            }
+
+            m_isSpilled[fullestIndex] = true;
+            return true;
+        }
+
+        bool Flush(uint64_t chunkIndex)
+        {
+            Chunk* chunk = m_chunks.Find(chunkIndex);
+            const size_t size = GetChunkSlots(chunkIndex) * m_slotSize;
+            // O_DIRECT wants whole blocks, the padding of the last chunk is cut off by the final truncate
+            const size_t alignedSize = (size + DIRECT_ALIGNMENT - 1) / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+
+            const bool isWritten = WriteAll(m_directFd, chunk->data.get(), alignedSize, GetOffset((unsigned)(chunkIndex * CHUNK_SLOTS)));
+
+            if (isWritten)
+            {
+                m_chunks.Erase(chunkIndex);
+                ReleaseChunk();
+            }
+
+            return isWritten;
+        }
+
+    private:
+        int m_directFd;
+        std::atomic<size_t>& m_openChunks;
+        MemoryBudget* m_budget;
+        FlatHashMap<uint64_t, Chunk, UInt64Hash> m_chunks;
+        std::vector<bool> m_isSpilled;      // by chunk: written partly filled, the rest goes by pwrite
+    };
+}
+
+DiskStore::DiskStore(const std::string& directory, Mode mode, MemoryBudget* budget)
+    : m_directory(directory)
+    , m_mode(mode)
+    , m_budget(budget)
+    , m_openChunks(0)
+{
+}
+
+std::unique_ptr<IStoredFile> DiskStore::Open(const std::string& name, unsigned seqTotal, size_t slotSize)
+{
+    const std::string path = m_directory + "/" + name;
+    const std::string partPath = path + ".part";
+    const uint64_t size = (uint64_t)seqTotal * slotSize;
+
+    const int fd = ::open(partPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd == -1)
+    {
+        LOG_ERROR("Can't create {}", partPath);
+        return nullptr;
+    }
+
+    // Sparse: blocks are only allocated for the slots that get written
+    if (::ftruncate(fd, size) != 0)
+    {
+        LOG_ERROR("Can't size {} to {} bytes", partPath, size);
+        ::close(fd);
+        ::unlink(partPath.c_str());
+        return nullptr;
+    }
+
+    if (m_mode == Mode::Mmap)
+    {
+        void* mapping = size > 0 ? ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, fd, 0) : MAP_FAILED;
+
+        if (mapping == MAP_FAILED)
+        {
+            LOG_ERROR("Can't map {}", partPath);
+            ::close(fd);
+            ::unlink(partPath.c_str());
+            return nullptr;
+        }
+
+        return std::make_unique<MappedFile>(path, fd, seqTotal, slotSize, static_cast<char*>(mapping));
+    }
+
+    if (m_mode == Mode::Direct)
+    {
+        int directFd = ::open(partPath.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+
+        // tmpfs and some other file systems don't support O_DIRECT; the chunked writes still save syscalls
+        if (directFd == -1)
+        {
+            directFd = fd;
+        }
+
+        return std::make_unique<DirectFile>(path, fd, directFd, seqTotal, slotSize, m_openChunks, m_budget);
+    }
+
+    return std::make_unique<DiskFile>(path, fd, seqTotal, slotSize);
+}
+
+bool DiskStore::IsInMemory() const
+{
+    // Only the chunks of the direct mode are buffered, they are capped and charge the budget themselves
+    return false;
+}
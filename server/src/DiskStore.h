@@ -0,0 +1,32 @@
+#pragma once
+
+#include "IFileStore.h"
+#include <atomic>
+
+class MemoryBudget;
+
+// Reassembles every file directly in <directory>/<name>.part, a sparse file with package i at
+// offset i * slotSize, and renames it to <directory>/<name> once complete. Completion only moves
+// packages that are shorter than a slot; files of full packages are just truncated. Incomplete files are removed.
+class DiskStore : public IFileStore
+{
+public:
+    enum class Mode
+    {
+        Pwrite, // pwrite per package, the page cache does the writeback
+        Mmap,   // memcpy into a shared mapping of the whole file
+        Direct  // packages are gathered into aligned chunks that go to disk with O_DIRECT, bypassing the page cache
+    };
+
+    // Chunks of the direct mode are charged to the budget, if any
+    DiskStore(const std::string& directory, Mode mode, MemoryBudget* budget = nullptr);
+
+    std::unique_ptr<IStoredFile> Open(const std::string& name, unsigned seqTotal, size_t slotSize) override;
+    bool IsInMemory() const override;
+
+private:
+    std::string m_directory;
+    Mode m_mode;
+    MemoryBudget* m_budget;
+    std::atomic<size_t> m_openChunks;   // chunks buffered by the files of the direct mode
+};
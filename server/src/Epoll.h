@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/epoll.h>
+
+// Thin wrapper over an epoll instance. Every registered fd carries a caller-defined 64-bit tag
+// that comes back in the events.
+class Epoll
+{
+public:
+    static constexpr unsigned MAX_EVENTS = 16;
+
+    Epoll();
+    ~Epoll();
+
+    Epoll(const Epoll&) = delete;
+    Epoll& operator=(const Epoll&) = delete;
+
+    bool IsSet() const;
+
+    bool Add(int fd, uint32_t events, uint64_t tag);
+    bool Remove(int fd);
+
+    // Returns the number of events stored in `events` (at most MAX_EVENTS), 0 on timeout or EINTR,
+    // -1 on error. A negative timeout waits forever.
+    int Wait(epoll_event* events, int timeoutMillis);
+
+private:
+    int m_fd;
+};
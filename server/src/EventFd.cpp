@@ -0,0 +1,45 @@
+#include "EventFd.h"
+#include "Logger.h"
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+EventFd::EventFd()
+    : m_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (m_fd == -1)
+    {
+        LOG_ERROR("Can't create eventfd");
+    }
+}
+
+EventFd::~EventFd()
+{
+    if (IsSet())
+    {
+        ::close(m_fd);
+    }
+}
+
+bool EventFd::IsSet() const
+{
+    return m_fd != -1;
+}
+
+int EventFd::GetFd() const
+{
+    return m_fd;
+}
+
+void EventFd::Signal()
+{
+    const uint64_t value = 1;
+    // Can only fail when the counter is about to overflow, the fd is readable then anyway
+    (void)!::write(m_fd, &value, sizeof(value));
+}
+
+void EventFd::Reset()
+{
+    uint64_t value;
+    (void)!::read(m_fd, &value, sizeof(value));
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+// Non-blocking eventfd used to wake a thread blocked in epoll_wait
+class EventFd
+{
+public:
+    EventFd();
+    ~EventFd();
+
+    EventFd(const EventFd&) = delete;
+    EventFd& operator=(const EventFd&) = delete;
+
+    bool IsSet() const;
+    int GetFd() const;
+
+    void Signal();
+    // Clears the counter so that the next Signal produces a new edge
+    void Reset();
+
+private:
+    int m_fd;
+};
@@ -0,0 +1,133 @@
+#include "FileSink.h"
+#include "Logger.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+FileSink::FileSink(const std::string& directory)
+    : m_directory(directory)
+{
+}
+
+FileSink::~FileSink()
+{
+    for (const auto& file : m_files)
+    {
+        ::close(file.second);
+        ::unlink((GetPath(file.first) + ".part").c_str());
+    }
+}
+
+void FileSink::OnData(const std::string& name, const char* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_files.find(name);
+
+    if (it == m_files.end())
+    {
+        const int fd = ::open((GetPath(name) + ".part").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+        if (fd == -1)
+        {
+            LOG_ERROR("Can't open output file: {}", name);
+            return;
+        }
+
+        it = m_files.emplace(name, fd).first;
+    }
+
+    while (size > 0)
+    {
+        const ssize_t written = ::write(it->second, data, size);
+
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (written <= 0)
+        {
+            LOG_ERROR("Can't write output file: {}", name);
+            break;
+        }
+
+        data += written;
+        size -= written;
+    }
+}
+
+void FileSink::OnComplete(const std::string& name, uint32_t)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_files.find(name);
+
+    if (it != m_files.end())
+    {
+        ::close(it->second);
+
+        const std::string path = GetPath(name);
+
+        if (::rename((path + ".part").c_str(), path.c_str()) != 0)
+        {
+            LOG_ERROR("Can't publish output file: {}", name);
+        }
+
+        m_files.erase(it);
+    }
+}
+
+void FileSink::OnAbort(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    auto it = m_files.find(name);
+
+    if (it != m_files.end())
+    {
+        ::close(it->second);
+        ::unlink((GetPath(name) + ".part").c_str());
+        m_files.erase(it);
+    }
+}
+
+std::string FileSink::GetPath(const std::string& name) const
+{
+    return m_directory + "/" + name;
+}
+
+std::string GetOutputFileName(const Endpoint& peer, const std::string& fileId)
+{
+    // Ids are 8 arbitrary bytes: printable ones are used as is (without the padding), others are hex encoded
+    std::string name = fileId.substr(0, fileId.find_last_not_of(std::string(" \0", 2)) + 1);
+
+    for (char c : name)
+    {
+        if (!isalnum((unsigned char)c) && c != '-' && c != '_' && c != '.')
+        {
+            name.clear();
+            break;
+        }
+    }
+
+    if (name.empty() || name == "." || name == "..")
+    {
+        static const char* HEX = "0123456789abcdef";
+
+        for (unsigned char c : fileId)
+        {
+            name += HEX[c >> 4];
+            name += HEX[c & 0xf];
+        }
+    }
+
+    // [::1]:5000 becomes __1_5000
+    std::string prefix = peer.ToString();
+    prefix.erase(std::remove_if(prefix.begin(), prefix.end(), [](char c) { return c == '[' || c == ']'; }), prefix.end());
+    std::replace(prefix.begin(), prefix.end(), ':', '_');
+
+    return prefix + "_" + name;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "IDataSink.h"
+#include "UdpSocket.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+// Name of the output file of a peer's id: <address>_<port>_<id>, as every client numbers its files from the same
+// start. Printable ids are used as is (without the padding), others are hex encoded.
+std::string GetOutputFileName(const Endpoint& peer, const std::string& fileId);
+
+// Streams every file into <directory>/<name>.part with plain write calls as its prefix grows and renames it to
+// <directory>/<name> once complete, so a file received again doesn't truncate the published one.
+// Files that are never completed are removed.
+class FileSink : public IDataSink
+{
+public:
+    explicit FileSink(const std::string& directory);
+    ~FileSink();
+
+    void OnData(const std::string& name, const char* data, size_t size) override;
+    void OnComplete(const std::string& name, uint32_t checksum) override;
+    void OnAbort(const std::string& name) override;
+
+private:
+    std::string GetPath(const std::string& name) const;
+
+private:
+    std::string m_directory;
+    std::mutex m_lock;
+    std::map<std::string/*name*/, int> m_files;
+};
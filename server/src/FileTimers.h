@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "TimerWheel.h"
+#include "UdpSocket.h"
+
+// Identifies the file a timer belongs to; serial tells a file apart from a later one with the same id
+struct FileTimer
+{
+    Endpoint endpoint;
+    uint64_t fileId;
+    uint64_t serial;
+};
+
+// Idle deadlines of the files handled by one worker thread. A file schedules one timer when it is
+// created and only records its last activity afterwards; when the timer fires the protocol either
+// drops the file or schedules it again for lastActivity + idleTimeout.
+struct FileTimers
+{
+    static constexpr std::chrono::milliseconds TICK{ 10 };
+
+    explicit FileTimers(std::chrono::milliseconds timeout)
+        : wheel(ToTicks(std::chrono::steady_clock::now()))
+        , idleTimeout((uint64_t)(timeout / TICK))
+    {
+    }
+
+    static uint64_t ToTicks(std::chrono::steady_clock::time_point time)
+    {
+        return (uint64_t)(time.time_since_epoch() / TICK);
+    }
+
+    TimerWheel<FileTimer> wheel;
+    uint64_t idleTimeout;
+    uint64_t nextSerial = 0;
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+// splitmix64 finalizer, for integer keys that are far from uniform, like ASCII file ids
+struct UInt64Hash
+{
+    size_t operator()(uint64_t value) const
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return (size_t)(value ^ (value >> 31));
+    }
+};
+
+// Open-addressing hash map with linear probing and values stored inline in the slot array.
+// Erase shifts the following entries back instead of leaving tombstones, so lookups stay short
+// under churn. Lookups never allocate; Insert allocates only when the table grows past 7/8.
+// Insert and Erase invalidate pointers to values. Key and Value must be default constructible.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class FlatHashMap
+{
+public:
+    FlatHashMap() = default;
+    FlatHashMap(FlatHashMap&&) = default;
+    FlatHashMap& operator=(FlatHashMap&&) = default;
+
+    size_t GetSize() const
+    {
+        return m_size;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t GetCapacity() const
+    {
+        return m_slots ? m_mask + 1 : 0;
+    }
+
+    Value* Find(const Key& key)
+    {
+        const size_t index = FindIndex(key);
+        return index != NOT_FOUND ? &m_slots[index].value : nullptr;
+    }
+
+    const Value* Find(const Key& key) const
+    {
+        const size_t index = FindIndex(key);
+        return index != NOT_FOUND ? &m_slots[index].value : nullptr;
+    }
+
+    // Returns the value for key and whether it was inserted; a new value is default constructed
+    std::pair<Value*, bool> Insert(const Key& key)
+    {
+        if ((m_size + 1) * 8 > GetCapacity() * 7)
+        {
+            Rehash(GetCapacity() ? GetCapacity() * 2 : MIN_CAPACITY);
+        }
+
+        for (size_t index = Hash()(key) & m_mask;; index = (index + 1) & m_mask)
+        {
+            if (!m_used[index])
+            {
+                m_used[index] = true;
+                m_slots[index].key = key;
+                ++m_size;
+                return { &m_slots[index].value, true };
+            }
+
+            if (m_slots[index].key == key)
+            {
+                return { &m_slots[index].value, false };
+            }
+        }
+    }
+
+    Value& operator[](const Key& key)
+    {
+        return *Insert(key).first;
+    }
+
+    bool Erase(const Key& key)
+    {
+        const size_t index = FindIndex(key);
+
+        if (index == NOT_FOUND)
+        {
+            return false;
+        }
+
+        EraseAt(index);
+        return true;
+    }
+
+    // Erases every entry for which predicate(const Key&, Value&) returns true. An entry that is moved
+    // during the scan may be offered to the predicate twice.
+    template <typename Predicate>
+    size_t EraseIf(Predicate&& predicate)
+    {
+        size_t erased = 0;
+
+        for (size_t index = 0; index < GetCapacity();)
+        {
+            if (m_used[index] && predicate(static_cast<const Key&>(m_slots[index].key), m_slots[index].value))
+            {
+                // The next entry of the cluster may have been shifted into this slot, check it again
+                EraseAt(index);
+                ++erased;
+            }
+            else
+            {
+                ++index;
+            }
+        }
+
+        return erased;
+    }
+
+    // Calls function(const Key&, Value&) for every entry
+    template <typename Function>
+    void ForEach(Function&& function)
+    {
+        for (size_t index = 0; index < GetCapacity(); ++index)
+        {
+            if (m_used[index])
+            {
+                function(static_cast<const Key&>(m_slots[index].key), m_slots[index].value);
+            }
+        }
+    }
+
+    void Reserve(size_t count)
+    {
+        size_t capacity = GetCapacity() ? GetCapacity() : MIN_CAPACITY;
+
+        while (count * 8 > capacity * 7)
+        {
+            capacity *= 2;
+        }
+
+        if (capacity > GetCapacity())
+        {
+            Rehash(capacity);
+        }
+    }
+
+    void Clear()
+    {
+        m_slots.reset();
+        m_used.reset();
+        m_mask = 0;
+        m_size = 0;
+    }
+
+private:
+    struct Slot
+    {
+        Key key;
+        Value value;
+    };
+
+    static constexpr size_t NOT_FOUND = SIZE_MAX;
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    size_t FindIndex(const Key& key) const
+    {
+        if (m_size == 0)
+        {
+            return NOT_FOUND;
+        }
+
+        for (size_t index = Hash()(key) & m_mask; m_used[index]; index = (index + 1) & m_mask)
+        {
+            if (m_slots[index].key == key)
+            {
+                return index;
+            }
+        }
+
+        return NOT_FOUND;
+    }
+
+    // Backward shift deletion: pulls every following entry of the cluster that may live in the hole
+    void EraseAt(size_t hole)
+    {
+        for (size_t index = (hole + 1) & m_mask; m_used[index]; index = (index + 1) & m_mask)
+        {
+            const size_t home = Hash()(m_slots[index].key) & m_mask;
+
+            // The entry can move to the hole unless its home lies cyclically in (hole, index]
+            if (((index - home) & m_mask) >= ((index - hole) & m_mask))
+            {
+                m_slots[hole] = std::move(m_slots[index]);
+                hole = index;
+            }
+        }
+
+        m_slots[hole] = Slot();
+        m_used[hole] = false;
+        --m_size;
+    }
+
+    void Rehash(size_t capacity)
+    {
+        std::unique_ptr<Slot[]> slots(new Slot[capacity]);
+        std::unique_ptr<bool[]> used(new bool[capacity]());
+        const size_t mask = capacity - 1;
+
+        for (size_t i = 0; i < GetCapacity(); ++i)
+        {
+            if (m_used[i])
+            {
+                size_t index = Hash()(m_slots[i].key) & mask;
+
+                while (used[index])
+                {
+                    index = (index + 1) & mask;
+                }
+
+                used[index] = true;
+                slots[index] = std::move(m_slots[i]);
+            }
+        }
+
+        m_slots = std::move(slots);
+        m_used = std::move(used);
+        m_mask = mask;
+    }
+
+private:
+    std::unique_ptr<Slot[]> m_slots;
+    std::unique_ptr<bool[]> m_used;
+    size_t m_mask = 0;
+    size_t m_size = 0;
+};
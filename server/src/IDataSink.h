@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+
+// Receives the data of a file in order, as soon as a contiguous prefix is available. Files are named
+// by GetOutputFileName, unique per peer and id. Called from the protocol threads, implementations must be thread-safe.
+class IDataSink
+{
+public:
+    virtual ~IDataSink() = default;
+    virtual void OnData(const std::string& name, const char* data, size_t size) = 0;
+    virtual void OnComplete(const std::string& name, uint32_t checksum) = 0;
+    virtual void OnAbort(const std::string& name) = 0;
+};
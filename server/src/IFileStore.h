@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Storage of one file while it is being reassembled. Package i goes to slot i of slotSize bytes,
+// so packages can be written in any order. Destroying a file that was not completed discards it.
+class IStoredFile
+{
+public:
+    virtual ~IStoredFile() = default;
+
+    virtual bool Write(unsigned seqNumber, const char* data, size_t size) = 0;
+    // Returns the data of a written package, in place or copied into scratch (slotSize bytes)
+    virtual const char* Read(unsigned seqNumber, size_t size, char* scratch) = 0;
+    // Every package is written: lays them out back to back and publishes the file
+    virtual bool Complete(const uint16_t* sizes) = 0;
+};
+
+// Creates the storage of new files. Called from all protocol threads, implementations must be thread-safe.
+class IFileStore
+{
+public:
+    virtual ~IFileStore() = default;
+
+    // Returns nullptr when the storage can't be created; name comes from GetOutputFileName
+    virtual std::unique_ptr<IStoredFile> Open(const std::string& name, unsigned seqTotal, size_t slotSize) = 0;
+    // Whether the packages of partial files are kept in memory and count against the memory budget
+    virtual bool IsInMemory() const = 0;
+};
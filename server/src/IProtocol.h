@@ -1,12 +1,38 @@
 #pragma once
 
-#include <vector>
+#include <cstddef>
+#include "FileTimers.h"
+
+// Fixed-size response record, passed by value through the response queue without heap allocations
+struct Response
+{
+    static constexpr size_t MAX_SIZE = 64;
+
+    unsigned size = 0; // 0 means there is nothing to send
+    char data[MAX_SIZE];
+};
+
+// When held-back acknowledgments go out: once `every` are due, or `delay` microseconds after the
+// first one was held, whichever comes first. Final ACKs with the checksum are never held.
+struct AckPolicy
+{
+    unsigned every = 16;
+    unsigned delay = 0;     // 0 flushes them at the end of every request batch
+};
 
 class IProtocol
 {
 public:
     virtual ~IProtocol() = default;
-    virtual std::vector<char> Process(const std::vector<char>& data) = 0;
+    virtual void Process(const char* data, size_t size, Response& response) = 0;
     virtual bool IsEmpty() = 0;
-    virtual bool IsExpired() = 0;
+    // Acknowledgments held back by the AckPolicy, so they go out together and a SACK covers many packages.
+    // IsAckDue tells that the policy's count is reached; FlushAck is called until it returns false.
+    virtual bool HasPendingAcks() = 0;
+    virtual bool IsAckDue() = 0;
+    virtual bool FlushAck(Response& response) = 0;
+    // Called for a timer the protocol scheduled; returns true when the file was dropped as idle
+    virtual bool OnTimer(const FileTimer& timer) = 0;
+    // Drops a partial file to free memory for others
+    virtual void Evict(uint64_t fileId) = 0;
 };
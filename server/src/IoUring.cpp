@@ -0,0 +1,311 @@
+#include "IoUring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    int IoUringSetup(unsigned entries, io_uring_params* params)
+    {
+        return (int)syscall(__NR_io_uring_setup, entries, params);
+    }
+
+    int IoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize)
+    {
+        return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+    }
+
+    int IoUringRegister(int fd, unsigned opcode, const void* arg, unsigned argCount)
+    {
+        return (int)syscall(__NR_io_uring_register, fd, opcode, arg, argCount);
+    }
+
+    void* Map(int fd, size_t size, off_t offset)
+    {
+        void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return result == MAP_FAILED ? nullptr : result;
+    }
+
+    template <typename T>
+    T* At(void* base, unsigned offset)
+    {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+}
+
+IoUring::IoUring()
+    : m_fd(-1)
+    , m_sqRing(nullptr)
+    , m_sqRingSize(0)
+    , m_cqRing(nullptr)
+    , m_cqRingSize(0)
+    , m_sqes(nullptr)
+    , m_sqesSize(0)
+    , m_sqHead(nullptr)
+    , m_sqTail(nullptr)
+    , m_sqArray(nullptr)
+    , m_sqMask(0)
+    , m_sqEntries(0)
+    , m_sqLocalTail(0)
+    , m_cqHead(nullptr)
+    , m_cqTail(nullptr)
+    , m_cqes(nullptr)
+    , m_cqMask(0)
+    , m_bufferRing(nullptr)
+    , m_bufferRingSize(0)
+    , m_buffers(nullptr)
+    , m_bufferCount(0)
+    , m_bufferSize(0)
+    , m_bufferTail(0)
+    , m_enterCount(0)
+{
+}
+
+IoUring::~IoUring()
+{
+    Release();
+}
+
+bool IoUring::Init(unsigned entries, unsigned completionEntries)
+{
+    Release();
+
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SINGLE_ISSUER;
+    params.cq_entries = completionEntries;
+
+    m_fd = IoUringSetup(entries, &params);
+
+    if (m_fd < 0 && errno == EINVAL)
+    {
+        // Kernels before 6.0 don't know the task run hints
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = completionEntries;
+        m_fd = IoUringSetup(entries, &params);
+    }
+
+    if (m_fd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        Release();
+        return false;
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    m_sqRing = Map(m_fd, m_sqRingSize, IORING_OFF_SQ_RING);
+    m_cqRing = m_sqRing;
+    m_sqes = static_cast<io_uring_sqe*>(Map(m_fd, m_sqesSize, IORING_OFF_SQES));
+
+    if (!m_sqRing || !m_sqes)
+    {
+        Release();
+        return false;
+    }
+
+    m_sqHead = At<unsigned>(m_sqRing, params.sq_off.head);
+    m_sqTail = At<unsigned>(m_sqRing, params.sq_off.tail);
+    m_sqArray = At<unsigned>(m_sqRing, params.sq_off.array);
+    m_sqMask = *At<unsigned>(m_sqRing, params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_sqLocalTail = *m_sqTail;
+
+    m_cqHead = At<unsigned>(m_cqRing, params.cq_off.head);
+    m_cqTail = At<unsigned>(m_cqRing, params.cq_off.tail);
+    m_cqes = At<io_uring_cqe>(m_cqRing, params.cq_off.cqes);
+    m_cqMask = *At<unsigned>(m_cqRing, params.cq_off.ring_mask);
+
+    // SQ slots map 1:1 to SQEs, so the index array is filled once
+    for (unsigned i = 0; i < m_sqEntries; ++i)
+    {
+        m_sqArray[i] = i;
+    }
+
+    return true;
+}
+
+bool IoUring::IsSet() const
+{
+    return m_fd >= 0;
+}
+
+io_uring_sqe* IoUring::GetSqe()
+{
+    const unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+
+    if (m_sqLocalTail - head >= m_sqEntries)
+    {
+        return nullptr;
+    }
+
+    io_uring_sqe* sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+    ++m_sqLocalTail;
+
+    memset(sqe, 0, sizeof(io_uring_sqe));
+    return sqe;
+}
+
+unsigned IoUring::GetPendingSubmissions() const
+{
+    return m_sqLocalTail - *m_sqTail;
+}
+
+int IoUring::Submit(unsigned waitCount, int timeoutMillis)
+{
+    const unsigned toSubmit = GetPendingSubmissions();
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec timeout;
+    memset(&arg, 0, sizeof(arg));
+
+    if (waitCount > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+
+        if (timeoutMillis >= 0)
+        {
+            timeout.tv_sec = timeoutMillis / 1000;
+            timeout.tv_nsec = (timeoutMillis % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&timeout);
+            flags |= IORING_ENTER_EXT_ARG;
+        }
+    }
+
+    ++m_enterCount;
+    const int result = IoUringEnter(m_fd, toSubmit, waitCount, flags,
+        (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr, (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+
+    // A timeout or a signal is not an error for the caller
+    if (result < 0)
+    {
+        return errno == ETIME || errno == EINTR ? 0 : -errno;
+    }
+
+    return result;
+}
+
+bool IoUring::RegisterBuffers(uint16_t groupId, unsigned count, unsigned size)
+{
+    if (!IsSet() || m_bufferRing || count == 0 || count > 32768 || (count & (count - 1)) != 0)
+    {
+        return false;
+    }
+
+    m_bufferRingSize = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, m_bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* buffers = mmap(nullptr, (size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (ring == MAP_FAILED || buffers == MAP_FAILED)
+    {
+        if (ring != MAP_FAILED)
+        {
+            munmap(ring, m_bufferRingSize);
+        }
+
+        if (buffers != MAP_FAILED)
+        {
+            munmap(buffers, (size_t)count * size);
+        }
+
+        return false;
+    }
+
+    io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = reinterpret_cast<uint64_t>(ring);
+    registration.ring_entries = count;
+    registration.bgid = groupId;
+
+    if (IoUringRegister(m_fd, IORING_REGISTER_PBUF_RING, &registration, 1) != 0)
+    {
+        munmap(ring, m_bufferRingSize);
+        munmap(buffers, (size_t)count * size);
+        return false;
+    }
+
+    m_bufferRing = static_cast<io_uring_buf_ring*>(ring);
+    m_buffers = static_cast<char*>(buffers);
+    m_bufferCount = count;
+    m_bufferSize = size;
+    m_bufferTail = 0;
+
+    for (unsigned i = 0; i < count; ++i)
+    {
+        RecycleBuffer(i);
+    }
+
+    CommitBuffers();
+    return true;
+}
+
+char* IoUring::GetBuffer(unsigned bufferId) const
+{
+    return m_buffers + (size_t)bufferId * m_bufferSize;
+}
+
+unsigned IoUring::GetBufferSize() const
+{
+    return m_bufferSize;
+}
+
+void IoUring::RecycleBuffer(unsigned bufferId)
+{
+    // Not m_bufferRing->bufs: in C++ __DECLARE_FLEX_ARRAY places the array after an empty struct, 8 bytes off
+    io_uring_buf& buffer = reinterpret_cast<io_uring_buf*>(m_bufferRing)[m_bufferTail & (m_bufferCount - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(GetBuffer(bufferId));
+    buffer.len = m_bufferSize;
+    buffer.bid = (uint16_t)bufferId;
+    ++m_bufferTail;
+}
+
+void IoUring::CommitBuffers()
+{
+    if (m_bufferRing)
+    {
+        __atomic_store_n(&m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE);
+    }
+}
+
+uint64_t IoUring::GetEnterCount() const
+{
+    return m_enterCount;
+}
+
+void IoUring::Release()
+{
+    // Closing the ring cancels the outstanding requests before the buffers are unmapped
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    if (m_sqes)
+    {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = nullptr;
+    }
+
+    if (m_sqRing)
+    {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = m_cqRing = nullptr;
+    }
+
+    if (m_bufferRing)
+    {
+        munmap(m_bufferRing, m_bufferRingSize);
+        munmap(m_buffers, (size_t)m_bufferCount * m_bufferSize);
+        m_bufferRing = nullptr;
+        m_buffers = nullptr;
+    }
+}
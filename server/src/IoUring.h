@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+// Minimal io_uring wrapper on top of the raw syscalls (no liburing): one submission and one completion
+// queue plus an optional ring of provided buffers for IOSQE_BUFFER_SELECT receives.
+// Not thread safe, the ring is meant to be owned by a single I/O thread.
+class IoUring
+{
+public:
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool Init(unsigned entries, unsigned completionEntries);
+    bool IsSet() const;
+
+    // Returns a zeroed SQE or nullptr when the submission queue is full
+    io_uring_sqe* GetSqe();
+    unsigned GetPendingSubmissions() const;
+
+    // Submits the queued SQEs and waits for at least waitCount completions, or for timeoutMillis
+    // when it is not negative. Returns the number of submitted SQEs or -errno.
+    int Submit(unsigned waitCount, int timeoutMillis);
+
+    // Calls handler(const io_uring_cqe&) for every available completion and returns their number
+    template <typename Handler>
+    unsigned ForEachCompletion(Handler&& handler);
+
+    // Provided buffers: `count` must be a power of two. All of them are handed to the kernel at once,
+    // consumed buffers are given back with RecycleBuffer and become visible on CommitBuffers.
+    bool RegisterBuffers(uint16_t groupId, unsigned count, unsigned size);
+    char* GetBuffer(unsigned bufferId) const;
+    unsigned GetBufferSize() const;
+    void RecycleBuffer(unsigned bufferId);
+    void CommitBuffers();
+
+    // Number of io_uring_enter calls so far
+    uint64_t GetEnterCount() const;
+
+private:
+    void Release();
+
+private:
+    int m_fd;
+
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+
+    unsigned* m_sqHead;
+    unsigned* m_sqTail;
+    unsigned* m_sqArray;
+    unsigned m_sqMask;
+    unsigned m_sqEntries;
+    unsigned m_sqLocalTail;
+
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    io_uring_cqe* m_cqes;
+    unsigned m_cqMask;
+
+    io_uring_buf_ring* m_bufferRing;
+    size_t m_bufferRingSize;
+    char* m_buffers;
+    unsigned m_bufferCount;
+    unsigned m_bufferSize;
+    uint16_t m_bufferTail;
+
+    uint64_t m_enterCount;
+};
+
+template <typename Handler>
+unsigned IoUring::ForEachCompletion(Handler&& handler)
+{
+    unsigned head = *m_cqHead;
+    const unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+
+    for (; head != tail; ++head, ++count)
+    {
+        handler(m_cqes[head & m_cqMask]);
+    }
+
+    if (count > 0)
+    {
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    return count;
+}
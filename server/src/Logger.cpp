@@ -0,0 +1,280 @@
+#include "Logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    constexpr size_t RING_SIZE = 4096;
+    constexpr std::chrono::milliseconds DRAIN_INTERVAL(20);
+
+    std::atomic<LogLevel> runtimeLevel(LogLevel::Info);
+
+    // Single producer (the owning thread), single consumer (the background thread)
+    struct LogRing
+    {
+        LogRecord records[RING_SIZE];
+        alignas(64) std::atomic<size_t> tail{ 0 };
+        std::atomic<uint64_t> dropped{ 0 };
+        std::atomic_bool isClosed{ false };
+        alignas(64) std::atomic<size_t> head{ 0 };
+        size_t cachedHead = 0;                  // producer's copy of head
+        uint64_t reportedDropped = 0;           // consumer only
+    };
+
+    class Backend
+    {
+    public:
+        Backend()
+            : m_stop(false)
+            , m_isNudged(false)
+            , m_thread([this] { ThreadProc(); })
+        {
+        }
+
+        ~Backend()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+
+            m_condition.notify_one();
+            m_thread.join();
+        }
+
+        LogRing* AddRing()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_rings.push_back(std::make_unique<LogRing>());
+            return m_rings.back().get();
+        }
+
+        // Called by producers whose ring is filling up, so bursts don't have to wait for the interval
+        void Nudge()
+        {
+            if (!m_isNudged.exchange(true, std::memory_order_relaxed))
+            {
+                m_condition.notify_one();
+            }
+        }
+
+    private:
+        struct Entry
+        {
+            uint64_t time;
+            const LogRecord* record;
+        };
+
+        void ThreadProc()
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+
+            while (true)
+            {
+                const bool isStopping = m_stop;
+
+                Drain();
+
+                if (isStopping)
+                {
+                    break;
+                }
+
+                m_condition.wait_for(lock, DRAIN_INTERVAL, [this] { return m_stop || m_isNudged.load(std::memory_order_relaxed); });
+                m_isNudged.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        // Formats everything queued so far, ordered by time over all rings, with one write
+        void Drain()
+        {
+            m_entries.clear();
+            m_output.clear();
+
+            std::vector<size_t> tails(m_rings.size());
+
+            for (size_t i = 0; i < m_rings.size(); ++i)
+            {
+                LogRing& ring = *m_rings[i];
+                tails[i] = ring.tail.load(std::memory_order_acquire);
+
+                for (size_t position = ring.head.load(std::memory_order_relaxed); position != tails[i]; ++position)
+                {
+                    const LogRecord& record = ring.records[position % RING_SIZE];
+                    m_entries.push_back(Entry{ record.time, &record });
+                }
+
+                const uint64_t dropped = ring.dropped.load(std::memory_order_relaxed);
+
+                if (dropped != ring.reportedDropped)
+                {
+                    m_output += "Log: " + std::to_string(dropped - ring.reportedDropped) + " records dropped\n";
+                    ring.reportedDropped = dropped;
+                }
+            }
+
+            std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+
+            for (const Entry& entry : m_entries)
+            {
+                Format(*entry.record);
+            }
+
+            if (!m_output.empty())
+            {
+                fwrite(m_output.data(), 1, m_output.size(), stdout);
+                fflush(stdout);
+            }
+
+            for (size_t i = 0; i < m_rings.size(); ++i)
+            {
+                m_rings[i]->head.store(tails[i], std::memory_order_release);
+            }
+
+            // Rings of finished threads go away once they are empty
+            m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [](const std::unique_ptr<LogRing>& ring)
+            {
+                return ring->isClosed.load(std::memory_order_acquire) &&
+                    ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire);
+            }), m_rings.end());
+        }
+
+        void Format(const LogRecord& record)
+        {
+            size_t argument = 0;
+
+            for (const char* ptr = record.format; *ptr; ++ptr)
+            {
+                if (*ptr != '{' || argument >= record.count)
+                {
+                    m_output += *ptr;
+                    continue;
+                }
+
+                const char* end = strchr(ptr, '}');
+
+                if (!end)
+                {
+                    m_output += ptr;
+                    break;
+                }
+
+                // "{:spec}" passes spec on to printf for doubles
+                const std::string spec = ptr[1] == ':' ? std::string(ptr + 2, end) : std::string();
+                const LogRecord::Value& value = record.values[argument];
+                char buffer[64];
+
+                switch (record.types[argument])
+                {
+                case LogRecord::Type::Signed:
+                    m_output += std::to_string(value.i);
+                    break;
+                case LogRecord::Type::Unsigned:
+                    m_output += std::to_string(value.u);
+                    break;
+                case LogRecord::Type::Double:
+                    snprintf(buffer, sizeof(buffer), ("%" + (spec.empty() ? std::string("g") : spec)).c_str(), value.d);
+                    m_output += buffer;
+                    break;
+                case LogRecord::Type::Text:
+                    m_output.append(record.text + value.text.offset, value.text.size);
+                    break;
+                }
+
+                ++argument;
+                ptr = end;
+            }
+
+            m_output += '\n';
+        }
+
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_condition;
+        bool m_stop;
+        std::atomic_bool m_isNudged;
+        std::vector<std::unique_ptr<LogRing>> m_rings;
+        std::vector<Entry> m_entries;
+        std::string m_output;
+        std::thread m_thread;
+    };
+
+    Backend& GetBackend()
+    {
+        static Backend backend;
+        return backend;
+    }
+
+    // Marks the ring of an exiting thread, the background thread frees it after the last drain
+    struct ThreadRing
+    {
+        ~ThreadRing()
+        {
+            if (ring)
+            {
+                ring->isClosed.store(true, std::memory_order_release);
+            }
+        }
+
+        LogRing* ring = nullptr;
+    };
+
+    thread_local ThreadRing threadRing;
+}
+
+void Logger::SetLevel(LogLevel level)
+{
+    runtimeLevel.store(level, std::memory_order_relaxed);
+}
+
+LogLevel Logger::GetLevel()
+{
+    return runtimeLevel.load(std::memory_order_relaxed);
+}
+
+LogRecord* Logger::Claim()
+{
+    LogRing* ring = threadRing.ring;
+
+    if (!ring)
+    {
+        ring = threadRing.ring = GetBackend().AddRing();
+    }
+
+    const size_t tail = ring->tail.load(std::memory_order_relaxed);
+
+    if (tail - ring->cachedHead >= RING_SIZE / 2)
+    {
+        ring->cachedHead = ring->head.load(std::memory_order_acquire);
+
+        if (tail - ring->cachedHead >= RING_SIZE)
+        {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        if (tail - ring->cachedHead >= RING_SIZE / 2)
+        {
+            GetBackend().Nudge();
+        }
+    }
+
+    LogRecord* record = &ring->records[tail % RING_SIZE];
+    record->time = (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count();
+
+    return record;
+}
+
+void Logger::Commit()
+{
+    LogRing* ring = threadRing.ring;
+    ring->tail.store(ring->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
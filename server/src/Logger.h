@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+// Asynchronous logging. A message is stored as a binary record (format pointer and raw arguments)
+// into a lock-free ring of the calling thread, which costs a few nanoseconds and no syscall;
+// a background thread formats the records and writes them to stdout in batches.
+//
+//     LOG_INFO("CRC: {}, id: {}", checksum, id);
+//
+// Formats must be string literals with "{}" placeholders ("{:.1f}" passes a precision to doubles).
+// Arguments are integers, floating point numbers and strings; strings are copied, long ones truncated.
+// Messages below LOG_LEVEL are compiled out entirely, their arguments are not even evaluated;
+// messages below the runtime level (Logger::SetLevel, Info by default) cost a relaxed load.
+// When a thread's ring is full its records are dropped and counted, the caller never blocks.
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#define LOG_WRITE(level, minimum, format, ...) \
+    do { if constexpr (LOG_LEVEL <= minimum) if (level >= Logger::GetLevel()) Logger::Write(level, "" format, ##__VA_ARGS__); } while (false)
+
+#define LOG_DEBUG(format, ...) LOG_WRITE(LogLevel::Debug, LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_WRITE(LogLevel::Info, LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARNING(format, ...) LOG_WRITE(LogLevel::Warning, LOG_LEVEL_WARNING, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_WRITE(LogLevel::Error, LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+
+enum class LogLevel : uint8_t
+{
+    Debug,
+    Info,
+    Warning,
+    Error
+};
+
+struct LogRecord
+{
+    static constexpr size_t MAX_ARGUMENTS = 6;
+    static constexpr size_t TEXT_SIZE = 176;
+
+    enum class Type : uint8_t
+    {
+        Signed,
+        Unsigned,
+        Double,
+        Text
+    };
+
+    union Value
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        struct
+        {
+            uint8_t offset;
+            uint8_t size;
+        } text;
+    };
+
+    const char* format;
+    uint64_t time;          // steady clock, only used to merge the rings in order
+    LogLevel level;
+    uint8_t count;
+    uint8_t textSize;
+    Type types[MAX_ARGUMENTS];
+    Value values[MAX_ARGUMENTS];
+    char text[TEXT_SIZE];   // the string arguments back to back
+};
+
+static_assert(sizeof(LogRecord) == 256, "LogRecord should fill whole cache lines");
+
+class Logger
+{
+public:
+    template <typename... Args>
+    static void Write(LogLevel level, const char* format, const Args&... args)
+    {
+        static_assert(sizeof...(Args) <= LogRecord::MAX_ARGUMENTS, "Too many log arguments");
+
+        if (level < GetLevel())
+        {
+            return;
+        }
+
+        LogRecord* record = Claim();
+
+        if (!record)
+        {
+            return;
+        }
+
+        record->format = format;
+        record->level = level;
+        record->count = 0;
+        record->textSize = 0;
+        (Encode(*record, args), ...);
+
+        Commit();
+    }
+
+    // Runtime filter on top of LOG_LEVEL, Info by default
+    static void SetLevel(LogLevel level);
+    static LogLevel GetLevel();
+
+private:
+    // The next free record of the calling thread's ring, nullptr when the ring is full
+    static LogRecord* Claim();
+    // Publishes the claimed record to the background thread
+    static void Commit();
+
+    template <typename T>
+    static void Encode(LogRecord& record, const T& value)
+    {
+        LogRecord::Value& slot = record.values[record.count];
+
+        if constexpr (std::is_floating_point_v<T>)
+        {
+            record.types[record.count] = LogRecord::Type::Double;
+            slot.d = value;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            record.types[record.count] = LogRecord::Type::Signed;
+            slot.i = (int64_t)value;
+        }
+        else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        {
+            record.types[record.count] = LogRecord::Type::Signed;
+            slot.i = value;
+        }
+        else if constexpr (std::is_integral_v<T>)
+        {
+            record.types[record.count] = LogRecord::Type::Unsigned;
+            slot.u = value;
+        }
+        else
+        {
+            static_assert(std::is_convertible_v<const T&, std::string_view>, "Unsupported log argument type");
+
+            const std::string_view text(value);
+            const size_t size = std::min(text.size(), LogRecord::TEXT_SIZE - record.textSize);
+
+            memcpy(record.text + record.textSize, text.data(), size);
+            record.types[record.count] = LogRecord::Type::Text;
+            slot.text.offset = record.textSize;
+            slot.text.size = (uint8_t)size;
+            record.textSize += (uint8_t)size;
+        }
+
+        ++record.count;
+    }
+};
@@ -0,0 +1,122 @@
+#include "MemoryBudget.h"
+#include <algorithm>
+
+MemoryBudget::MemoryBudget(uint64_t limit)
+    : m_limit(limit)
+    , m_used(0)
+    , m_wanted(0)
+{
+}
+
+bool MemoryBudget::TryCharge(uint64_t bytes)
+{
+    uint64_t used = m_used.load(std::memory_order_relaxed);
+
+    do
+    {
+        if (m_limit != 0 && used + bytes > m_limit)
+        {
+            return false;
+        }
+    }
+    while (!m_used.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+
+    return true;
+}
+
+void MemoryBudget::Release(uint64_t bytes)
+{
+    m_used.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+MemoryBudget::Result MemoryBudget::TryCharge(const Endpoint& peer, uint64_t bytes, uint64_t peerQuota)
+{
+    if (peerQuota == 0)
+    {
+        return TryCharge(bytes) ? Result::Charged : Result::OverLimit;
+    }
+
+    std::lock_guard<std::mutex> lock(m_peersLock);
+
+    uint64_t& used = m_peers[peer];
+
+    if (used + bytes > peerQuota)
+    {
+        if (used == 0)
+        {
+            m_peers.erase(peer);
+        }
+
+        return Result::OverQuota;
+    }
+
+    if (!TryCharge(bytes))
+    {
+        if (used == 0)
+        {
+            m_peers.erase(peer);
+        }
+
+        return Result::OverLimit;
+    }
+
+    used += bytes;
+    return Result::Charged;
+}
+
+void MemoryBudget::Release(const Endpoint& peer, uint64_t bytes)
+{
+    Release(bytes);
+
+    std::lock_guard<std::mutex> lock(m_peersLock);
+
+    const auto it = m_peers.find(peer);
+
+    // Peers charged without a quota are not tracked
+    if (it != m_peers.end())
+    {
+        it->second -= std::min(it->second, bytes);
+
+        if (it->second == 0)
+        {
+            m_peers.erase(it);
+        }
+    }
+}
+
+void MemoryBudget::RequestEviction(uint64_t bytes)
+{
+    uint64_t wanted = m_wanted.load(std::memory_order_relaxed);
+
+    while (wanted < bytes && !m_wanted.compare_exchange_weak(wanted, bytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+bool MemoryBudget::TakeEviction()
+{
+    uint64_t wanted = m_wanted.load(std::memory_order_relaxed);
+
+    if (wanted == 0)
+    {
+        return false;
+    }
+
+    if (m_limit == 0 || GetUsed() + wanted <= m_limit)
+    {
+        m_wanted.compare_exchange_strong(wanted, 0, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+uint64_t MemoryBudget::GetUsed() const
+{
+    return m_used.load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryBudget::GetLimit() const
+{
+    return m_limit;
+}
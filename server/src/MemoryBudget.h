@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include "UdpSocket.h"
+
+// What happens to a package that needs memory beyond the budget or a peer's quota
+enum class BudgetPolicy
+{
+    DropNew,     // new files are refused; admitted files reserved their memory and always finish
+    EvictOldest, // the worker's oldest partial files are dropped to make room
+    StopAcks     // files are charged package by package, nothing more is stored or acknowledged until
+                 // completions or expiry free memory
+};
+
+// Bytes held by the partial files of all workers, in total and per peer over all workers and sockets
+class MemoryBudget
+{
+public:
+    enum class Result
+    {
+        Charged,
+        OverQuota,  // the peer's quota is exceeded
+        OverLimit   // the total limit is exceeded
+    };
+
+    // 0 means unlimited
+    explicit MemoryBudget(uint64_t limit = 0);
+
+    // Fails when the bytes don't fit into the limit
+    bool TryCharge(uint64_t bytes);
+    void Release(uint64_t bytes);
+    // The same, also charged to the peer, which may hold at most peerQuota bytes (0 is unlimited)
+    Result TryCharge(const Endpoint& peer, uint64_t bytes, uint64_t peerQuota);
+    void Release(const Endpoint& peer, uint64_t bytes);
+
+    // A worker that is over the limit without files of its own to evict asks the others for bytes;
+    // TakeEviction tells them to evict their oldest file until the bytes fit
+    void RequestEviction(uint64_t bytes);
+    bool TakeEviction();
+
+    uint64_t GetUsed() const;
+    uint64_t GetLimit() const;
+
+private:
+    const uint64_t m_limit;
+    std::atomic<uint64_t> m_used;
+    std::atomic<uint64_t> m_wanted;     // bytes of the last eviction request, 0 without one
+    std::mutex m_peersLock;
+    std::unordered_map<Endpoint, uint64_t, EndpointHash> m_peers;
+};
+
+// One worker's side of the budget, shared by its protocols. Keeps the worker's admitted files
+// oldest first; other workers' files are only evicted by them, on request.
+struct FileBudget
+{
+    struct AdmittedFile
+    {
+        Endpoint endpoint;
+        uint64_t fileId;
+    };
+
+    MemoryBudget* global = nullptr; // nullptr means unlimited
+    BudgetPolicy policy = BudgetPolicy::DropNew;
+    uint64_t peerQuota = 0;         // bytes per peer, 0 means unlimited; per worker only without global
+    uint64_t fileQuota = 0;         // bytes per file, 0 means unlimited
+
+    std::map<uint64_t/*admission*/, AdmittedFile> files;
+    uint64_t nextAdmission = 0;
+
+    // Set by the owner of the protocols: drops the file from its protocol
+    std::function<void(const AdmittedFile&)> evict;
+
+    // Written by the worker only
+    std::atomic<uint64_t> filesRefused{ 0 };
+    std::atomic<uint64_t> filesEvicted{ 0 };
+    std::atomic<uint64_t> packagesRefused{ 0 };
+};
@@ -0,0 +1,53 @@
+#include "MemoryStore.h"
+#include <cstring>
+#include <new>
+
+namespace
+{
+    class MemoryFile : public IStoredFile
+    {
+    public:
+        MemoryFile(char* data, size_t slotSize)
+            : m_data(data)
+            , m_slotSize(slotSize)
+        {
+        }
+
+        bool Write(unsigned seqNumber, const char* data, size_t size) override
+        {
+            memcpy(m_data.get() + (size_t)seqNumber * m_slotSize, data, size);
+            return true;
+        }
+
+        const char* Read(unsigned seqNumber, size_t, char*) override
+        {
+            return m_data.get() + (size_t)seqNumber * m_slotSize;
+        }
+
+        bool Complete(const uint16_t*) override
+        {
+            return true;
+        }
+
+    private:
+        std::unique_ptr<char[]> m_data;
+        size_t m_slotSize;
+    };
+}
+
+std::unique_ptr<IStoredFile> MemoryStore::Open(const std::string&, unsigned seqTotal, size_t slotSize)
+{
+    char* data = new (std::nothrow) char[(size_t)seqTotal * slotSize];
+
+    if (!data)
+    {
+        return nullptr;
+    }
+
+    return std::make_unique<MemoryFile>(data, slotSize);
+}
+
+bool MemoryStore::IsInMemory() const
+{
+    return true;
+}
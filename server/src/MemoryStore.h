@@ -0,0 +1,12 @@
+#pragma once
+
+#include "IFileStore.h"
+
+// Keeps every file in one heap block of seqTotal slots until it completes. The block is never
+// initialized, so only the pages of received packages are committed. Nothing is kept after Complete.
+class MemoryStore : public IFileStore
+{
+public:
+    std::unique_ptr<IStoredFile> Open(const std::string& name, unsigned seqTotal, size_t slotSize) override;
+    bool IsInMemory() const override;
+};
@@ -0,0 +1,184 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+
+void Histogram::Record(uint64_t value)
+{
+    std::atomic<uint64_t>& bucket = m_counts[GetIndex(value)];
+
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_sum.store(m_sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+
+    if (value > m_max.load(std::memory_order_relaxed))
+    {
+        m_max.store(value, std::memory_order_relaxed);
+    }
+}
+
+void Histogram::Merge(const Histogram& other)
+{
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        const uint64_t bucket = other.m_counts[i].load(std::memory_order_relaxed);
+        m_counts[i].store(m_counts[i].load(std::memory_order_relaxed) + bucket, std::memory_order_relaxed);
+        count += bucket;
+    }
+
+    // Counted from the buckets, so percentiles stay consistent while the writer keeps going
+    m_count.store(m_count.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    m_sum.store(m_sum.load(std::memory_order_relaxed) + other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_max.store(std::max(m_max.load(std::memory_order_relaxed), other.m_max.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+}
+
+uint64_t Histogram::GetCount() const
+{
+    return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::GetMax() const
+{
+    return m_max.load(std::memory_order_relaxed);
+}
+
+double Histogram::GetMean() const
+{
+    const uint64_t count = GetCount();
+    return count > 0 ? (double)m_sum.load(std::memory_order_relaxed) / count : 0.0;
+}
+
+uint64_t Histogram::GetPercentile(double fraction) const
+{
+    const uint64_t count = GetCount();
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, 1-based
+    const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(fraction * count + 0.5));
+    uint64_t seen = 0;
+
+    for (size_t i = 0; i < BUCKETS; ++i)
+    {
+        seen += m_counts[i].load(std::memory_order_relaxed);
+
+        if (seen >= rank)
+        {
+            const uint64_t lower = GetLowerBound(i);
+            const uint64_t upper = i + 1 < BUCKETS ? GetLowerBound(i + 1) : UINT64_MAX;
+            return std::min(lower + (upper - lower) / 2, GetMax());
+        }
+    }
+
+    return GetMax();
+}
+
+size_t Histogram::GetIndex(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return (size_t)value;
+    }
+
+    const unsigned exponent = 63 - __builtin_clzll(value);
+    const unsigned shift = exponent - SUB_BUCKET_BITS;
+
+    // The leading bit selects the power of two, the next SUB_BUCKET_BITS the linear sub-bucket
+    return (size_t)(shift + 1) * SUB_BUCKETS + (size_t)((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t Histogram::GetLowerBound(size_t index)
+{
+    if (index < SUB_BUCKETS)
+    {
+        return index;
+    }
+
+    const unsigned shift = (unsigned)(index / SUB_BUCKETS) - 1;
+    return (uint64_t)(SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+}
+
+void JsonWriter::BeginObject(const char* key)
+{
+    AddKey(key);
+    m_text += '{';
+    m_isFirst = true;
+}
+
+void JsonWriter::EndObject()
+{
+    m_text += '}';
+    m_isFirst = false;
+}
+
+void JsonWriter::Add(const char* key, uint64_t value)
+{
+    AddKey(key);
+    m_text += std::to_string(value);
+}
+
+void JsonWriter::Add(const char* key, double value)
+{
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.3f", value);
+
+    AddKey(key);
+    m_text += buffer;
+}
+
+void JsonWriter::Add(const char* key, const std::string& value)
+{
+    AddKey(key);
+    m_text += '"';
+
+    for (char c : value)
+    {
+        if (c == '"' || c == '\\')
+        {
+            m_text += '\\';
+        }
+
+        m_text += c;
+    }
+
+    m_text += '"';
+}
+
+void JsonWriter::Add(const char* key, const Histogram& histogram)
+{
+    BeginObject(key);
+    Add("count", histogram.GetCount());
+    Add("mean_us", histogram.GetMean() / 1000);
+    Add("p50_us", histogram.GetPercentile(0.5) / 1000.0);
+    Add("p90_us", histogram.GetPercentile(0.9) / 1000.0);
+    Add("p99_us", histogram.GetPercentile(0.99) / 1000.0);
+    Add("p999_us", histogram.GetPercentile(0.999) / 1000.0);
+    Add("max_us", histogram.GetMax() / 1000.0);
+    EndObject();
+}
+
+const std::string& JsonWriter::GetText() const
+{
+    return m_text;
+}
+
+void JsonWriter::AddKey(const char* key)
+{
+    if (!m_isFirst)
+    {
+        m_text += ',';
+    }
+
+    m_isFirst = false;
+
+    if (key)
+    {
+        m_text += '"';
+        m_text += key;
+        m_text += "\":";
+    }
+}
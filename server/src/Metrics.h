@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Building blocks of the runtime metrics. Every Counter and Histogram has a single writer thread,
+// so updates are plain relaxed load/store pairs without locked instructions; readers aggregate
+// them on demand and may see a slightly stale value.
+
+inline uint64_t GetMonotonicNanoseconds()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class Counter
+{
+public:
+    void Add(uint64_t value = 1)
+    {
+        m_value.store(m_value.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    uint64_t Get() const
+    {
+        return m_value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> m_value{ 0 };
+};
+
+// Log-linear buckets in the style of HdrHistogram: every power of two is split into 16 linear
+// sub-buckets, so any recorded value is known within 1/16 (6.25%) over the full 64 bit range.
+class Histogram
+{
+public:
+    void Record(uint64_t value);
+
+    // Adds the counts of other, which may be written concurrently; this one must not be
+    void Merge(const Histogram& other);
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    double GetMean() const;
+    // Midpoint of the bucket holding the given fraction (0..1) of the values, 0 when empty
+    uint64_t GetPercentile(double fraction) const;
+
+private:
+    static constexpr unsigned SUB_BUCKET_BITS = 4;
+    static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static size_t GetIndex(uint64_t value);
+    static uint64_t GetLowerBound(size_t index);
+
+    std::atomic<uint64_t> m_counts[BUCKETS] = {};
+    std::atomic<uint64_t> m_count{ 0 };
+    std::atomic<uint64_t> m_sum{ 0 };
+    std::atomic<uint64_t> m_max{ 0 };
+};
+
+// Per-worker protocol metrics, shared by the worker's protocols
+struct ProtocolMetrics
+{
+    // Timing every crc32c would cost as much as the checksum itself, one package in CHECKSUM_SAMPLING is timed
+    static constexpr unsigned CHECKSUM_SAMPLING = 64;
+
+    Counter packagesStored;
+    Counter duplicates;             // packages that were already stored, acknowledged again
+    Counter filesCompleted;
+    Counter acks;                   // ACK datagrams, the final ones with the checksum included
+    Counter sacks;                  // selective ACK datagrams
+    Counter checksumNanoseconds;    // over the sampled packages
+    Counter checksumSamples;
+    Histogram fileCompletion;       // nanoseconds from the first package of a file to its last one
+
+    unsigned checksumCountdown = 1;   // the first package is timed, so short runs report a value too
+};
+
+// Minimal writer for the flat JSON documents of the metrics endpoint
+class JsonWriter
+{
+public:
+    void BeginObject(const char* key = nullptr);
+    void EndObject();
+    void Add(const char* key, uint64_t value);
+    void Add(const char* key, double value);
+    void Add(const char* key, const std::string& value);
+    // p50/p90/p99/p999/max/mean of a nanosecond histogram, in microseconds
+    void Add(const char* key, const Histogram& histogram);
+
+    const std::string& GetText() const;
+
+private:
+    void AddKey(const char* key);
+
+    std::string m_text;
+    bool m_isFirst = true;
+};
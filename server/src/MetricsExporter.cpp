@@ -0,0 +1,180 @@
+#include "MetricsExporter.h"
+#include "Logger.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+    // A scraper that stops reading can't hold the exporter for longer than this
+    constexpr struct timeval SEND_TIMEOUT = { 1, 0 };
+
+    bool WriteAll(int fd, const std::string& text, bool isSocket)
+    {
+        const char* data = text.data();
+        size_t size = text.size();
+
+        while (size > 0)
+        {
+            const ssize_t written = isSocket ? ::send(fd, data, size, MSG_NOSIGNAL) : ::write(fd, data, size);
+
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if (written <= 0)
+            {
+                return false;
+            }
+
+            data += written;
+            size -= written;
+        }
+
+        return true;
+    }
+}
+
+MetricsExporter::MetricsExporter(const std::string& socketPath, const std::string& filePath, std::chrono::milliseconds interval, Snapshot snapshot)
+    : m_socketPath(socketPath)
+    , m_filePath(filePath)
+    , m_interval(interval)
+    , m_snapshot(std::move(snapshot))
+    , m_listenFd(-1)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    Stop();
+}
+
+bool MetricsExporter::Start()
+{
+    if (!m_socketPath.empty())
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+
+        if (m_socketPath.size() >= sizeof(address.sun_path))
+        {
+            LOG_ERROR("Metrics socket path is too long: {}", m_socketPath);
+            return false;
+        }
+
+        memcpy(address.sun_path, m_socketPath.c_str(), m_socketPath.size() + 1);
+
+        m_listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        // A socket left behind by a previous run would make bind fail
+        ::unlink(m_socketPath.c_str());
+
+        if (m_listenFd == -1 || ::bind(m_listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(m_listenFd, 16) != 0)
+        {
+            LOG_ERROR("Can't listen for metrics on {}", m_socketPath);
+            return false;
+        }
+    }
+
+    m_thread = std::thread([this] { ThreadProc(); });
+    return true;
+}
+
+void MetricsExporter::Stop()
+{
+    if (m_thread.joinable())
+    {
+        m_stopEvent.Signal();
+        m_thread.join();
+    }
+
+    if (m_listenFd != -1)
+    {
+        ::close(m_listenFd);
+        ::unlink(m_socketPath.c_str());
+        m_listenFd = -1;
+    }
+}
+
+void MetricsExporter::ThreadProc()
+{
+    auto nextDump = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        int timeout = -1;
+
+        if (!m_filePath.empty())
+        {
+            const auto now = std::chrono::steady_clock::now();
+
+            if (now >= nextDump)
+            {
+                Dump();
+                nextDump = now + m_interval;
+            }
+
+            timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(nextDump - now).count() + 1;
+        }
+
+        pollfd fds[2] = { { m_stopEvent.GetFd(), POLLIN, 0 }, { m_listenFd, POLLIN, 0 } };
+        const int eventsCount = ::poll(fds, m_listenFd != -1 ? 2 : 1, timeout);
+
+        if (eventsCount > 0 && (fds[0].revents & POLLIN))
+        {
+            break;
+        }
+
+        if (eventsCount > 0 && (fds[1].revents & POLLIN))
+        {
+            Serve();
+        }
+    }
+
+    // The final numbers of the run
+    if (!m_filePath.empty())
+    {
+        Dump();
+    }
+}
+
+void MetricsExporter::Serve()
+{
+    const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+
+    if (fd == -1)
+    {
+        return;
+    }
+
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &SEND_TIMEOUT, sizeof(SEND_TIMEOUT));
+    WriteAll(fd, m_snapshot() + "\n", true);
+    ::close(fd);
+}
+
+void MetricsExporter::Dump()
+{
+    const std::string temporaryPath = m_filePath + ".tmp";
+    const int fd = ::open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd == -1)
+    {
+        LOG_ERROR("Can't write metrics to {}", temporaryPath);
+        return;
+    }
+
+    const bool isWritten = WriteAll(fd, m_snapshot() + "\n", false);
+    ::close(fd);
+
+    if (!isWritten || ::rename(temporaryPath.c_str(), m_filePath.c_str()) != 0)
+    {
+        LOG_ERROR("Can't write metrics to {}", m_filePath);
+        ::unlink(temporaryPath.c_str());
+    }
+}
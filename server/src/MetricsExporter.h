@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include "EventFd.h"
+
+// Serves a JSON snapshot to every client connecting to a Unix stream socket
+// (e.g. `socat - UNIX-CONNECT:PATH`) and/or rewrites a file with it periodically.
+// Snapshots are taken on the exporter's own thread, never on the I/O or protocol threads.
+class MetricsExporter
+{
+public:
+    typedef std::function<std::string()> Snapshot;
+
+    // Empty paths disable that output
+    MetricsExporter(const std::string& socketPath, const std::string& filePath, std::chrono::milliseconds interval, Snapshot snapshot);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    bool Start();
+    void Stop();
+
+private:
+    void ThreadProc();
+    void Serve();
+    // Writes a temporary file and renames it, so readers never see a partial document
+    void Dump();
+
+private:
+    std::string m_socketPath;
+    std::string m_filePath;
+    std::chrono::milliseconds m_interval;
+    Snapshot m_snapshot;
+    int m_listenFd;
+    EventFd m_stopEvent;
+    std::thread m_thread;
+};
@@ -0,0 +1,161 @@
+#include "PacketPool.h"
+#include <cassert>
+
+namespace
+{
+    constexpr size_t SLAB_BLOCKS = 1024;   // blocks allocated at once when the pool is empty
+    constexpr size_t TRANSFER_BATCH = 256; // blocks moved between a thread cache and the global list
+}
+
+struct PacketPool::ThreadCache
+{
+    explicit ThreadCache(PacketPool& pool)
+        : pool(pool)
+    {
+        blocks.reserve(2 * TRANSFER_BATCH);
+    }
+
+    ~ThreadCache()
+    {
+        pool.Drain(blocks, blocks.size());
+    }
+
+    PacketPool& pool;
+    std::vector<char*> blocks;
+};
+
+PacketPool& PacketPool::Instance()
+{
+    static PacketPool pool;
+    return pool;
+}
+
+PacketPool::ThreadCache& PacketPool::GetThreadCache()
+{
+    thread_local ThreadCache cache(*this);
+    return cache;
+}
+
+char* PacketPool::Allocate()
+{
+    auto& cache = GetThreadCache();
+
+    if (cache.blocks.empty())
+    {
+        Refill(cache.blocks);
+    }
+
+    char* block = cache.blocks.back();
+    cache.blocks.pop_back();
+
+    return block;
+}
+
+void PacketPool::Release(char* block)
+{
+    auto& cache = GetThreadCache();
+    cache.blocks.push_back(block);
+
+    if (cache.blocks.size() >= 2 * TRANSFER_BATCH)
+    {
+        Drain(cache.blocks, TRANSFER_BATCH);
+    }
+}
+
+void PacketPool::Refill(std::vector<char*>& blocks)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_free.size() < TRANSFER_BATCH)
+    {
+        m_slabs.emplace_back(new char[SLAB_BLOCKS * BLOCK_SIZE]);
+
+        for (size_t i = 0; i < SLAB_BLOCKS; ++i)
+        {
+            m_free.push_back(m_slabs.back().get() + i * BLOCK_SIZE);
+        }
+    }
+
+    blocks.insert(blocks.end(), m_free.end() - TRANSFER_BATCH, m_free.end());
+    m_free.resize(m_free.size() - TRANSFER_BATCH);
+}
+
+void PacketPool::Drain(std::vector<char*>& blocks, size_t count)
+{
+    assert(count <= blocks.size());
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_free.insert(m_free.end(), blocks.end() - count, blocks.end());
+    blocks.resize(blocks.size() - count);
+}
+
+
+PacketBuffer::PacketBuffer(PacketBuffer&& other) noexcept
+    : m_data(other.m_data)
+    , m_size(other.m_size)
+{
+    other.m_data = nullptr;
+    other.m_size = 0;
+}
+
+PacketBuffer& PacketBuffer::operator=(PacketBuffer&& other) noexcept
+{
+    if (this != &other)
+    {
+        Release();
+        m_data = other.m_data;
+        m_size = other.m_size;
+        other.m_data = nullptr;
+        other.m_size = 0;
+    }
+
+    return *this;
+}
+
+PacketBuffer::~PacketBuffer()
+{
+    Release();
+}
+
+PacketBuffer PacketBuffer::Allocate()
+{
+    PacketBuffer buffer;
+    buffer.m_data = PacketPool::Instance().Allocate();
+    return buffer;
+}
+
+bool PacketBuffer::IsSet() const
+{
+    return m_data != nullptr;
+}
+
+char* PacketBuffer::GetData()
+{
+    return m_data;
+}
+
+const char* PacketBuffer::GetData() const
+{
+    return m_data;
+}
+
+size_t PacketBuffer::GetSize() const
+{
+    return m_size;
+}
+
+void PacketBuffer::SetSize(size_t size)
+{
+    assert(size <= GetCapacity());
+    m_size = size;
+}
+
+void PacketBuffer::Release()
+{
+    if (m_data)
+    {
+        PacketPool::Instance().Release(m_data);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Slab allocator for datagram-sized blocks, shared by the receive path and the request queue.
+// Every thread keeps a small cache of free blocks; blocks freed by another thread than the one
+// that allocated them flow back through the global free list in batches, so in steady state
+// a packet costs no malloc and only an occasional lock.
+class PacketPool
+{
+public:
+    static constexpr size_t BLOCK_SIZE = 1472;
+
+    static PacketPool& Instance();
+
+    char* Allocate();
+    void Release(char* block);
+
+private:
+    struct ThreadCache;
+    friend struct ThreadCache;
+
+    PacketPool() = default;
+
+    ThreadCache& GetThreadCache();
+    void Refill(std::vector<char*>& blocks);
+    void Drain(std::vector<char*>& blocks, size_t count);
+
+private:
+    std::mutex m_lock;
+    std::vector<char*> m_free;
+    std::vector<std::unique_ptr<char[]>> m_slabs;
+};
+
+// Owning handle to one pool block and the number of bytes used in it
+class PacketBuffer
+{
+public:
+    PacketBuffer() = default;
+    PacketBuffer(PacketBuffer&& other) noexcept;
+    PacketBuffer& operator=(PacketBuffer&& other) noexcept;
+    PacketBuffer(const PacketBuffer&) = delete;
+    PacketBuffer& operator=(const PacketBuffer&) = delete;
+    ~PacketBuffer();
+
+    static PacketBuffer Allocate();
+
+    bool IsSet() const;
+    char* GetData();
+    const char* GetData() const;
+    size_t GetSize() const;
+    void SetSize(size_t size);
+    static constexpr size_t GetCapacity() { return PacketPool::BLOCK_SIZE; }
+
+private:
+    void Release();
+
+private:
+    char* m_data = nullptr;
+    size_t m_size = 0;
+};
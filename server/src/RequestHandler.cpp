@@ -1,26 +1,69 @@
 #include "RequestHandler.h"
 #include "DefaultProtocol.h"
 #include <algorithm>
+#include <cstring>
 #include <numeric>
 
-
-bool RequestHandler::ClientInfo::operator<(const RequestHandler::ClientInfo& other) const
+namespace
 {
-    return port < other.port || (port == other.port && address < other.address);
+    constexpr size_t PROCESS_BATCH_SIZE = 256;
+    constexpr std::chrono::milliseconds EXPIRY_INTERVAL(100);
+
+    // Offset of the 8 byte file id in the packet header: seq_number, seq_total, type
+    constexpr size_t ID_OFFSET = sizeof(unsigned) + sizeof(unsigned) + sizeof(unsigned char);
+    constexpr size_t ID_SIZE = 8;
 }
 
-RequestHandler::Request::Request(ClientInfo&& clientInfo, Buffer&& data)
-    : clientInfo(std::move(clientInfo))
+RequestHandler::Request::Request(const Endpoint& endpoint, PacketBuffer&& data, uint64_t enqueueTime)
+    : endpoint(endpoint)
     , data(std::move(data))
+    , enqueueTime(enqueueTime)
 {
 }
 
-RequestHandler::RequestHandler()
-    : m_stop(false)
-    , m_hasResponses(false)
-    , m_eventFlag(false)
+RequestHandler::Worker::Worker(const ServerConfig& config)
+    : requests(config.requestQueueSize)
+    , requestsProcessed(0)
+    , requestsDropped(0)
+    , protocolsCount(0)
+    , filesExpired(0)
+    , submitPending(false)
+    , parked(false)
+    , eventFlag(false)
+    , timers(std::chrono::milliseconds(config.idleTimeout))
 {
-    m_thread = std::thread([this] { ThreadProc(); });
+    budget.policy = config.budgetPolicy;
+    budget.peerQuota = (uint64_t)config.peerQuota << 20;
+    budget.fileQuota = (uint64_t)config.fileQuota << 20;
+}
+
+RequestHandler::RequestHandler(const ServerConfig& config, IDataSink* sink, IFileStore* store, MemoryBudget* budget)
+    : m_sink(sink)
+    , m_store(store)
+    , m_budget(budget)
+    , m_ackPolicy{ std::max(config.ackEvery, 1u), config.ackDelay }
+    , m_stop(false)
+    , m_batchTime(0)
+    , m_responses(config.responseQueueSize)
+    , m_responsesFull(0)
+    , m_responsesSignaled(false)
+{
+    const unsigned workers = std::max(config.workers, 1u);
+
+    for (unsigned i = 0; i < workers; ++i)
+    {
+        m_workers.push_back(std::make_unique<Worker>(config));
+
+        Worker* workerPtr = m_workers.back().get();
+        workerPtr->budget.global = budget;
+        workerPtr->budget.evict = [this, workerPtr](const FileBudget::AdmittedFile& file) { EvictFile(*workerPtr, file); };
+    }
+
+    for (auto& worker : m_workers)
+    {
+        Worker* workerPtr = worker.get();
+        worker->thread = std::thread([this, workerPtr] { ThreadProc(*workerPtr); });
+    }
 }
 
 RequestHandler::~RequestHandler()
@@ -31,106 +74,406 @@ RequestHandler::~RequestHandler()
 void RequestHandler::Stop()
 {
     m_stop = true;
-    SetEvent();
 
-    if (m_thread.joinable())
+    for (auto& worker : m_workers)
     {
-        m_thread.join();
+        WakeUp(*worker);
+    }
+
+    for (auto& worker : m_workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
     }
 }
 
-void RequestHandler::AddRequest(const std::string& clientAddress, unsigned short clientPort, std::vector<char>&& data)
+size_t RequestHandler::GetWorkerIndex(const Endpoint& client, const PacketBuffer& data) const
 {
+    if (m_workers.size() == 1)
+    {
+        return 0;
+    }
+
+    uint64_t hash;
+
+    if (data.GetSize() >= ID_OFFSET + ID_SIZE)
     {
-        std::lock_guard<std::mutex> lock(m_requestsLock);
-        m_requests.emplace_back(ClientInfo{ clientAddress, clientPort }, std::move(data));
+        // Multiplicative hash of the id; its high bits are independent of the SO_REUSEPORT steering,
+        // which uses the low bits of a different mix
+        memcpy(&hash, data.GetData() + ID_OFFSET, ID_SIZE);
+        hash *= 0x9e3779b97f4a7c15ULL;
+    }
+    else
+    {
+        hash = EndpointHash()(client);
     }
 
-    SetEvent();
+    return (size_t)(((hash >> 32) * m_workers.size()) >> 32);
 }
 
-std::list<std::pair<RequestHandler::ClientInfo, RequestHandler::Buffer>> RequestHandler::GetResponses()
+bool RequestHandler::AddRequest(const Endpoint& client, PacketBuffer&& data)
 {
-    std::list<std::pair<ClientInfo, Buffer>> responses;
-    std::lock_guard<std::mutex> lock(m_responsesLock);
+    Worker& worker = *m_workers[GetWorkerIndex(client, data)];
 
-    if (!m_responses.empty())
+    if (m_batchTime == 0)
     {
-        m_responses.swap(responses);
+        m_batchTime = GetMonotonicNanoseconds();
     }
 
-    m_hasResponses = false;
+    Request request(client, std::move(data), m_batchTime);
+
+    if (!worker.requests.TryPush(std::move(request)))
+    {
+        worker.requestsDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
 
-    return responses;
+    worker.submitPending = true;
+    return true;
 }
 
-bool RequestHandler::HasResponses()
+void RequestHandler::SubmitRequests()
 {
-    return m_hasResponses;
+    m_batchTime = 0;
+
+    // Pairs with the fence in WaitForRequests: either we see parked or the worker sees the new requests
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    for (auto& worker : m_workers)
+    {
+        if (worker->submitPending)
+        {
+            worker->submitPending = false;
+
+            if (worker->parked.load(std::memory_order_relaxed))
+            {
+                WakeUp(*worker);
+            }
+        }
+    }
 }
 
-void RequestHandler::ThreadProc()
+void RequestHandler::GetResponses(Responses& responses)
 {
-    while (!m_stop)
+    responses.clear();
+
+    // Clear the flag before draining: responses pushed after this point signal the eventfd again
+    if (m_responsesSignaled.exchange(false))
     {
-        WaitForEvent();
-        Process();
+        m_responsesEvent.Reset();
     }
+
+    std::pair<Endpoint, Response> response;
+
+    while (m_responses.TryPop(response))
+    {
+        responses.push_back(response);
+    }
+}
+
+bool RequestHandler::HasResponses() const
+{
+    return !m_responses.IsEmpty();
+}
+
+int RequestHandler::GetResponsesEventFd() const
+{
+    return m_responsesEvent.GetFd();
 }
 
-void RequestHandler::Process()
+RequestHandler::Statistics RequestHandler::GetStatistics() const
 {
-    std::list<Request> requests;
+    Statistics statistics{ 0, m_responsesFull.load(std::memory_order_relaxed), 0, m_responses.GetSize(), 0, 0, 0,
+        m_budget ? m_budget->GetUsed() : 0, m_budget ? m_budget->GetLimit() : 0, {} };
 
+    for (const auto& worker : m_workers)
     {
-        std::lock_guard<std::mutex> lock(m_requestsLock);
-        m_requests.swap(requests);
+        const WorkerStatistics workerStatistics{
+            worker->requestsProcessed.load(std::memory_order_relaxed),
+            worker->requestsDropped.load(std::memory_order_relaxed),
+            worker->requests.GetSize(),
+            worker->protocolsCount.load(std::memory_order_relaxed),
+            worker->filesExpired.load(std::memory_order_relaxed),
+            worker->budget.filesRefused.load(std::memory_order_relaxed),
+            worker->budget.filesEvicted.load(std::memory_order_relaxed),
+            worker->budget.packagesRefused.load(std::memory_order_relaxed),
+            worker->metrics.packagesStored.Get(),
+            worker->metrics.duplicates.Get(),
+            worker->metrics.filesCompleted.Get(),
+            worker->metrics.acks.Get(),
+            worker->metrics.sacks.Get(),
+            worker->metrics.checksumNanoseconds.Get(),
+            worker->metrics.checksumSamples.Get()
+        };
+
+        statistics.requestsDropped += workerStatistics.requestsDropped;
+        statistics.requestsQueued += workerStatistics.requestsQueued;
+        statistics.filesRefused += workerStatistics.filesRefused;
+        statistics.filesEvicted += workerStatistics.filesEvicted;
+        statistics.packagesRefused += workerStatistics.packagesRefused;
+        statistics.workers.push_back(workerStatistics);
     }
 
-    for (auto& request : requests)
+    return statistics;
+}
+
+void RequestHandler::CollectHistograms(Histogram& fileCompletion, Histogram& requestSojourn) const
+{
+    for (const auto& worker : m_workers)
     {
-        auto& protocol = m_protocols[request.clientInfo];
-        if (!protocol)
+        fileCompletion.Merge(worker->metrics.fileCompletion);
+        requestSojourn.Merge(worker->requestSojourn);
+    }
+}
+
+void RequestHandler::ThreadProc(Worker& worker)
+{
+    while (!m_stop)
+    {
+        ExpireFiles(worker);
+        EvictForOthers(worker);
+
+        if (!Process(worker))
         {
-            protocol = std::make_unique<DefaultProtocol>();
+            // Held acknowledgments must not wait for the next request
+            if (!worker.pendingAcks.empty())
+            {
+                FlushAcks(worker, GetMonotonicNanoseconds());
+                SignalResponses();
+            }
+
+            WaitForRequests(worker);
         }
+    }
+}
 
-        auto response = protocol->Process(request.data);
+void RequestHandler::ExpireFiles(Worker& worker)
+{
+    // The only clock read per batch; protocols take the time from the wheel
+    const uint64_t now = FileTimers::ToTicks(std::chrono::steady_clock::now());
+
+    worker.timers.wheel.Advance(now, [&](const FileTimer& timer)
+    {
+        auto* protocol = worker.protocols.Find(timer.endpoint);
 
-        if (!response.empty())
+        if (protocol && (*protocol)->OnTimer(timer))
         {
-            std::lock_guard<std::mutex> lock(m_responsesLock);
-            m_responses.emplace_back(request.clientInfo, std::move(response));
-            m_hasResponses = true;
+            worker.filesExpired.fetch_add(1, std::memory_order_relaxed);
+
+            if ((*protocol)->IsEmpty())
+            {
+                worker.protocols.Erase(timer.endpoint);
+            }
         }
+    });
+
+    worker.protocolsCount.store(worker.protocols.GetSize(), std::memory_order_relaxed);
+}
+
+void RequestHandler::EvictForOthers(Worker& worker)
+{
+    // One file per batch; workers with files wake up at least once per expiry interval, so requests don't wait for packages
+    if (m_budget && !worker.budget.files.empty() && m_budget->TakeEviction())
+    {
+        const FileBudget::AdmittedFile file = worker.budget.files.begin()->second;
+
+        EvictFile(worker, file);
+        worker.budget.filesEvicted.fetch_add(1, std::memory_order_relaxed);
     }
+}
 
-    for (auto it = m_protocols.begin(); it != m_protocols.end();)
+void RequestHandler::EvictFile(Worker& worker, const FileBudget::AdmittedFile& file)
+{
+    // Only called for files of other peers than the one being processed
+    auto* protocol = worker.protocols.Find(file.endpoint);
+
+    if (protocol)
     {
-        if (it->second && (it->second->IsEmpty() || it->second->IsExpired()))
+        (*protocol)->Evict(file.fileId);
+
+        if ((*protocol)->IsEmpty())
         {
-            it = m_protocols.erase(it);
+            worker.protocols.Erase(file.endpoint);
         }
-        else
+    }
+}
+
+bool RequestHandler::Process(Worker& worker)
+{
+    Request request;
+    Response response;
+    size_t processed = 0;
+    uint64_t batchStart = 0;
+
+    for (; processed < PROCESS_BATCH_SIZE && worker.requests.TryPop(request); ++processed)
+    {
+        // One clock read per batch: the sojourn is measured until the worker takes the batch
+        if (batchStart == 0)
+        {
+            batchStart = GetMonotonicNanoseconds();
+        }
+
+        worker.requestSojourn.Record(batchStart > request.enqueueTime ? batchStart - request.enqueueTime : 0);
+
+        auto& slot = worker.protocols[request.endpoint];
+        if (!slot)
+        {
+            slot = std::make_unique<DefaultProtocol>(m_sink, &worker.timers, request.endpoint, m_store, &worker.budget, &worker.metrics,
+                m_ackPolicy);
+        }
+
+        // Evictions erase other peers and may move the slot, the protocol itself stays put
+        IProtocol* protocol = slot.get();
+        const bool hadPendingAcks = protocol->HasPendingAcks();
+        protocol->Process(request.data.GetData(), request.data.GetSize(), response);
+
+        if (protocol->IsAckDue())
+        {
+            FlushAcks(request.endpoint, *protocol);
+        }
+        else if (!hadPendingAcks && protocol->HasPendingAcks())
+        {
+            // The delay runs from the first acknowledgment held back since the last flush
+            if (worker.pendingAcks.empty())
+            {
+                worker.ackDeadline = batchStart + (uint64_t)m_ackPolicy.delay * 1000;
+            }
+
+            worker.pendingAcks.push_back(request.endpoint);
+        }
+
+        // A peer without files in progress costs nothing until its next package
+        if (protocol->IsEmpty())
         {
-            ++it;
+            worker.protocols.Erase(request.endpoint);
         }
+
+        // Returns the buffer to the pool
+        request.data = PacketBuffer();
+
+        if (response.size > 0)
+        {
+            PushResponse(request.endpoint, response);
+        }
+    }
+
+    if (processed == 0)
+    {
+        return false;
     }
+
+    FlushAcks(worker, batchStart);
+    SignalResponses();
+
+    worker.requestsProcessed.fetch_add(processed, std::memory_order_relaxed);
+    worker.protocolsCount.store(worker.protocols.GetSize(), std::memory_order_relaxed);
+
+    return true;
 }
 
-void RequestHandler::SetEvent()
+void RequestHandler::FlushAcks(Worker& worker, uint64_t now)
 {
+    if (worker.pendingAcks.empty() || (m_ackPolicy.delay != 0 && now < worker.ackDeadline))
     {
-        std::lock_guard<std::mutex> lock(m_eventLock);
-        m_eventFlag = true;
+        return;
     }
 
-    m_eventCondition.notify_all();
+    // A peer stays until its held ACKs went out, the ones of its last file too
+    for (const Endpoint& endpoint : worker.pendingAcks)
+    {
+        auto* protocol = worker.protocols.Find(endpoint);
+
+        if (protocol)
+        {
+            FlushAcks(endpoint, **protocol);
+
+            if ((*protocol)->IsEmpty())
+            {
+                worker.protocols.Erase(endpoint);
+            }
+        }
+    }
+
+    worker.pendingAcks.clear();
 }
 
-void RequestHandler::WaitForEvent()
+void RequestHandler::FlushAcks(const Endpoint& client, IProtocol& protocol)
 {
-    std::unique_lock<std::mutex> lock(m_eventLock);
-    m_eventCondition.wait(lock, [&] { return m_eventFlag; });
-    m_eventFlag = false;
+    Response response;
+
+    while (protocol.FlushAck(response))
+    {
+        PushResponse(client, response);
+    }
+}
+
+void RequestHandler::PushResponse(const Endpoint& client, const Response& response)
+{
+    std::pair<Endpoint, Response> item(client, response);
+
+    if (m_responses.TryPush(std::move(item)))
+    {
+        return;
+    }
+
+    // ACKs are not dropped: the I/O thread drains the ring independently, so waiting here is bounded
+    m_responsesFull.fetch_add(1, std::memory_order_relaxed);
+    SignalResponses();
+
+    while (!m_stop && !m_responses.TryPush(std::move(item)))
+    {
+        std::this_thread::yield();
+    }
+}
+
+void RequestHandler::SignalResponses()
+{
+    if (!m_responses.IsEmpty() && !m_responsesSignaled.exchange(true))
+    {
+        m_responsesEvent.Signal();
+    }
+}
+
+void RequestHandler::WaitForRequests(Worker& worker)
+{
+    std::unique_lock<std::mutex> lock(worker.eventLock);
+
+    worker.parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (worker.requests.IsEmpty() && !m_stop)
+    {
+        // Partial files need the clock to move even when no packages arrive, held acknowledgments their deadline
+        if (worker.timers.wheel.IsEmpty() && worker.pendingAcks.empty())
+        {
+            worker.eventCondition.wait(lock, [&] { return worker.eventFlag; });
+        }
+        else
+        {
+            std::chrono::nanoseconds timeout = EXPIRY_INTERVAL;
+
+            if (!worker.pendingAcks.empty())
+            {
+                const uint64_t now = GetMonotonicNanoseconds();
+                timeout = std::min(timeout, std::chrono::nanoseconds(worker.ackDeadline > now ? worker.ackDeadline - now : 0));
+            }
+
+            worker.eventCondition.wait_for(lock, timeout, [&] { return worker.eventFlag; });
+        }
+    }
+
+    worker.eventFlag = false;
+    worker.parked.store(false, std::memory_order_relaxed);
+}
+
+void RequestHandler::WakeUp(Worker& worker)
+{
+    {
+        std::lock_guard<std::mutex> lock(worker.eventLock);
+        worker.eventFlag = true;
+    }
+
+    worker.eventCondition.notify_one();
 }
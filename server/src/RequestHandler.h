@@ -2,67 +2,167 @@
 
 #include <string>
 #include <vector>
-#include <list>
 #include <thread>
 #include <atomic>
 #include <mutex>
-#include <map>
 #include <memory>
 #include <condition_variable>
 
 #include "IProtocol.h"
+#include "IDataSink.h"
+#include "IFileStore.h"
+#include "UdpSocket.h"
+#include "PacketPool.h"
+#include "Ring.h"
+#include "ServerConfig.h"
+#include "EventFd.h"
+#include "FlatHashMap.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
 
 class RequestHandler
 {
 public:
-    typedef std::vector<char> Buffer;
+    typedef std::vector<std::pair<Endpoint, Response>> Responses;
 
-    struct ClientInfo
+    struct WorkerStatistics
     {
-        std::string address;
-        unsigned short port;
+        uint64_t requestsProcessed;
+        uint64_t requestsDropped;   // requests rejected because the worker's request ring was full
+        size_t requestsQueued;
+        size_t protocols;           // peers with files in progress on this worker
+        uint64_t filesExpired;      // partial files dropped after the idle timeout
+        uint64_t filesRefused;      // packages refused because they would start a file over the budget or a quota,
+                                    // and files dropped by the file quota
+        uint64_t filesEvicted;      // partial files dropped to make room for others
+        uint64_t packagesRefused;   // packages left unacknowledged because memory was exhausted
+        uint64_t packagesStored;
+        uint64_t duplicates;        // packages received again after they were stored
+        uint64_t filesCompleted;
+        uint64_t acks;              // ACK datagrams, final ones included
+        uint64_t sacks;             // selective ACK datagrams
+        uint64_t checksumNanoseconds;
+        uint64_t checksumSamples;   // packages whose checksum was timed
+    };
 
-        bool operator<(const ClientInfo& other) const;
+    struct Statistics
+    {
+        uint64_t requestsDropped;   // sum over the workers
+        uint64_t responsesFull;     // times a worker had to wait for room in the response ring
+        size_t requestsQueued;
+        size_t responsesQueued;
+        uint64_t filesRefused;      // sums over the workers
+        uint64_t filesEvicted;
+        uint64_t packagesRefused;
+        uint64_t memoryUsed;        // bytes of partial files, over all handlers
+        uint64_t memoryLimit;
+        std::vector<WorkerStatistics> workers;
     };
 
 private:
     struct Request
     {
-        Request(ClientInfo&& clientInfo, Buffer&& data);
-        ClientInfo clientInfo;
-        Buffer data;
+        Request() = default;
+        Request(const Endpoint& endpoint, PacketBuffer&& data, uint64_t enqueueTime);
+        Endpoint endpoint;
+        PacketBuffer data;
+        uint64_t enqueueTime = 0;   // monotonic nanoseconds of the received batch
+    };
+
+    // One protocol thread with its own request ring. Every file is routed to a single worker by its id,
+    // so a worker's protocols only ever see their own files and share nothing with the other workers.
+    struct Worker
+    {
+        explicit Worker(const ServerConfig& config);
+
+        SpscRing<Request> requests;
+        std::atomic<uint64_t> requestsProcessed;
+        std::atomic<uint64_t> requestsDropped;
+        std::atomic<size_t> protocolsCount;
+        std::atomic<uint64_t> filesExpired;
+
+        // Set by AddRequest, cleared by SubmitRequests; only touched by the I/O thread
+        bool submitPending;
+
+        // The worker only sleeps on the condition variable when parked is set,
+        // so producers signal it only in that case
+        std::atomic_bool parked;
+        std::mutex eventLock;
+        std::condition_variable eventCondition;
+        bool eventFlag;
+
+        // Declared before the protocols, which release their files into them when destroyed
+        FileTimers timers;
+        FileBudget budget;
+        ProtocolMetrics metrics;
+        Histogram requestSojourn;   // nanoseconds from the received batch until the worker takes the request
+        FlatHashMap<Endpoint, std::unique_ptr<IProtocol>, EndpointHash> protocols;
+        std::vector<Endpoint> pendingAcks;  // peers whose protocols hold acknowledgments back
+        uint64_t ackDeadline = 0;           // when they go out with AckPolicy::delay, monotonic nanoseconds
+        std::thread thread;
     };
 
 public:
-    RequestHandler();
+    // The memory budget may be shared by several handlers, without it memory is unlimited
+    explicit RequestHandler(const ServerConfig& config = ServerConfig(), IDataSink* sink = nullptr, IFileStore* store = nullptr,
+        MemoryBudget* budget = nullptr);
     ~RequestHandler();
 
     void Stop();
 
-    void AddRequest(const std::string& clientAddress, unsigned short clientPort, std::vector<char>&& data);
-    std::list<std::pair<ClientInfo, Buffer>> GetResponses();
-    bool HasResponses();
+    // Producer side, called by one I/O thread. AddRequest only queues the request on its worker and
+    // returns false when that worker's ring is full; SubmitRequests wakes the parked workers that got
+    // new requests and is meant to be called once per received batch.
+    bool AddRequest(const Endpoint& client, PacketBuffer&& data);
+    void SubmitRequests();
+
+    // Consumer side of the responses, called by the same I/O thread. Previous content of
+    // `responses` is dropped, its capacity is reused.
+    void GetResponses(Responses& responses);
+    bool HasResponses() const;
+
+    // Becomes readable (edge-triggered) after new responses were queued while the I/O thread
+    // had already taken everything out with GetResponses
+    int GetResponsesEventFd() const;
+
+    Statistics GetStatistics() const;
+    // Adds the histograms of all workers
+    void CollectHistograms(Histogram& fileCompletion, Histogram& requestSojourn) const;
 
 private:
-    void ThreadProc();
-    void Process();
-    void SetEvent();
-    void WaitForEvent();
+    size_t GetWorkerIndex(const Endpoint& client, const PacketBuffer& data) const;
+
+    void ThreadProc(Worker& worker);
+    bool Process(Worker& worker);
+    void ExpireFiles(Worker& worker);
+    // Evicts the worker's oldest file while another worker asks for memory it can't free itself
+    void EvictForOthers(Worker& worker);
+    void EvictFile(Worker& worker, const FileBudget::AdmittedFile& file);
+    // Sends what the worker's protocols hold back, when the delay of the policy passed at `now`
+    void FlushAcks(Worker& worker, uint64_t now);
+    void FlushAcks(const Endpoint& client, IProtocol& protocol);
+    void PushResponse(const Endpoint& client, const Response& response);
+    void SignalResponses();
+    void WaitForRequests(Worker& worker);
+    void WakeUp(Worker& worker);
 
 private:
-    std::thread m_thread;
+    IDataSink* m_sink;
+    IFileStore* m_store;
+    MemoryBudget* m_budget;
+    AckPolicy m_ackPolicy;
     std::atomic_bool m_stop;
 
-    std::mutex m_requestsLock;
-    std::list<Request> m_requests;
+    std::vector<std::unique_ptr<Worker>> m_workers;
 
-    std::mutex m_responsesLock;
-    std::list<std::pair<ClientInfo, Buffer>> m_responses;
-    std::atomic_bool m_hasResponses;
+    // Time of the batch being added, read once per batch by AddRequest; only touched by the I/O thread
+    uint64_t m_batchTime;
 
-    std::mutex m_eventLock;
-    std::condition_variable m_eventCondition;
-    bool m_eventFlag;
+    MpscRing<std::pair<Endpoint, Response>> m_responses;
+    std::atomic<uint64_t> m_responsesFull;
 
-    std::map<ClientInfo, std::unique_ptr<IProtocol>> m_protocols;
+    // Set from the first response after GetResponses until the next GetResponses,
+    // so the eventfd is written at most once per drain
+    EventFd m_responsesEvent;
+    std::atomic_bool m_responsesSignaled;
 };
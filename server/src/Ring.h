@@ -0,0 +1,199 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free queues for handing packets between threads. Capacity is rounded up to a power of two.
+// TryPush never moves from the item when the queue is full.
+
+inline size_t RoundUpToPowerOfTwo(size_t value)
+{
+    size_t result = 1;
+
+    while (result < value)
+    {
+        result <<= 1;
+    }
+
+    return result;
+}
+
+// Single producer, single consumer
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+        : m_mask(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity) - 1)
+        , m_items(new T[m_mask + 1])
+    {
+    }
+
+    // Producer side
+    bool TryPush(T&& item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail - m_cachedHead > m_mask)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+
+            if (tail - m_cachedHead > m_mask)
+            {
+                return false;
+            }
+        }
+
+        m_items[tail & m_mask] = std::move(item);
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side
+    bool TryPop(T& item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+
+            if (head == m_cachedTail)
+            {
+                return false;
+            }
+        }
+
+        item = std::move(m_items[head & m_mask]);
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Approximate when called concurrently with TryPush/TryPop
+    size_t GetSize() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        return m_tail.load(std::memory_order_acquire) - head;
+    }
+
+    bool IsEmpty() const
+    {
+        return GetSize() == 0;
+    }
+
+    size_t GetCapacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    size_t m_cachedTail = 0; // consumer's copy of m_tail
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    size_t m_cachedHead = 0; // producer's copy of m_head
+    alignas(64) const size_t m_mask;
+    std::unique_ptr<T[]> m_items;
+};
+
+// Multiple producers, single consumer. Slots carry sequence numbers (D. Vyukov's bounded queue),
+// so producers only contend on one compare-and-swap of the tail.
+template <typename T>
+class MpscRing
+{
+public:
+    explicit MpscRing(size_t capacity)
+        : m_mask(RoundUpToPowerOfTwo(capacity < 2 ? 2 : capacity) - 1)
+        , m_slots(new Slot[m_mask + 1])
+    {
+        for (size_t i = 0; i <= m_mask; ++i)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Any thread
+    bool TryPush(T&& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        for (;;)
+        {
+            slot = &m_slots[tail & m_mask];
+            const intptr_t difference = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)tail;
+
+            if (difference == 0)
+            {
+                if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                tail = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->item = std::move(item);
+        slot->sequence.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Consumer side
+    bool TryPop(T& item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[head & m_mask];
+
+        if ((intptr_t)slot.sequence.load(std::memory_order_acquire) - (intptr_t)(head + 1) < 0)
+        {
+            return false;
+        }
+
+        item = std::move(slot.item);
+        slot.sequence.store(head + m_mask + 1, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Approximate when called concurrently with TryPush/TryPop
+    size_t GetSize() const
+    {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool IsEmpty() const
+    {
+        return GetSize() == 0;
+    }
+
+    size_t GetCapacity() const
+    {
+        return m_mask + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    alignas(64) std::atomic<size_t> m_head{ 0 };
+    alignas(64) std::atomic<size_t> m_tail{ 0 };
+    alignas(64) const size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+};
@@ -0,0 +1,235 @@
+#include "ServerConfig.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+namespace
+{
+    bool ParseUnsigned(const char* value, unsigned long long maxValue, unsigned long long& result)
+    {
+        char* end = nullptr;
+        errno = 0;
+        result = strtoull(value, &end, 10);
+
+        return errno == 0 && end != value && *end == '\0' && result <= maxValue;
+    }
+
+    void PrintUsage(const char* program)
+    {
+        printf("Usage: %s [options]\n"
+            "  --address=ADDR   address to bind (default 127.0.0.1)\n"
+            "  --port=PORT      port to bind (default 8865)\n"
+            "  --sockets=N      number of SO_REUSEPORT sockets/I/O threads (default 1)\n"
+            "  --io=epoll|uring I/O backend (default epoll)\n"
+            "  --workers=N      protocol worker threads per socket (default 1)\n"
+            "  --output-dir=DIR stream received files into DIR as they arrive\n"
+            "  --store=memory|pwrite|mmap|direct\n"
+            "                   reassemble files in memory (default) or in place in the output dir\n"
+            "  --memory-budget=MB, --peer-quota=MB, --file-quota=MB\n"
+            "                   memory of partial files in total (default 1024), per peer and per file; 0 is unlimited\n"
+            "  --over-budget=drop-new|evict-oldest|stop-acks\n"
+            "                   what to do with packages beyond the budget (default drop-new)\n"
+            "  --metrics-socket=PATH  serve JSON metrics to every connection on a Unix socket\n"
+            "  --metrics-file=PATH    rewrite PATH with JSON metrics periodically\n"
+            "  --metrics-interval=MS  period of --metrics-file (default 1000)\n"
+            "  --idle-timeout=MS drop a partial file after MS without packages (default 10000)\n"
+            "  --ack-every=N, --ack-delay=US\n"
+            "                   hold ACKs back until N are due or US microseconds passed (default 16 and 0)\n"
+            "  --request-queue=N, --response-queue=N\n"
+            "                   capacity of the request/response rings (default 8192)\n"
+            "  --log-level=debug|info|warning|error\n"
+            "                   lowest level logged, debug adds a line per package (default info)\n",
+            program);
+    }
+}
+
+bool ParseArguments(int argc, char** argv, ServerConfig& config)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const char* argument = argv[i];
+        const char* value = strchr(argument, '=');
+        const std::string name = value ? std::string(argument, value - argument) : std::string(argument);
+        value = value ? value + 1 : "";
+
+        unsigned long long number = 0;
+        bool isValid = true;
+
+        if (name == "--help")
+        {
+            PrintUsage(argv[0]);
+            return false;
+        }
+        else if (name == "--address")
+        {
+            config.address = value;
+        }
+        else if (name == "--port")
+        {
+            isValid = ParseUnsigned(value, 65535, number) && number > 0;
+            config.port = (unsigned short)number;
+        }
+        else if (name == "--log-level")
+        {
+            if (strcmp(value, "debug") == 0)
+            {
+                config.logLevel = LogLevel::Debug;
+            }
+            else if (strcmp(value, "info") == 0)
+            {
+                config.logLevel = LogLevel::Info;
+            }
+            else if (strcmp(value, "warning") == 0)
+            {
+                config.logLevel = LogLevel::Warning;
+            }
+            else if (strcmp(value, "error") == 0)
+            {
+                config.logLevel = LogLevel::Error;
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        else if (name == "--sockets")
+        {
+            isValid = ParseUnsigned(value, 256, number) && number > 0;
+            config.sockets = (unsigned)number;
+        }
+        else if (name == "--io")
+        {
+            isValid = strcmp(value, "epoll") == 0 || strcmp(value, "uring") == 0;
+            config.ioBackend = strcmp(value, "uring") == 0 ? IoBackend::Uring : IoBackend::Epoll;
+        }
+        else if (name == "--workers")
+        {
+            isValid = ParseUnsigned(value, 256, number) && number > 0;
+            config.workers = (unsigned)number;
+        }
+        else if (name == "--request-queue")
+        {
+            isValid = ParseUnsigned(value, 1 << 24, number) && number > 0;
+            config.requestQueueSize = (unsigned)number;
+        }
+        else if (name == "--response-queue")
+        {
+            isValid = ParseUnsigned(value, 1 << 24, number) && number > 0;
+            config.responseQueueSize = (unsigned)number;
+        }
+        else if (name == "--idle-timeout")
+        {
+            isValid = ParseUnsigned(value, 24 * 3600 * 1000, number) && number > 0;
+            config.idleTimeout = (unsigned)number;
+        }
+        else if (name == "--ack-every")
+        {
+            isValid = ParseUnsigned(value, 1 << 16, number) && number > 0;
+            config.ackEvery = (unsigned)number;
+        }
+        else if (name == "--ack-delay")
+        {
+            isValid = ParseUnsigned(value, 1000 * 1000, number);
+            config.ackDelay = (unsigned)number;
+        }
+        else if (name == "--output-dir")
+        {
+            isValid = *value != '\0';
+            config.outputDirectory = value;
+        }
+        else if (name == "--store")
+        {
+            if (strcmp(value, "memory") == 0)
+            {
+                config.storageMode = StorageMode::Memory;
+            }
+            else if (strcmp(value, "pwrite") == 0)
+            {
+                config.storageMode = StorageMode::Pwrite;
+            }
+            else if (strcmp(value, "mmap") == 0)
+            {
+                config.storageMode = StorageMode::Mmap;
+            }
+            else if (strcmp(value, "direct") == 0)
+            {
+                config.storageMode = StorageMode::Direct;
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        else if (name == "--memory-budget")
+        {
+            isValid = ParseUnsigned(value, 1 << 30, number);
+            config.memoryBudget = (unsigned)number;
+        }
+        else if (name == "--peer-quota")
+        {
+            isValid = ParseUnsigned(value, 1 << 30, number);
+            config.peerQuota = (unsigned)number;
+        }
+        else if (name == "--file-quota")
+        {
+            isValid = ParseUnsigned(value, 1 << 30, number);
+            config.fileQuota = (unsigned)number;
+        }
+        else if (name == "--metrics-socket")
+        {
+            isValid = *value != '\0';
+            config.metricsSocket = value;
+        }
+        else if (name == "--metrics-file")
+        {
+            isValid = *value != '\0';
+            config.metricsFile = value;
+        }
+        else if (name == "--metrics-interval")
+        {
+            isValid = ParseUnsigned(value, 24 * 3600 * 1000, number) && number > 0;
+            config.metricsInterval = (unsigned)number;
+        }
+        else if (name == "--over-budget")
+        {
+            if (strcmp(value, "drop-new") == 0)
+            {
+                config.budgetPolicy = BudgetPolicy::DropNew;
+            }
+            else if (strcmp(value, "evict-oldest") == 0)
+            {
+                config.budgetPolicy = BudgetPolicy::EvictOldest;
+            }
+            else if (strcmp(value, "stop-acks") == 0)
+            {
+                config.budgetPolicy = BudgetPolicy::StopAcks;
+            }
+            else
+            {
+                isValid = false;
+            }
+        }
+        else
+        {
+            isValid = false;
+        }
+
+        if (!isValid)
+        {
+            printf("Invalid argument: %s\n", argument);
+            PrintUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (config.storageMode != StorageMode::Memory && config.outputDirectory.empty())
+    {
+        printf("--store=%s needs --output-dir\n", config.storageMode == StorageMode::Pwrite ? "pwrite" :
+            config.storageMode == StorageMode::Mmap ? "mmap" : "direct");
+        PrintUsage(argv[0]);
+        return false;
+    }
+
+    return true;
+}
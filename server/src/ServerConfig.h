@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string>
+#include "Logger.h"
+#include "MemoryBudget.h"
+
+enum class IoBackend
+{
+    Epoll,  // recvmmsg/sendmmsg driven by an edge-triggered epoll loop
+    Uring   // io_uring with multishot recvmsg into provided buffers, falls back to Epoll when unavailable
+};
+
+enum class StorageMode
+{
+    Memory, // one heap block per file, streamed to the output directory (if any) in order
+    Pwrite, // the following ones reassemble files in place in the output directory
+    Mmap,
+    Direct
+};
+
+struct ServerConfig
+{
+    std::string address = "127.0.0.1";
+    unsigned short port = 8865;
+
+    // Number of SO_REUSEPORT sockets, each one is served by its own I/O thread and RequestHandler.
+    unsigned sockets = 1;
+    IoBackend ioBackend = IoBackend::Epoll;
+
+    // Protocol worker threads behind every socket; files are spread over them by id
+    unsigned workers = 1;
+
+    // Capacity of the lock-free rings between an I/O thread and its RequestHandler,
+    // the request ring exists once per worker
+    unsigned requestQueueSize = 8192;
+    unsigned responseQueueSize = 8192;
+
+    // A partial file is dropped after this many milliseconds without packages
+    unsigned idleTimeout = 10000;
+
+    // Acknowledgments are held back until ackEvery are due for a peer (new packages of a file with
+    // selective ACKs) or ackDelay microseconds passed; 0 sends them at the end of every request batch
+    unsigned ackEvery = 16;
+    unsigned ackDelay = 0;
+
+    // When set, every file is streamed into this directory as soon as its prefix is contiguous
+    std::string outputDirectory;
+
+    // Where files are kept until they complete; the disk modes need outputDirectory
+    StorageMode storageMode = StorageMode::Memory;
+
+    // MiB of partial files held in memory by the whole server, per peer and per file; 0 is unlimited
+    unsigned memoryBudget = 1024;
+    unsigned peerQuota = 0;
+    unsigned fileQuota = 0;
+    BudgetPolicy budgetPolicy = BudgetPolicy::DropNew;
+
+    // Metrics as JSON: served to every connection on a Unix socket and/or written to a file every metricsInterval ms
+    std::string metricsSocket;
+    std::string metricsFile;
+    unsigned metricsInterval = 1000;
+
+    // Lowest level logged at run time, Debug adds a line per package
+    LogLevel logLevel = LogLevel::Info;
+};
+
+// Parses "--name=value" arguments, prints usage and returns false on unknown or malformed ones
+bool ParseArguments(int argc, char** argv, ServerConfig& config);
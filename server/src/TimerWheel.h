@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Hierarchical timing wheel: LEVELS wheels of SLOTS buckets, each level SLOTS times coarser than
+// the one below. Schedule is O(1); a coarse bucket is moved down a level when its time range comes up,
+// so every entry is touched at most LEVELS times. Time is counted in caller-defined integer ticks.
+template <typename T>
+class TimerWheel
+{
+public:
+    static constexpr unsigned SLOT_BITS = 6;
+    static constexpr unsigned SLOTS = 1u << SLOT_BITS;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr uint64_t MAX_DELAY = (1ull << (SLOT_BITS * LEVELS)) - 1;
+
+    explicit TimerWheel(uint64_t now = 0)
+        : m_next(now + 1)
+    {
+    }
+
+    // The last tick passed to Advance
+    uint64_t GetNow() const
+    {
+        return m_next - 1;
+    }
+
+    size_t GetSize() const
+    {
+        return m_size;
+    }
+
+    bool IsEmpty() const
+    {
+        return m_size == 0;
+    }
+
+    // A deadline in the past fires on the next Advance. One further than MAX_DELAY ahead fires early,
+    // at MAX_DELAY, so the callback has to check its own deadline and reschedule.
+    void Schedule(uint64_t deadline, const T& item)
+    {
+        ++m_size;
+        Insert(Entry{ deadline, item });
+    }
+
+    // Moves the clock to now and calls expired(const T&) for every item that is due. The callback may
+    // schedule new items; they fire on a later Advance at the earliest.
+    template <typename Callback>
+    size_t Advance(uint64_t now, Callback&& expired)
+    {
+        size_t fired = 0;
+
+        for (; m_next <= now; )
+        {
+            if (m_size == 0)
+            {
+                m_next = now + 1;
+                break;
+            }
+
+            const uint64_t tick = m_next;
+            const unsigned index = tick & (SLOTS - 1);
+
+            // Entering a new range of the level above: spread its bucket over the levels below
+            for (unsigned level = 1; level < LEVELS && (tick >> (SLOT_BITS * (level - 1)) & (SLOTS - 1)) == 0; ++level)
+            {
+                Cascade(level, (tick >> (SLOT_BITS * level)) & (SLOTS - 1));
+            }
+
+            // Items scheduled by the callbacks below must land in a later bucket
+            m_next = tick + 1;
+
+            m_due.swap(m_slots[0][index]);
+            m_size -= m_due.size();
+            fired += m_due.size();
+
+            for (const auto& entry : m_due)
+            {
+                expired(entry.item);
+            }
+
+            m_due.clear();
+        }
+
+        return fired;
+    }
+
+private:
+    struct Entry
+    {
+        uint64_t deadline;
+        T item;
+    };
+
+    void Insert(Entry&& entry)
+    {
+        // m_next is the first tick that is still to be processed
+        if (entry.deadline < m_next)
+        {
+            entry.deadline = m_next;
+        }
+        else if (entry.deadline - m_next > MAX_DELAY)
+        {
+            entry.deadline = m_next + MAX_DELAY;
+        }
+
+        const uint64_t delay = entry.deadline - m_next;
+        unsigned level = 0;
+
+        while (level + 1 < LEVELS && delay >= (1ull << (SLOT_BITS * (level + 1))))
+        {
+            ++level;
+        }
+
+        m_slots[level][(entry.deadline >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(std::move(entry));
+    }
+
+    void Cascade(unsigned level, unsigned index)
+    {
+        std::vector<Entry> entries;
+        entries.swap(m_slots[level][index]);
+
+        for (auto& entry : entries)
+        {
+            Insert(std::move(entry));
+        }
+
+        // Hand the storage back, the bucket is empty again by now
+        if (m_slots[level][index].empty())
+        {
+            entries.clear();
+            m_slots[level][index].swap(entries);
+        }
+    }
+
+private:
+    std::vector<Entry> m_slots[LEVELS][SLOTS];
+    std::vector<Entry> m_due;
+    uint64_t m_next;
+    size_t m_size = 0;
+};
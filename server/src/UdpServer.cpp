@@ -1,13 +1,191 @@
 #include "UdpServer.h"
 #include "UdpSocket.h"
+#include "FileSink.h"
+#include "MemoryStore.h"
+#include "DiskStore.h"
+#include "Epoll.h"
+#include "IoUring.h"
+#include "Logger.h"
+#include "MetricsExporter.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
 
-const size_t BUF_SIZE = 1472;
-const unsigned POLL_TIMEOUT = 10;
+const size_t BATCH_SIZE = UdpSocket::MAX_BATCH_SIZE;
+const std::chrono::seconds STATISTICS_INTERVAL(1);
+
+// Tags of epoll events and io_uring requests; a send request carries its slot index above the tag
+enum EventTag : uint64_t
+{
+    SOCKET_EVENT,
+    RESPONSES_EVENT,
+    STOP_EVENT,
+    SEND_EVENT
+};
+
+const unsigned URING_ENTRIES = 256;
+const unsigned URING_COMPLETIONS = 8192;
+const unsigned URING_BUFFERS = 1024;
+const uint16_t URING_BUFFER_GROUP = 0;
+const unsigned URING_SEND_SLOTS = 128;
+const unsigned TAG_BITS = 8;
 
 
-UdpServer::UdpServer()
-    : m_stop(false)
+namespace
 {
+    // Offset of the 8 byte file id in the packet header: seq_number, seq_total, type
+    constexpr unsigned ID_OFFSET = sizeof(unsigned) + sizeof(unsigned) + sizeof(unsigned char);
+
+    // Classic BPF program for SO_ATTACH_REUSEPORT_CBPF. For UDP the packet data starts at the payload,
+    // so the program hashes both words of the id and returns the socket index, which keeps all packets
+    // of one file on the same socket. Datagrams too short to contain an id go to socket 0.
+    std::vector<sock_filter> MakeFileIdSteeringProgram(unsigned socketsCount)
+    {
+        return {
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, ID_OFFSET),       // A = id[0..3]
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),                     // X = A
+            BPF_STMT(BPF_LD | BPF_W | BPF_ABS, ID_OFFSET + 4),   // A = id[4..7]
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),              // A ^= X
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),              // A ^= A >> 16
+            BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 0x45d9f3b),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+            BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),              // A ^= A >> 16
+            BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, socketsCount),
+            BPF_STMT(BPF_RET | BPF_A, 0),
+        };
+    }
+
+    // A sendmsg request in flight, everything it points to must stay put until its completion
+    struct SendSlot
+    {
+        msghdr message;
+        iovec vector;
+        SockAddr address;
+        Response response;
+    };
+
+    io_uring_sqe* GetSqe(IoUring& ring)
+    {
+        io_uring_sqe* sqe = ring.GetSqe();
+
+        if (!sqe)
+        {
+            ring.Submit(0, -1);
+            sqe = ring.GetSqe();
+        }
+
+        return sqe;
+    }
+
+    // Multishot recvmsg: one request keeps posting a completion per datagram, each in its own provided buffer
+    bool ArmReceive(IoUring& ring, int fd, msghdr* message)
+    {
+        io_uring_sqe* sqe = GetSqe(ring);
+
+        if (!sqe)
+        {
+            return false;
+        }
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(message);
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        sqe->user_data = SOCKET_EVENT;
+
+        return true;
+    }
+
+    bool ArmPoll(IoUring& ring, int fd, EventTag tag, bool multishot)
+    {
+        io_uring_sqe* sqe = GetSqe(ring);
+
+        if (!sqe)
+        {
+            return false;
+        }
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = POLLIN;
+        sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+        sqe->user_data = tag;
+
+        return true;
+    }
+
+    bool QueueSend(IoUring& ring, int fd, SendSlot& slot, unsigned slotIndex)
+    {
+        io_uring_sqe* sqe = GetSqe(ring);
+
+        if (!sqe)
+        {
+            return false;
+        }
+
+        slot.vector.iov_base = slot.response.data;
+        slot.vector.iov_len = slot.response.size;
+
+        memset(&slot.message, 0, sizeof(msghdr));
+        slot.message.msg_name = slot.address.GetSockAddrPtr();
+        slot.message.msg_namelen = slot.address.GetSockAddrSize();
+        slot.message.msg_iov = &slot.vector;
+        slot.message.msg_iovlen = 1;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&slot.message);
+        sqe->len = 1;
+        sqe->user_data = SEND_EVENT | ((uint64_t)slotIndex << TAG_BITS);
+
+        return true;
+    }
+}
+
+
+UdpServer::UdpServer(const ServerConfig& config)
+    : m_config(config)
+    , m_startTime(std::chrono::steady_clock::now())
+    , m_stop(false)
+    , m_budget((uint64_t)config.memoryBudget << 20)
+{
+    m_config.sockets = std::max(m_config.sockets, 1u);
+
+    // Disk stores publish the files themselves, the sink is only needed to stream files kept in memory
+    switch (m_config.storageMode)
+    {
+    case StorageMode::Memory:
+        m_store = std::make_unique<MemoryStore>();
+
+        if (!m_config.outputDirectory.empty())
+        {
+            m_sink = std::make_unique<FileSink>(m_config.outputDirectory);
+        }
+        break;
+    case StorageMode::Pwrite:
+        m_store = std::make_unique<DiskStore>(m_config.outputDirectory, DiskStore::Mode::Pwrite);
+        break;
+    case StorageMode::Mmap:
+        m_store = std::make_unique<DiskStore>(m_config.outputDirectory, DiskStore::Mode::Mmap);
+        break;
+    case StorageMode::Direct:
+        m_store = std::make_unique<DiskStore>(m_config.outputDirectory, DiskStore::Mode::Direct, &m_budget);
+        break;
+    }
+
+    for (unsigned i = 0; i < m_config.sockets; ++i)
+    {
+        m_handlers.push_back(std::make_unique<RequestHandler>(m_config, m_sink.get(), m_store.get(), &m_budget));
+        m_counters.push_back(std::make_unique<IoCounters>());
+    }
 }
 
 UdpServer::~UdpServer()
@@ -17,52 +195,553 @@ UdpServer::~UdpServer()
 
 void UdpServer::Start(const std::string& address, unsigned short port)
 {
-    printf("Server started\n");
+    const bool reusePort = m_handlers.size() > 1;
+    std::vector<std::unique_ptr<UdpSocket>> sockets;
+
+    for (size_t i = 0; i < m_handlers.size(); ++i)
+    {
+        auto socket = std::make_unique<UdpSocket>(NetworkProtocol::IPv4, true);
+
+        if (reusePort && !socket->SetReusePort(true))
+        {
+            LOG_ERROR("Can't set SO_REUSEPORT");
+            return;
+        }
+
+        if (!socket->Bind(port, address, true, 1000))
+        {
+            LOG_ERROR("Can't bind: {}:{}", address, port);
+            return;
+        }
+
+        sockets.push_back(std::move(socket));
+    }
+
+    if (reusePort && !sockets.front()->AttachReusePortFilter(MakeFileIdSteeringProgram(sockets.size())))
+    {
+        LOG_WARNING("Can't attach SO_REUSEPORT filter, packets will be steered by address");
+    }
+
+    MetricsExporter metrics(m_config.metricsSocket, m_config.metricsFile, std::chrono::milliseconds(m_config.metricsInterval),
+        [this] { return GetMetricsJson(); });
+
+    if ((!m_config.metricsSocket.empty() || !m_config.metricsFile.empty()) && !metrics.Start())
+    {
+        return;
+    }
+
+    LOG_INFO("Server started");
+
+    std::vector<std::thread> threads;
+
+    for (size_t i = 1; i < sockets.size(); ++i)
+    {
+        threads.emplace_back([this, &sockets, i] { ThreadProc(*sockets[i], *m_handlers[i], *m_counters[i]); });
+    }
+
+    ThreadProc(*sockets.front(), *m_handlers.front(), *m_counters.front());
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+UdpServer::IoStatistics UdpServer::GetIoStatistics() const
+{
+    IoStatistics total;
+
+    for (const auto& counters : m_counters)
+    {
+        total.datagramsReceived += counters->datagramsReceived.load(std::memory_order_relaxed);
+        total.datagramsSent += counters->datagramsSent.load(std::memory_order_relaxed);
+        total.bytesReceived += counters->bytesReceived.load(std::memory_order_relaxed);
+        total.bytesSent += counters->bytesSent.load(std::memory_order_relaxed);
+        total.syscalls += counters->syscalls.load(std::memory_order_relaxed);
+        total.sendCalls += counters->sendCalls.load(std::memory_order_relaxed);
+    }
 
-    UdpSocket socket(NetworkProtocol::IPv4, true);
+    return total;
+}
+
+std::string UdpServer::GetMetricsJson() const
+{
+    const IoStatistics io = GetIoStatistics();
+    RequestHandler::Statistics total{};
+    RequestHandler::WorkerStatistics workers{};
+    size_t protocols = 0;
+    Histogram fileCompletion;
+    Histogram requestSojourn;
 
-    if (socket.Bind(port, address, true, 1000))
+    for (const auto& handler : m_handlers)
     {
-        while (!m_stop)
+        const auto statistics = handler->GetStatistics();
+
+        total.requestsDropped += statistics.requestsDropped;
+        total.responsesFull += statistics.responsesFull;
+        total.requestsQueued += statistics.requestsQueued;
+        total.responsesQueued += statistics.responsesQueued;
+        total.memoryUsed = statistics.memoryUsed;
+        total.memoryLimit = statistics.memoryLimit;
+
+        for (const auto& worker : statistics.workers)
         {
-            if (socket.CanRead(POLL_TIMEOUT))
+            workers.requestsProcessed += worker.requestsProcessed;
+            workers.filesExpired += worker.filesExpired;
+            workers.filesRefused += worker.filesRefused;
+            workers.filesEvicted += worker.filesEvicted;
+            workers.packagesRefused += worker.packagesRefused;
+            workers.packagesStored += worker.packagesStored;
+            workers.duplicates += worker.duplicates;
+            workers.filesCompleted += worker.filesCompleted;
+            workers.acks += worker.acks;
+            workers.sacks += worker.sacks;
+            workers.checksumNanoseconds += worker.checksumNanoseconds;
+            workers.checksumSamples += worker.checksumSamples;
+            protocols += worker.protocols;
+        }
+
+        handler->CollectHistograms(fileCompletion, requestSojourn);
+    }
+
+    JsonWriter json;
+    json.BeginObject();
+    json.Add("uptime_s", std::chrono::duration<double>(std::chrono::steady_clock::now() - m_startTime).count());
+
+    json.BeginObject("io");
+    json.Add("datagrams_received", io.datagramsReceived);
+    json.Add("datagrams_sent", io.datagramsSent);
+    json.Add("bytes_received", io.bytesReceived);
+    json.Add("bytes_sent", io.bytesSent);
+    json.Add("syscalls", io.syscalls);
+    json.Add("send_calls", io.sendCalls);
+    json.EndObject();
+
+    json.BeginObject("protocol");
+    json.Add("requests_processed", workers.requestsProcessed);
+    json.Add("packages_stored", workers.packagesStored);
+    json.Add("duplicates", workers.duplicates);
+    json.Add("files_completed", workers.filesCompleted);
+    json.Add("acks_sent", workers.acks);
+    json.Add("sacks_sent", workers.sacks);
+    json.Add("files_expired", workers.filesExpired);
+    json.Add("files_refused", workers.filesRefused);
+    json.Add("files_evicted", workers.filesEvicted);
+    json.Add("packages_refused", workers.packagesRefused);
+    json.Add("checksum_ns_per_package", workers.checksumSamples > 0 ? (double)workers.checksumNanoseconds / workers.checksumSamples : 0.0);
+    json.Add("peers", (uint64_t)protocols);
+    json.EndObject();
+
+    json.BeginObject("queues");
+    json.Add("requests_queued", (uint64_t)total.requestsQueued);
+    json.Add("responses_queued", (uint64_t)total.responsesQueued);
+    json.Add("requests_dropped", total.requestsDropped);
+    json.Add("responses_full", total.responsesFull);
+    json.EndObject();
+
+    json.BeginObject("memory");
+    json.Add("used_bytes", total.memoryUsed);
+    json.Add("limit_bytes", total.memoryLimit);
+    json.EndObject();
+
+    json.Add("file_completion", fileCompletion);
+    json.Add("request_sojourn", requestSojourn);
+    json.EndObject();
+
+    return json.GetText();
+}
+
+void UdpServer::IoCounters::Publish(const IoStatistics& statistics)
+{
+    datagramsReceived.store(statistics.datagramsReceived, std::memory_order_relaxed);
+    datagramsSent.store(statistics.datagramsSent, std::memory_order_relaxed);
+    bytesReceived.store(statistics.bytesReceived, std::memory_order_relaxed);
+    bytesSent.store(statistics.bytesSent, std::memory_order_relaxed);
+    syscalls.store(statistics.syscalls, std::memory_order_relaxed);
+    sendCalls.store(statistics.sendCalls, std::memory_order_relaxed);
+}
+
+void UdpServer::ThreadProc(UdpSocket& socket, RequestHandler& handler, IoCounters& counters)
+{
+    if (m_config.ioBackend == IoBackend::Uring && UringThreadProc(socket, handler, counters))
+    {
+        return;
+    }
+
+    EpollThreadProc(socket, handler, counters);
+}
+
+void UdpServer::EpollThreadProc(UdpSocket& socket, RequestHandler& handler, IoCounters& counters)
+{
+    Epoll epoll;
+
+    if (!epoll.IsSet()
+        || !epoll.Add(socket.GetSocketId(), EPOLLIN | EPOLLOUT | EPOLLET, SOCKET_EVENT)
+        || !epoll.Add(handler.GetResponsesEventFd(), EPOLLIN | EPOLLET, RESPONSES_EVENT)
+        || !epoll.Add(m_stopEvent.GetFd(), EPOLLIN, STOP_EVENT))
+    {
+        LOG_ERROR("Can't set up the event loop");
+        return;
+    }
+
+    std::vector<PacketBuffer> buffers(BATCH_SIZE);
+    std::vector<Datagram> datagrams(BATCH_SIZE);
+    RequestHandler::Responses responses;
+    size_t responsesSent = 0;
+    epoll_event events[Epoll::MAX_EVENTS];
+    IoStatistics statistics;
+
+    // Edge-triggered: a direction stays ready until the socket reports EAGAIN
+    bool readable = true;
+    bool writable = true;
+
+    RequestHandler::Statistics reported = handler.GetStatistics();
+    auto reportTime = std::chrono::steady_clock::now();
+
+    while (!m_stop)
+    {
+        if (readable)
+        {
+            readable = ReadRequests(socket, handler, buffers, datagrams, statistics);
+        }
+
+        if (writable)
+        {
+            if (responsesSent == responses.size() && handler.HasResponses())
             {
-                std::vector<char> buffer(BUF_SIZE);
-                std::string clientAddress;
-                unsigned short clientPort;
+                handler.GetResponses(responses);
+                responsesSent = 0;
+            }
 
-                const int bytesRead = socket.Read(buffer.data(), buffer.size(), &clientAddress, &clientPort);
+            writable = SendResponses(socket, responses, responsesSent, statistics);
+        }
+
+        const bool canWrite = writable && handler.HasResponses();
+
+        // Block only when there is nothing to do: new datagrams, room in the send buffer,
+        // new responses and Stop all arrive as events
+        if (!readable && !canWrite)
+        {
+            const int eventsCount = epoll.Wait(events, (int)std::chrono::milliseconds(STATISTICS_INTERVAL).count());
+            ++statistics.syscalls;
 
-                if (bytesRead > 0)
+            for (int i = 0; i < eventsCount; ++i)
+            {
+                if (events[i].data.u64 == SOCKET_EVENT)
                 {
-                    buffer.resize(bytesRead);
-                    m_handler.AddRequest(clientAddress, clientPort, std::move(buffer));
+                    readable |= (events[i].events & (EPOLLIN | EPOLLERR)) != 0;
+                    writable |= (events[i].events & (EPOLLOUT | EPOLLERR)) != 0;
                 }
             }
+        }
+
+        counters.Publish(statistics);
+        ReportStatistics(handler, reported, reportTime);
+    }
+}
+
+bool UdpServer::UringThreadProc(UdpSocket& socket, RequestHandler& handler, IoCounters& counters)
+{
+    const int fd = socket.GetSocketId();
+
+    // Provided buffer layout: io_uring_recvmsg_out, source address, payload
+    msghdr receiveMessage;
+    memset(&receiveMessage, 0, sizeof(msghdr));
+    receiveMessage.msg_namelen = sizeof(sockaddr_storage);
+    const unsigned payloadOffset = sizeof(io_uring_recvmsg_out) + receiveMessage.msg_namelen;
+
+    std::vector<SendSlot> slots(URING_SEND_SLOTS);
+    std::vector<unsigned> freeSlots;
+
+    for (unsigned i = URING_SEND_SLOTS; i > 0; --i)
+    {
+        freeSlots.push_back(i - 1);
+    }
+
+    // Declared after the slots: closing the ring first cancels the sends that still point to them
+    IoUring ring;
+
+    if (!ring.Init(URING_ENTRIES, URING_COMPLETIONS)
+        || !ring.RegisterBuffers(URING_BUFFER_GROUP, URING_BUFFERS, payloadOffset + PacketBuffer::GetCapacity())
+        || !ArmReceive(ring, fd, &receiveMessage)
+        || !ArmPoll(ring, handler.GetResponsesEventFd(), RESPONSES_EVENT, true)
+        || !ArmPoll(ring, m_stopEvent.GetFd(), STOP_EVENT, false))
+    {
+        LOG_WARNING("io_uring is not available, using epoll");
+        return false;
+    }
+
+    RequestHandler::Responses responses;
+    size_t responsesSent = 0;
+    IoStatistics statistics;
+    bool received = false;
 
-            if (m_handler.HasResponses())
+    RequestHandler::Statistics reported = handler.GetStatistics();
+    auto reportTime = std::chrono::steady_clock::now();
+
+    while (!m_stop)
+    {
+        bool rearmReceive = false;
+        bool rearmResponses = false;
+        bool unsupported = false;
+        unsigned requestsAdded = 0;
+
+        ring.ForEachCompletion([&](const io_uring_cqe& cqe)
+        {
+            const uint64_t tag = cqe.user_data & ((1u << TAG_BITS) - 1);
+
+            if (tag == SOCKET_EVENT)
             {
-                for (const auto& response : m_handler.GetResponses())
+                if (cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER))
                 {
-                    if (socket.Write(response.second.data(), response.second.size(), response.first.address, response.first.port) == (int)response.second.size())
-                    {
-                        //printf("Package sent\n");
-                    }
-                    else
+                    const unsigned bufferId = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                    const char* buffer = ring.GetBuffer(bufferId);
+                    const auto* header = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+
+                    if (!(header->flags & MSG_TRUNC) && header->payloadlen > 0)
                     {
-                        printf("Can't send package\n");
+                        PacketBuffer packet = PacketBuffer::Allocate();
+                        memcpy(packet.GetData(), buffer + payloadOffset, header->payloadlen);
+                        packet.SetSize(header->payloadlen);
+                        statistics.bytesReceived += header->payloadlen;
+
+                        const auto* name = reinterpret_cast<const sockaddr*>(buffer + sizeof(io_uring_recvmsg_out));
+                        const socklen_t nameSize = std::min<socklen_t>(header->namelen, receiveMessage.msg_namelen);
+
+                        handler.AddRequest(Endpoint::FromSockAddr(name, nameSize), std::move(packet));
+                        ++requestsAdded;
                     }
+
+                    ring.RecycleBuffer(bufferId);
+                    received = true;
+                }
+                else if (cqe.res == -EINVAL && !received)
+                {
+                    unsupported = true;
                 }
+
+                // Multishot stops on errors, when the buffers ran out or the completion queue overflowed
+                rearmReceive |= !(cqe.flags & IORING_CQE_F_MORE);
             }
+            else if (tag == SEND_EVENT)
+            {
+                const unsigned slotIndex = (unsigned)(cqe.user_data >> TAG_BITS);
+
+                if (cqe.res >= 0)
+                {
+                    ++statistics.datagramsSent;
+                    statistics.bytesSent += cqe.res;
+                }
+                else
+                {
+                    LOG_ERROR("Can't send package to {}", slots[slotIndex].address.GetEndpoint().ToString());
+                }
+
+                freeSlots.push_back(slotIndex);
+            }
+            else if (tag == RESPONSES_EVENT)
+            {
+                rearmResponses |= !(cqe.flags & IORING_CQE_F_MORE);
+            }
+        });
+
+        if (unsupported)
+        {
+            // Multishot recvmsg needs Linux 6.0, provided buffer rings are available since 5.19
+            LOG_WARNING("io_uring multishot receive is not supported, using epoll");
+            return false;
+        }
+
+        ring.CommitBuffers();
+        statistics.datagramsReceived += requestsAdded;
+
+        if (requestsAdded > 0)
+        {
+            handler.SubmitRequests();
+        }
+
+        if (rearmReceive)
+        {
+            ArmReceive(ring, fd, &receiveMessage);
+        }
+
+        if (rearmResponses)
+        {
+            ArmPoll(ring, handler.GetResponsesEventFd(), RESPONSES_EVENT, true);
+        }
+
+        if (responsesSent == responses.size() && handler.HasResponses())
+        {
+            handler.GetResponses(responses);
+            responsesSent = 0;
+            ++statistics.sendCalls;
+        }
+
+        for (; responsesSent < responses.size() && !freeSlots.empty(); ++responsesSent)
+        {
+            const unsigned slotIndex = freeSlots.back();
+            SendSlot& slot = slots[slotIndex];
+            slot.address = SockAddr(responses[responsesSent].first);
+            slot.response = responses[responsesSent].second;
+
+            if (!QueueSend(ring, fd, slot, slotIndex))
+            {
+                break;
+            }
+
+            freeSlots.pop_back();
         }
+
+        // Wait only when every response is queued or no slot is free; otherwise just submit
+        const bool idle = freeSlots.empty() || (responsesSent == responses.size() && !handler.HasResponses());
+
+        if (idle || ring.GetPendingSubmissions() > 0)
+        {
+            ring.Submit(idle ? 1 : 0, (int)std::chrono::milliseconds(STATISTICS_INTERVAL).count());
+        }
+
+        statistics.syscalls = ring.GetEnterCount();
+        counters.Publish(statistics);
+        ReportStatistics(handler, reported, reportTime);
+    }
+
+    return true;
+}
+
+bool UdpServer::ReadRequests(UdpSocket& socket, RequestHandler& handler,
+    std::vector<PacketBuffer>& buffers, std::vector<Datagram>& datagrams, IoStatistics& statistics)
+{
+    for (size_t i = 0; i < BATCH_SIZE; ++i)
+    {
+        if (!buffers[i].IsSet())
+        {
+            buffers[i] = PacketBuffer::Allocate();
+        }
+
+        datagrams[i].buff = buffers[i].GetData();
+        datagrams[i].bufSize = PacketBuffer::GetCapacity();
+    }
+
+    const int messagesRead = socket.ReadMany(datagrams.data(), BATCH_SIZE);
+    ++statistics.syscalls;
+
+    for (int i = 0; i < messagesRead; ++i)
+    {
+        if (datagrams[i].dataSize > 0)
+        {
+            buffers[i].SetSize(datagrams[i].dataSize);
+            statistics.bytesReceived += datagrams[i].dataSize;
+            handler.AddRequest(datagrams[i].endpoint, std::move(buffers[i]));
+        }
+    }
+
+    if (messagesRead > 0)
+    {
+        statistics.datagramsReceived += messagesRead;
+        handler.SubmitRequests();
+    }
+
+    // A short batch means the receive queue is drained, the next datagram raises a new edge
+    return messagesRead == (int)BATCH_SIZE;
+}
+
+bool UdpServer::SendResponses(UdpSocket& socket, RequestHandler::Responses& responses, size_t& sent, IoStatistics& statistics)
+{
+    Datagram datagrams[BATCH_SIZE];
+
+    while (sent < responses.size())
+    {
+        const size_t count = std::min(responses.size() - sent, BATCH_SIZE);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto& response = responses[sent + i];
+            datagrams[i].buff = response.second.data;
+            datagrams[i].bufSize = datagrams[i].dataSize = response.second.size;
+            datagrams[i].endpoint = response.first;
+        }
+
+        const int messagesSent = socket.WriteMany(datagrams, count);
+        ++statistics.syscalls;
+        ++statistics.sendCalls;
+
+        if (messagesSent > 0)
+        {
+            for (int i = 0; i < messagesSent; ++i)
+            {
+                statistics.bytesSent += datagrams[i].dataSize;
+            }
+
+            sent += messagesSent;
+            statistics.datagramsSent += messagesSent;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // The rest is sent on the next EPOLLOUT edge
+            return false;
+        }
+        else
+        {
+            LOG_ERROR("Can't send package to {}", responses[sent].first.ToString());
+            ++sent;
+        }
+    }
+
+    return true;
+}
+
+void UdpServer::ReportStatistics(RequestHandler& handler, RequestHandler::Statistics& reported,
+    std::chrono::steady_clock::time_point& reportTime)
+{
+    const auto now = std::chrono::steady_clock::now();
+
+    if (now - reportTime < STATISTICS_INTERVAL)
+    {
+        return;
+    }
+
+    reportTime = now;
+    const auto statistics = handler.GetStatistics();
+
+    if (statistics.requestsDropped != reported.requestsDropped || statistics.responsesFull != reported.responsesFull)
+    {
+        LOG_INFO("Queues: {} requests dropped, {} waits for responses, {}/{} queued",
+            statistics.requestsDropped - reported.requestsDropped, statistics.responsesFull - reported.responsesFull,
+            statistics.requestsQueued, statistics.responsesQueued);
+    }
+
+    if (statistics.memoryUsed != reported.memoryUsed || statistics.filesRefused != reported.filesRefused ||
+        statistics.filesEvicted != reported.filesEvicted || statistics.packagesRefused != reported.packagesRefused)
+    {
+        LOG_INFO("Memory: {:.1f}/{} MiB, {} files refused, {} files evicted, {} packages refused",
+            statistics.memoryUsed / 1048576.0, statistics.memoryLimit >> 20, statistics.filesRefused - reported.filesRefused,
+            statistics.filesEvicted - reported.filesEvicted, statistics.packagesRefused - reported.packagesRefused);
     }
-    else
+
+    // Load balance over the workers: requests processed since the last report and peers in progress
+    if (statistics.workers.size() > 1 && statistics.workers.size() == reported.workers.size())
     {
-        printf("Can't bind: %s:%hu\n", address.c_str(), port);
+        std::string line;
+        bool isActive = false;
+
+        for (size_t i = 0; i < statistics.workers.size(); ++i)
+        {
+            const auto processed = statistics.workers[i].requestsProcessed - reported.workers[i].requestsProcessed;
+            isActive |= processed > 0;
+            line += " " + std::to_string(processed) + "/" + std::to_string(statistics.workers[i].protocols);
+        }
+
+        if (isActive)
+        {
+            LOG_INFO("Workers (requests/peers):{}", line);
+        }
     }
+
+    reported = statistics;
 }
 
 void UdpServer::Stop()
 {
     m_stop = true;
+    m_stopEvent.Signal();
 }
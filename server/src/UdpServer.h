@@ -1,18 +1,77 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <string>
+#include <vector>
+#include <memory>
 #include "RequestHandler.h"
+#include "ServerConfig.h"
+#include "IDataSink.h"
+#include "IFileStore.h"
+#include "EventFd.h"
+
+class UdpSocket;
 
 class UdpServer
 {
 public:
-    UdpServer();
+    // Totals over all I/O threads. Syscalls counts only the calls made by the I/O threads themselves:
+    // recvmmsg, sendmmsg and epoll_wait, or io_uring_enter.
+    struct IoStatistics
+    {
+        uint64_t datagramsReceived = 0;
+        uint64_t datagramsSent = 0;
+        uint64_t bytesReceived = 0;
+        uint64_t bytesSent = 0;
+        uint64_t syscalls = 0;
+        uint64_t sendCalls = 0;     // sendmmsg calls, with io_uring the response batches taken from the handler
+    };
+
+    explicit UdpServer(const ServerConfig& config = ServerConfig());
     ~UdpServer();
     void Start(const std::string& address, unsigned short port);
     void Stop();
 
+    IoStatistics GetIoStatistics() const;
+    // Everything the metrics endpoint exposes, aggregated over all threads, as one JSON object
+    std::string GetMetricsJson() const;
+
+private:
+    // Written by one I/O thread, read by GetIoStatistics
+    struct alignas(64) IoCounters
+    {
+        std::atomic<uint64_t> datagramsReceived{ 0 };
+        std::atomic<uint64_t> datagramsSent{ 0 };
+        std::atomic<uint64_t> bytesReceived{ 0 };
+        std::atomic<uint64_t> bytesSent{ 0 };
+        std::atomic<uint64_t> syscalls{ 0 };
+        std::atomic<uint64_t> sendCalls{ 0 };
+
+        void Publish(const IoStatistics& statistics);
+    };
+
+    void ThreadProc(UdpSocket& socket, RequestHandler& handler, IoCounters& counters);
+    void EpollThreadProc(UdpSocket& socket, RequestHandler& handler, IoCounters& counters);
+    // Returns false when io_uring can't be used, before anything was received
+    bool UringThreadProc(UdpSocket& socket, RequestHandler& handler, IoCounters& counters);
+
+    // Both return whether the socket may still be ready in that direction
+    bool ReadRequests(UdpSocket& socket, RequestHandler& handler,
+        std::vector<PacketBuffer>& buffers, std::vector<Datagram>& datagrams, IoStatistics& statistics);
+    bool SendResponses(UdpSocket& socket, RequestHandler::Responses& responses, size_t& sent, IoStatistics& statistics);
+
+    void ReportStatistics(RequestHandler& handler, RequestHandler::Statistics& reported,
+        std::chrono::steady_clock::time_point& reportTime);
+
 private:
+    ServerConfig m_config;
+    std::chrono::steady_clock::time_point m_startTime;
     std::atomic_bool m_stop;
-    RequestHandler m_handler;
+    EventFd m_stopEvent;
+    std::unique_ptr<IDataSink> m_sink;
+    std::unique_ptr<IFileStore> m_store;
+    MemoryBudget m_budget;
+    std::vector<std::unique_ptr<RequestHandler>> m_handlers;
+    std::vector<std::unique_ptr<IoCounters>> m_counters;
 };
@@ -1,5 +1,7 @@
 #pragma once
 #include <cassert>
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 #include <string>
 #include <chrono>
@@ -8,6 +10,7 @@
 #include <poll.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
+#include <linux/filter.h>
 
 #ifndef INVALID_SOCKET
     #define INVALID_SOCKET (-1)
@@ -24,7 +27,63 @@ enum class NetworkProtocol
     Unknown
 };
 
-class SockAddr;
+// Compact trivially copyable peer address: family, raw address bytes and port (network byte order).
+// Used as a lookup key on the packet path; text is produced only for logging.
+struct Endpoint
+{
+    uint16_t family = AF_UNSPEC;
+    uint16_t port = 0;
+    unsigned char address[16] = {};
+
+    static Endpoint FromSockAddr(const sockaddr* addr, socklen_t addrSize);
+
+    unsigned short GetPort() const;
+    std::string ToString() const;
+
+    bool operator==(const Endpoint& other) const;
+    bool operator!=(const Endpoint& other) const;
+    bool operator<(const Endpoint& other) const;
+};
+
+static_assert(std::is_trivially_copyable<Endpoint>::value && sizeof(Endpoint) == 20, "Endpoint must stay compact");
+
+struct EndpointHash
+{
+    size_t operator()(const Endpoint& endpoint) const;
+};
+
+class SockAddr
+{
+public:
+    SockAddr();
+    SockAddr(const sockaddr* addr, socklen_t addrSize);
+    explicit SockAddr(const Endpoint& endpoint);
+    ~SockAddr() = default;
+
+    void Init(const sockaddr* addr, socklen_t addrSize);
+    bool IsSet() const;
+    NetworkProtocol GetNetworkProtocol() const;
+    Endpoint GetEndpoint() const;
+    const sockaddr* GetSockAddr() const;
+    socklen_t GetSockAddrSize() const;
+    sockaddr* GetSockAddrPtr();
+    socklen_t* GetSockAddrSizePtr();
+
+private:
+    bool Init();
+
+private:
+    sockaddr_storage m_sockaddr;
+    socklen_t m_sockaddrSize;
+};
+
+struct Datagram
+{
+    char* buff = nullptr;
+    unsigned bufSize = 0;  // capacity of buff
+    unsigned dataSize = 0; // bytes received by ReadMany, 0 if truncated / bytes to send by WriteMany
+    Endpoint endpoint;     // source for ReadMany, destination for WriteMany
+};
 
 std::vector<SockAddr> GetAddressInfo(const std::string& address, unsigned short port, NetworkProtocol networkProtocol);
 
@@ -40,13 +99,29 @@ public:
 
     bool Bind(unsigned short port, const std::string& address, bool reuseAddress, unsigned timeout);
 
+    // Must be called before Bind. The filter is attached to the whole SO_REUSEPORT group
+    // and returns the index (in bind order) of the socket that should receive a datagram.
+    bool SetReusePort(bool reusePort);
+    bool AttachReusePortFilter(const std::vector<sock_filter>& program);
+
     bool IsSet() const;
+    int GetSocketId() const;
 
     bool SetNonBlockingMode(bool nonBlocking);
     bool IsNonBlocking() const;
 
     int Read(char* buff, unsigned bufSize, std::string* outAddress, unsigned short* outPort);
+    int Read(char* buff, unsigned bufSize, Endpoint* outEndpoint);
     int Write(const char* buff, unsigned bufSize, const std::string& address, unsigned short port);
+    int Write(const char* buff, unsigned bufSize, const SockAddr& address);
+    int Write(const char* buff, unsigned bufSize, const Endpoint& endpoint);
+
+    // Batched versions on top of recvmmsg/sendmmsg, at most MAX_BATCH_SIZE datagrams per call.
+    // Return the number of datagrams read/sent or SOCKET_ERROR.
+    int ReadMany(Datagram* datagrams, unsigned count);
+    int WriteMany(const Datagram* datagrams, unsigned count);
+
+    static constexpr unsigned MAX_BATCH_SIZE = 64;
 
     bool CanRead(unsigned waitTimeoutMillis) const;
     bool CanWrite(unsigned waitTimeoutMillis) const;
@@ -61,26 +136,3 @@ private:
     NetworkProtocol m_netProtocol;
     bool m_nonBlocking;
 };
-
-class SockAddr
-{
-public:
-    SockAddr();
-    SockAddr(const sockaddr* addr, socklen_t addrSize);
-    ~SockAddr() = default;
-
-    void Init(const sockaddr* addr, socklen_t addrSize);
-    bool IsSet() const;
-    NetworkProtocol GetNetworkProtocol() const;
-    const sockaddr* GetSockAddr() const;
-    socklen_t GetSockAddrSize() const;
-    sockaddr* GetSockAddrPtr();
-    socklen_t* GetSockAddrSizePtr();
-
-private:
-    bool Init();
-
-private:
-    std::vector<char> m_sockaddrBuffer;
-    socklen_t m_sockaddrSize;
-};
@@ -1,9 +1,19 @@
 #include "UdpServer.h"
+#include "ServerConfig.h"
 
-int main()
+int main(int argc, char** argv)
 {
-    UdpServer server;
-    server.Start("127.0.0.1", 8865);
+    ServerConfig config;
+
+    if (!ParseArguments(argc, argv, config))
+    {
+        return 1;
+    }
+
+    Logger::SetLevel(config.logLevel);
+
+    UdpServer server(config);
+    server.Start(config.address, config.port);
 
     return 0;
 }